@@ -4,37 +4,799 @@
 #include <mruby/variable.h>
 #include <mruby/value.h>
 #include <mruby/string.h>
+#include <mruby/data.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <math.h>
 
-// C struct to avoid constantly getting ivars.
+// Optional per-method counters, for #fastcanvas_stats. Enable with FASTCANVAS_STATS=1 when building mruby.
+// When disabled, the macros below compile to nothing.
+#ifdef FASTCANVAS_STATS
+#include <time.h>
+
+enum {
+  STAT_CLEAR, STAT_FILL, STAT_GET_PIXEL, STAT_SET_PIXEL, STAT_LINE, STAT_RECTANGLE, STAT_PATH, STAT_POLYGON,
+  STAT_ELLIPSE, STAT_ARC, STAT_PIE, STAT_ROUNDED_RECTANGLE, STAT_CHAR, STAT_TEXT, STAT_BITMAP, STAT_DRAW_BATCH,
+  STAT_FLOOD_FILL, STAT_MOVE_REGION, STAT_SCROLL, STAT_DITHER_IMAGE, STAT_COMPOSITE, STAT_CLEAR_RECT, STAT_FILL_RECT,
+  STAT_TEXT_WIDTH, STAT_TEXT_BOX,
+  STAT_COUNT
+};
+
+static const char* const c_stat_names[STAT_COUNT] = {
+  "clear", "fill", "_get_pixel", "_set_pixel", "_line", "_rectangle", "_path", "_polygon",
+  "_ellipse", "_arc", "_pie", "_rounded_rectangle", "_char", "text", "_bitmap", "draw_batch",
+  "_flood_fill", "move_region", "scroll", "_dither_image", "composite", "clear_rect", "fill_rect",
+  "text_width", "text_box",
+};
+
+typedef struct {
+  uint64_t calls;
+  uint64_t pixels;
+  uint64_t nsec;
+} canvas_stat_t;
+
+// Elapsed time from a monotonic clock where there is one, so time spent waiting counts too.
+// Otherwise CPU time from clock(), which leaves that out.
+static inline uint64_t
+c_stats_now(void) {
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+#else
+  return ((uint64_t)clock() * 1000000000) / CLOCKS_PER_SEC;
+#endif
+}
+
+#define STATS_PIXELS(c, n)    ((c)->stats_pixels += (n))
+#define STATS_BEGIN(c)        uint64_t stats_start = c_stats_now(); uint64_t stats_pixels = (c)->stats_pixels
+#define STATS_END(c, stat)    c_canvas_stats_add((c), (stat), stats_start, stats_pixels)
+#else
+#define STATS_PIXELS(c, n)
+#define STATS_BEGIN(c)
+#define STATS_END(c, stat)
+#endif
+
+typedef struct pixel_format pixel_format_t;
+
+// One entry of a font's sparse map from code point to glyph index.
+typedef struct {
+  uint32_t codepoint;
+  uint32_t glyph;
+} font_map_entry_t;
+
+// Dirty regions and #diff_and_commit copy of @front_framebuffers, exchanged with the canvas's own by #swap_buffers.
 typedef struct {
+  mrb_int*  dirty_min;
+  mrb_int*  dirty_max;
+  mrb_int   dirty_pages;
+  uint8_t*  shadow;
+  mrb_int   shadow_size;
+  mrb_int   shadow_columns;
+  mrb_int   shadow_rows;
+  const pixel_format_t* shadow_format;
+} canvas_front_t;
+
+// C struct cached on the Canvas, to avoid constantly getting ivars.
+typedef struct canvas {
+  // Ivar symbols, interned once when the cache is created.
+  mrb_sym   sym_framebuffers;
+  mrb_sym   sym_invert_x;
+  mrb_sym   sym_invert_y;
+  mrb_sym   sym_swap_xy;
+  mrb_sym   sym_current_color;
+  mrb_sym   sym_pixel_format;
+  mrb_sym   sym_x_max;
+  mrb_sym   sym_y_max;
+
+  // Ruby state the cache was built from, compared against the ivars on every call.
   mrb_value framebuffers;
+  mrb_bool  invert_x;
+  mrb_bool  invert_y;
+  mrb_bool  swap_xy;
+  mrb_value pixel_format;
+
+  // Layout of the framebuffers, and the kernels that write it.
+  const pixel_format_t* format;
+
+  // Writers specialized for the current orientation and format. They take canvas coordinates, already clipped.
+  void (*write_pixel)(struct canvas* c, mrb_int x, mrb_int y, int color);
+  void (*write_rect)(struct canvas* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, int color);
+  int  (*read_pixel)(struct canvas* c, mrb_int x, mrb_int y);
+
+  // Raw pointer to the bytes of each framebuffer String. One per color for 1bpp formats, else just one.
+  uint8_t** planes;
+  mrb_int   plane_count;
+  mrb_int   plane_size;
+
+  // Geometry
   mrb_int   colors;
+  mrb_int   color_max;
   mrb_int   columns;
   mrb_int   rows;
   mrb_int   x_max;
   mrb_int   y_max;
-  mrb_bool  invert_x;
-  mrb_bool  invert_y;
-  mrb_bool  swap_xy;
-  mrb_int   current_color;
+  mrb_int   pages;
+
+  // Optional clip rectangle set from Ruby, in canvas coordinates.
+  mrb_bool  user_clip;
+  mrb_int   user_clip_x1;
+  mrb_int   user_clip_y1;
+  mrb_int   user_clip_x2;
+  mrb_int   user_clip_y2;
+
+  // Width of outlines, set from Ruby. 1 draws them with the 1px line and ellipse steppers.
+  mrb_int   stroke_width;
+
+  // Visible area in canvas coordinates: the framebuffer's bounds, intersected with any user clip.
+  mrb_int   clip_x1;
+  mrb_int   clip_y1;
+  mrb_int   clip_x2;
+  mrb_int   clip_y2;
+
+  // Changed column range of each page since the last #clear_dirty. Empty when min > max.
+  mrb_int*  dirty_min;
+  mrb_int*  dirty_max;
+  mrb_int   dirty_pages;
+
+  // Copy of every plane, back to back, as of the last #diff_and_commit. Only valid for the layout it was taken with.
+  uint8_t*  shadow;
+  mrb_int   shadow_size;
+  mrb_int   shadow_columns;
+  mrb_int   shadow_rows;
+  const pixel_format_t* shadow_format;
+
+  // The same for the set last swapped out. Not valid until dirty_pages matches the canvas's.
+  canvas_front_t front;
+
+  // Font glyphs packed into one table, rebuilt when @font_characters is replaced.
+  mrb_sym   sym_font_characters;
+  mrb_value font_characters;
+  uint8_t*  font_table;
+  uint16_t* font_glyph_sizes;
+  mrb_int   font_glyph_count;
+  mrb_int   font_glyph_stride;
+  mrb_int   font_last_character;
+  mrb_int   font_height;
+  mrb_int   font_width;
+
+  // Open addressed hash from a glyph Array's pointer to its index, so _char can find it in the table.
+  mrb_int*  font_lookup;
+  mrb_int   font_lookup_size;
+
+  // Optional width of each glyph from @font_widths, for proportional fonts. NULL when all are @font_width.
+  mrb_value font_widths;
+  uint16_t* font_glyph_widths;
+
+  // Optional glyph for each code point outside the font's run from SPACE, from @font_map. Sorted by code point.
+  mrb_value font_map;
+  font_map_entry_t* font_map_entries;
+  mrb_int   font_map_count;
+
+#ifdef FASTCANVAS_STATS
+  // Pixels written since the cache was created, and totals for each method.
+  uint64_t      stats_pixels;
+  canvas_stat_t stats[STAT_COUNT];
+#endif
 } canvas_t;
 
-// Get the ivars from the ruby Canvas once.
 static void
-mrb_get_canvas_data(mrb_state* mrb, mrb_value self, canvas_t* canvas) {
-  canvas->framebuffers  = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@framebuffers"));
-  canvas->colors        = mrb_fixnum(mrb_iv_get(mrb, self,  mrb_intern_lit(mrb, "@colors")));
-  canvas->columns       = mrb_fixnum(mrb_iv_get(mrb, self,  mrb_intern_lit(mrb, "@columns")));
-  canvas->rows          = mrb_fixnum(mrb_iv_get(mrb, self,  mrb_intern_lit(mrb, "@rows")));
-  canvas->x_max         = mrb_fixnum(mrb_iv_get(mrb, self,  mrb_intern_lit(mrb, "@x_max")));
-  canvas->y_max         = mrb_fixnum(mrb_iv_get(mrb, self,  mrb_intern_lit(mrb, "@y_max")));
-  canvas->invert_x      = mrb_bool(mrb_iv_get(mrb, self,    mrb_intern_lit(mrb, "@invert_x")));
-  canvas->invert_y      = mrb_bool(mrb_iv_get(mrb, self,    mrb_intern_lit(mrb, "@invert_y")));
-  canvas->swap_xy       = mrb_bool(mrb_iv_get(mrb, self,    mrb_intern_lit(mrb, "@swap_xy")));
-  canvas->current_color = mrb_fixnum(mrb_iv_get(mrb, self,  mrb_intern_lit(mrb, "@current_color")));
+mrb_canvas_data_free(mrb_state* mrb, void* ptr) {
+  canvas_t* canvas = (canvas_t*)ptr;
+  if (canvas == NULL) return;
+  mrb_free(mrb, canvas->planes);
+  mrb_free(mrb, canvas->dirty_min);
+  mrb_free(mrb, canvas->dirty_max);
+  mrb_free(mrb, canvas->shadow);
+  mrb_free(mrb, canvas->front.dirty_min);
+  mrb_free(mrb, canvas->front.dirty_max);
+  mrb_free(mrb, canvas->front.shadow);
+  mrb_free(mrb, canvas->font_table);
+  mrb_free(mrb, canvas->font_glyph_sizes);
+  mrb_free(mrb, canvas->font_lookup);
+  mrb_free(mrb, canvas->font_glyph_widths);
+  mrb_free(mrb, canvas->font_map_entries);
+  mrb_free(mrb, canvas);
+}
+
+static const struct mrb_data_type mrb_canvas_data_type = { "FastCanvas", mrb_canvas_data_free };
+
+#ifdef FASTCANVAS_STATS
+static void
+c_canvas_stats_add(canvas_t* c, int stat, uint64_t start, uint64_t pixels_before) {
+  c->stats[stat].calls  += 1;
+  c->stats[stat].pixels += c->stats_pixels - pixels_before;
+  c->stats[stat].nsec   += c_stats_now() - start;
+}
+
+// Count set bits, for pixels written by masks.
+static inline int
+c_popcount(uint64_t bits) {
+  int count = 0;
+  while (bits) { bits &= bits - 1; count++; }
+  return count;
+}
+#endif
+
+//
+// Dirty region tracking, in physical (framebuffer) coordinates.
+//
+static inline void
+c_canvas_dirty(canvas_t* c, mrb_int page, mrb_int x1, mrb_int x2) {
+  if (x1 < c->dirty_min[page]) c->dirty_min[page] = x1;
+  if (x2 > c->dirty_max[page]) c->dirty_max[page] = x2;
+}
+
+// Mark a rectangle, already clipped to the framebuffer.
+static inline void
+c_canvas_dirty_rect(canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2) {
+  for(mrb_int page = y1 / 8; page <= y2 / 8; page++) {
+    c_canvas_dirty(c, page, x1, x2);
+  }
+}
+
+static void
+c_canvas_dirty_all(canvas_t* c) {
+  for(int page=0; page < c->dirty_pages; page++) {
+    c->dirty_min[page] = 0;
+    c->dirty_max[page] = c->columns - 1;
+  }
+}
+
+static void
+c_canvas_dirty_reset(canvas_t* c) {
+  for(int page=0; page < c->dirty_pages; page++) {
+    c->dirty_min[page] = c->columns;
+    c->dirty_max[page] = -1;
+  }
+}
+
+//
+// Pixel formats. Each one has kernels for a single pixel, and for a rectangle, in physical coordinates,
+// already clipped to the framebuffer. They're selected once, from @pixel_format, when the cache loads.
+//
+struct pixel_format {
+  const char* name;
+  mrb_bool    planar;     // One 1bpp framebuffer per color, instead of one holding color values.
+  mrb_int     color_max;  // Largest color value, or 0 for one color per 1bpp plane, up to @colors.
+  mrb_int     bits;       // Bits per pixel in each framebuffer.
+  mrb_int     (*buffer_size)(mrb_int columns, mrb_int rows, mrb_int colors);
+  void        (*set_pixel)(canvas_t* c, mrb_int x, mrb_int y, int color);
+  int         (*get_pixel)(canvas_t* c, mrb_int x, mrb_int y);
+  void        (*fill_rect)(canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, int color);
+};
+
+// Write color into the masked bits of count consecutive bytes, in every plane.
+static inline void
+c_canvas_write_masked(canvas_t* c, mrb_int byte_index, mrb_int count, uint8_t mask, int color) {
+  // Colors are 1-indexed so "0" means blank/clear.
+  for(int i=1; i <= c->plane_count; i++) {
+    uint8_t* fb_data = c->planes[i-1] + byte_index;
+
+    // Set bits in fb for given color
+    if (i == color) {
+      if (mask == 0xFF) {
+        memset(fb_data, 0xFF, count);
+      } else {
+        for(mrb_int n=0; n<count; n++) fb_data[n] |= mask;
+      }
+    // Clear in other colors
+    } else {
+      if (mask == 0xFF) {
+        memset(fb_data, 0x00, count);
+      } else {
+        for(mrb_int n=0; n<count; n++) fb_data[n] &= ~mask;
+      }
+    }
+  }
+}
+
+// Read a pixel from 1bpp planes. If its bit isn't set in any of them, color is 0.
+static inline int
+c_planar_get_pixel(canvas_t* c, mrb_int byte_index, uint8_t mask) {
+  for(int i=1; i <= c->plane_count; i++) {
+    if (c->planes[i-1][byte_index] & mask) return i;
+  }
+  return 0;
+}
+
+// :page, the default. SSD1306 style, each byte is 8 rows of one column, LSB on top.
+static mrb_int
+c_page_buffer_size(mrb_int columns, mrb_int rows, mrb_int colors) {
+  return ((rows + 7) / 8) * columns;
+}
+
+static void
+c_page_set_pixel(canvas_t* c, mrb_int x, mrb_int y, int color) {
+  c_canvas_write_masked(c, ((y / 8) * c->columns) + x, 1, 1 << (y % 8), color);
+}
+
+static int
+c_page_get_pixel(canvas_t* c, mrb_int x, mrb_int y) {
+  return c_planar_get_pixel(c, ((y / 8) * c->columns) + x, 1 << (y % 8));
+}
+
+static void
+c_page_fill_rect(canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, int color) {
+  mrb_int count = x2 - x1 + 1;
+
+  for(mrb_int page = y1 / 8; page <= y2 / 8; page++) {
+    // First and last bit of the rectangle within this page.
+    mrb_int bit_first = (y1 > page*8)     ? y1 - page*8 : 0;
+    mrb_int bit_last  = (y2 < page*8 + 7) ? y2 - page*8 : 7;
+    uint8_t mask = (uint8_t)((0xFF << bit_first) & (0xFF >> (7 - bit_last)));
+
+    c_canvas_write_masked(c, (page * c->columns) + x1, count, mask, color);
+  }
+}
+
+// :row, for e-paper. Each byte is 8 columns of one row, MSB on the left.
+static mrb_int
+c_row_buffer_size(mrb_int columns, mrb_int rows, mrb_int colors) {
+  return ((columns + 7) / 8) * rows;
+}
+
+static void
+c_row_set_pixel(canvas_t* c, mrb_int x, mrb_int y, int color) {
+  c_canvas_write_masked(c, (y * ((c->columns + 7) / 8)) + (x / 8), 1, 0x80 >> (x % 8), color);
+}
+
+static int
+c_row_get_pixel(canvas_t* c, mrb_int x, mrb_int y) {
+  return c_planar_get_pixel(c, (y * ((c->columns + 7) / 8)) + (x / 8), 0x80 >> (x % 8));
+}
+
+static void
+c_row_fill_rect(canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, int color) {
+  mrb_int stride     = (c->columns + 7) / 8;
+  mrb_int byte_first = x1 / 8;
+  mrb_int byte_last  = x2 / 8;
+  uint8_t mask_first = 0xFF >> (x1 % 8);
+  uint8_t mask_last  = 0xFF << (7 - (x2 % 8));
+
+  for(mrb_int y = y1; y <= y2; y++) {
+    mrb_int row = y * stride;
+    if (byte_first == byte_last) {
+      c_canvas_write_masked(c, row + byte_first, 1, mask_first & mask_last, color);
+      continue;
+    }
+    c_canvas_write_masked(c, row + byte_first, 1, mask_first, color);
+    if (byte_last - byte_first > 1) c_canvas_write_masked(c, row + byte_first + 1, byte_last - byte_first - 1, 0xFF, color);
+    c_canvas_write_masked(c, row + byte_last, 1, mask_last, color);
+  }
+}
+
+// :gray4, for grayscale OLEDs. Two pixels per byte, left one in the high nibble. Colors are 0-15.
+static mrb_int
+c_gray4_buffer_size(mrb_int columns, mrb_int rows, mrb_int colors) {
+  return ((columns + 1) / 2) * rows;
+}
+
+static void
+c_gray4_set_pixel(canvas_t* c, mrb_int x, mrb_int y, int color) {
+  uint8_t* byte = c->planes[0] + (y * ((c->columns + 1) / 2)) + (x / 2);
+  if (x % 2) {
+    *byte = (*byte & 0xF0) | color;
+  } else {
+    *byte = (*byte & 0x0F) | (color << 4);
+  }
+}
+
+static int
+c_gray4_get_pixel(canvas_t* c, mrb_int x, mrb_int y) {
+  uint8_t byte = c->planes[0][(y * ((c->columns + 1) / 2)) + (x / 2)];
+  return (x % 2) ? (byte & 0x0F) : (byte >> 4);
+}
+
+static void
+c_gray4_fill_rect(canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, int color) {
+  mrb_int stride = (c->columns + 1) / 2;
+
+  // Whole bytes in the middle, and a lone nibble at either end.
+  mrb_int whole_first = (x1 + 1) / 2;
+  mrb_int whole_last  = (x2 % 2) ? x2 / 2 : (x2 / 2) - 1;
+
+  for(mrb_int y = y1; y <= y2; y++) {
+    if (x1 % 2) c_gray4_set_pixel(c, x1, y, color);
+    if (whole_last >= whole_first) memset(c->planes[0] + (y * stride) + whole_first, color * 0x11, whole_last - whole_first + 1);
+    if (x2 % 2 == 0) c_gray4_set_pixel(c, x2, y, color);
+  }
+}
+
+// :rgb565, for small TFTs. Two bytes per pixel, big-endian, same as they're sent to the display.
+static mrb_int
+c_rgb565_buffer_size(mrb_int columns, mrb_int rows, mrb_int colors) {
+  return columns * rows * 2;
+}
+
+static void
+c_rgb565_set_pixel(canvas_t* c, mrb_int x, mrb_int y, int color) {
+  uint8_t* pixel = c->planes[0] + (((y * c->columns) + x) * 2);
+  pixel[0] = color >> 8;
+  pixel[1] = color & 0xFF;
+}
+
+static int
+c_rgb565_get_pixel(canvas_t* c, mrb_int x, mrb_int y) {
+  uint8_t* pixel = c->planes[0] + (((y * c->columns) + x) * 2);
+  return (pixel[0] << 8) | pixel[1];
+}
+
+static void
+c_rgb565_fill_rect(canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, int color) {
+  uint8_t high = color >> 8;
+  uint8_t low  = color & 0xFF;
+  mrb_int count = x2 - x1 + 1;
+
+  for(mrb_int y = y1; y <= y2; y++) {
+    uint8_t* pixel = c->planes[0] + (((y * c->columns) + x1) * 2);
+    if (high == low) {
+      memset(pixel, high, count * 2);
+    } else {
+      for(mrb_int n=0; n<count; n++) {
+        pixel[2*n]   = high;
+        pixel[2*n+1] = low;
+      }
+    }
+  }
+}
+
+// :page_interleaved, for multi-color e-paper. Same as :page, but in one framebuffer, with each column's byte
+// for every color side by side. A pixel's planes are all in one cache line, instead of separate Strings.
+static mrb_int
+c_interleaved_buffer_size(mrb_int columns, mrb_int rows, mrb_int colors) {
+  return ((rows + 7) / 8) * columns * colors;
+}
+
+// Write color into the masked bits of count consecutive columns, in every plane.
+static inline void
+c_interleaved_write_masked(canvas_t* c, mrb_int column_index, mrb_int count, uint8_t mask, int color) {
+  uint8_t* fb_data = c->planes[0] + (column_index * c->colors);
+  for(mrb_int n=0; n<count; n++) {
+    // Colors are 1-indexed so "0" means blank/clear.
+    for(int i=1; i <= c->colors; i++) {
+      if (i == color) {
+        fb_data[i-1] |= mask;
+      } else {
+        fb_data[i-1] &= ~mask;
+      }
+    }
+    fb_data += c->colors;
+  }
+}
+
+static void
+c_interleaved_set_pixel(canvas_t* c, mrb_int x, mrb_int y, int color) {
+  c_interleaved_write_masked(c, ((y / 8) * c->columns) + x, 1, 1 << (y % 8), color);
+}
+
+static int
+c_interleaved_get_pixel(canvas_t* c, mrb_int x, mrb_int y) {
+  uint8_t* fb_data = c->planes[0] + ((((y / 8) * c->columns) + x) * c->colors);
+  uint8_t  mask    = 1 << (y % 8);
+  for(int i=1; i <= c->colors; i++) {
+    if (fb_data[i-1] & mask) return i;
+  }
+  return 0;
+}
+
+static void
+c_interleaved_fill_rect(canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, int color) {
+  mrb_int count = x2 - x1 + 1;
+
+  for(mrb_int page = y1 / 8; page <= y2 / 8; page++) {
+    mrb_int bit_first = (y1 > page*8)     ? y1 - page*8 : 0;
+    mrb_int bit_last  = (y2 < page*8 + 7) ? y2 - page*8 : 7;
+    uint8_t mask = (uint8_t)((0xFF << bit_first) & (0xFF >> (7 - bit_last)));
+
+    c_interleaved_write_masked(c, (page * c->columns) + x1, count, mask, color);
+  }
+}
+
+static const pixel_format_t c_pixel_formats[] = {
+  { "page",   TRUE,  0,      1,  c_page_buffer_size,   c_page_set_pixel,   c_page_get_pixel,   c_page_fill_rect   },
+  { "row",    TRUE,  0,      1,  c_row_buffer_size,    c_row_set_pixel,    c_row_get_pixel,    c_row_fill_rect    },
+  { "gray4",  FALSE, 15,     4,  c_gray4_buffer_size,  c_gray4_set_pixel,  c_gray4_get_pixel,  c_gray4_fill_rect  },
+  { "rgb565", FALSE, 0xFFFF, 16, c_rgb565_buffer_size, c_rgb565_set_pixel, c_rgb565_get_pixel, c_rgb565_fill_rect },
+  { "page_interleaved", FALSE, 0, 1, c_interleaved_buffer_size, c_interleaved_set_pixel, c_interleaved_get_pixel, c_interleaved_fill_rect },
+};
+#define PIXEL_FORMAT_PAGE             (&c_pixel_formats[0])
+#define PIXEL_FORMAT_PAGE_INTERLEAVED (&c_pixel_formats[4])
+
+// Find the format named by @pixel_format. nil means :page.
+static const pixel_format_t*
+mrb_canvas_pixel_format(mrb_state* mrb, mrb_value name) {
+  if (mrb_nil_p(name)) return PIXEL_FORMAT_PAGE;
+  if (mrb_symbol_p(name)) {
+    for (size_t i=0; i < sizeof(c_pixel_formats) / sizeof(c_pixel_formats[0]); i++) {
+      if (mrb_symbol(name) == mrb_intern_cstr(mrb, c_pixel_formats[i].name)) return &c_pixel_formats[i];
+    }
+  }
+  mrb_raise(mrb, E_ARGUMENT_ERROR, "@pixel_format must be :page, :row, :gray4, :rgb565 or :page_interleaved");
+}
+
+//
+// Writers for each of the 8 orientations, so transforms are compiled in instead of branched on for every pixel.
+// :page gets its own pixel writer and reader, with the byte kernel inlined.
+//
+#define CANVAS_WRITERS(INDEX, INVERT_X, INVERT_Y, SWAP_XY) \
+  static void \
+  c_write_pixel_page_##INDEX(canvas_t* c, mrb_int x, mrb_int y, int color) { \
+    mrb_int xt = (INVERT_X) ? c->x_max - x : x; \
+    mrb_int yt = (INVERT_Y) ? c->y_max - y : y; \
+    mrb_int px = (SWAP_XY) ? yt : xt; \
+    mrb_int py = (SWAP_XY) ? xt : yt; \
+    c_page_set_pixel(c, px, py, color); \
+    c_canvas_dirty(c, py / 8, px, px); \
+    STATS_PIXELS(c, 1); \
+  } \
+  static void \
+  c_write_pixel_##INDEX(canvas_t* c, mrb_int x, mrb_int y, int color) { \
+    mrb_int xt = (INVERT_X) ? c->x_max - x : x; \
+    mrb_int yt = (INVERT_Y) ? c->y_max - y : y; \
+    mrb_int px = (SWAP_XY) ? yt : xt; \
+    mrb_int py = (SWAP_XY) ? xt : yt; \
+    c->format->set_pixel(c, px, py, color); \
+    c_canvas_dirty(c, py / 8, px, px); \
+    STATS_PIXELS(c, 1); \
+  } \
+  static int \
+  c_read_pixel_page_##INDEX(canvas_t* c, mrb_int x, mrb_int y) { \
+    mrb_int xt = (INVERT_X) ? c->x_max - x : x; \
+    mrb_int yt = (INVERT_Y) ? c->y_max - y : y; \
+    return (SWAP_XY) ? c_page_get_pixel(c, yt, xt) : c_page_get_pixel(c, xt, yt); \
+  } \
+  static int \
+  c_read_pixel_##INDEX(canvas_t* c, mrb_int x, mrb_int y) { \
+    mrb_int xt = (INVERT_X) ? c->x_max - x : x; \
+    mrb_int yt = (INVERT_Y) ? c->y_max - y : y; \
+    return (SWAP_XY) ? c->format->get_pixel(c, yt, xt) : c->format->get_pixel(c, xt, yt); \
+  } \
+  static void \
+  c_write_rect_##INDEX(canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, int color) { \
+    mrb_int xt1 = (INVERT_X) ? c->x_max - x2 : x1; \
+    mrb_int xt2 = (INVERT_X) ? c->x_max - x1 : x2; \
+    mrb_int yt1 = (INVERT_Y) ? c->y_max - y2 : y1; \
+    mrb_int yt2 = (INVERT_Y) ? c->y_max - y1 : y2; \
+    STATS_PIXELS(c, (x2 - x1 + 1) * (y2 - y1 + 1)); \
+    if (SWAP_XY) { \
+      c->format->fill_rect(c, yt1, xt1, yt2, xt2, color); \
+      c_canvas_dirty_rect(c, yt1, xt1, yt2, xt2); \
+    } else { \
+      c->format->fill_rect(c, xt1, yt1, xt2, yt2, color); \
+      c_canvas_dirty_rect(c, xt1, yt1, xt2, yt2); \
+    } \
+  }
+
+// Index is invert_x | invert_y << 1 | swap_xy << 2.
+CANVAS_WRITERS(0, FALSE, FALSE, FALSE)
+CANVAS_WRITERS(1, TRUE,  FALSE, FALSE)
+CANVAS_WRITERS(2, FALSE, TRUE,  FALSE)
+CANVAS_WRITERS(3, TRUE,  TRUE,  FALSE)
+CANVAS_WRITERS(4, FALSE, FALSE, TRUE)
+CANVAS_WRITERS(5, TRUE,  FALSE, TRUE)
+CANVAS_WRITERS(6, FALSE, TRUE,  TRUE)
+CANVAS_WRITERS(7, TRUE,  TRUE,  TRUE)
+
+typedef struct {
+  void (*page_pixel)(canvas_t* c, mrb_int x, mrb_int y, int color);
+  void (*pixel)(canvas_t* c, mrb_int x, mrb_int y, int color);
+  void (*rect)(canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, int color);
+  int  (*page_read)(canvas_t* c, mrb_int x, mrb_int y);
+  int  (*read)(canvas_t* c, mrb_int x, mrb_int y);
+} canvas_writers_t;
+
+static const canvas_writers_t c_canvas_writers[8] = {
+  { c_write_pixel_page_0, c_write_pixel_0, c_write_rect_0, c_read_pixel_page_0, c_read_pixel_0 },
+  { c_write_pixel_page_1, c_write_pixel_1, c_write_rect_1, c_read_pixel_page_1, c_read_pixel_1 },
+  { c_write_pixel_page_2, c_write_pixel_2, c_write_rect_2, c_read_pixel_page_2, c_read_pixel_2 },
+  { c_write_pixel_page_3, c_write_pixel_3, c_write_rect_3, c_read_pixel_page_3, c_read_pixel_3 },
+  { c_write_pixel_page_4, c_write_pixel_4, c_write_rect_4, c_read_pixel_page_4, c_read_pixel_4 },
+  { c_write_pixel_page_5, c_write_pixel_5, c_write_rect_5, c_read_pixel_page_5, c_read_pixel_5 },
+  { c_write_pixel_page_6, c_write_pixel_6, c_write_rect_6, c_read_pixel_page_6, c_read_pixel_6 },
+  { c_write_pixel_page_7, c_write_pixel_7, c_write_rect_7, c_read_pixel_page_7, c_read_pixel_7 },
+};
+
+// The framebuffer's bounds in canvas coordinates, after transformations.
+static void
+c_canvas_bounds(canvas_t* c, mrb_int* x1, mrb_int* y1, mrb_int* x2, mrb_int* y2) {
+  // Canvas x lands on framebuffer rows when swapped, and its columns otherwise. Same for y.
+  mrb_int x_size = (c->swap_xy) ? c->rows    : c->columns;
+  mrb_int y_size = (c->swap_xy) ? c->columns : c->rows;
+
+  *x1 = (c->invert_x) ? c->x_max - (x_size - 1) : 0;
+  *x2 = (c->invert_x) ? c->x_max                : x_size - 1;
+  *y1 = (c->invert_y) ? c->y_max - (y_size - 1) : 0;
+  *y2 = (c->invert_y) ? c->y_max                : y_size - 1;
+}
+
+// Map a rectangle in canvas coordinates to framebuffer coordinates, keeping x1 <= x2 and y1 <= y2.
+static void
+c_canvas_physical_rect(canvas_t* c, mrb_int* x1, mrb_int* y1, mrb_int* x2, mrb_int* y2) {
+  mrb_int xt1 = (c->invert_x) ? c->x_max - *x2 : *x1;
+  mrb_int xt2 = (c->invert_x) ? c->x_max - *x1 : *x2;
+  mrb_int yt1 = (c->invert_y) ? c->y_max - *y2 : *y1;
+  mrb_int yt2 = (c->invert_y) ? c->y_max - *y1 : *y2;
+
+  *x1 = (c->swap_xy) ? yt1 : xt1;
+  *x2 = (c->swap_xy) ? yt2 : xt2;
+  *y1 = (c->swap_xy) ? xt1 : yt1;
+  *y2 = (c->swap_xy) ? xt2 : yt2;
+}
+
+// Work out the visible area in canvas coordinates, from framebuffer size, transformations and user clip.
+static void
+c_canvas_update_clip(canvas_t* c) {
+  c_canvas_bounds(c, &c->clip_x1, &c->clip_y1, &c->clip_x2, &c->clip_y2);
+
+  if (c->user_clip) {
+    if (c->user_clip_x1 > c->clip_x1) c->clip_x1 = c->user_clip_x1;
+    if (c->user_clip_y1 > c->clip_y1) c->clip_y1 = c->user_clip_y1;
+    if (c->user_clip_x2 < c->clip_x2) c->clip_x2 = c->user_clip_x2;
+    if (c->user_clip_y2 < c->clip_y2) c->clip_y2 = c->user_clip_y2;
+  }
+}
+
+// Read every ivar the drawing code depends on, and point planes at the framebuffer Strings.
+// Everything that can raise happens before the cache is touched, so a bad ivar leaves it as it was,
+// and the next call sees the same change and raises again, instead of drawing with half of it.
+static void
+mrb_canvas_data_load(mrb_state* mrb, mrb_value self, canvas_t* canvas) {
+  mrb_value framebuffers = mrb_iv_get(mrb, self, canvas->sym_framebuffers);
+  mrb_bool  invert_x     = mrb_bool(mrb_iv_get(mrb, self, canvas->sym_invert_x));
+  mrb_bool  invert_y     = mrb_bool(mrb_iv_get(mrb, self, canvas->sym_invert_y));
+  mrb_bool  swap_xy      = mrb_bool(mrb_iv_get(mrb, self, canvas->sym_swap_xy));
+  mrb_value pixel_format = mrb_iv_get(mrb, self, canvas->sym_pixel_format);
+  mrb_int   colors       = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@colors")));
+  mrb_int   columns      = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@columns")));
+  mrb_int   rows         = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@rows")));
+  mrb_int   x_max        = mrb_fixnum(mrb_iv_get(mrb, self, canvas->sym_x_max));
+  mrb_int   y_max        = mrb_fixnum(mrb_iv_get(mrb, self, canvas->sym_y_max));
+
+  // 1bpp formats have a framebuffer per color. Others have one, holding color values.
+  const pixel_format_t* format = mrb_canvas_pixel_format(mrb, pixel_format);
+  mrb_int plane_count = (format->planar) ? colors : 1;
+
+  if (!mrb_array_p(framebuffers) || RARRAY_LEN(framebuffers) < plane_count) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "canvas needs one framebuffer per color");
+  }
+
+  // Every pixel write indexes up to the last byte of the framebuffer. Dirty tracking is in 8 row pages for every format.
+  mrb_int pages      = (rows + 7) / 8;
+  mrb_int plane_size = format->buffer_size(columns, rows, colors);
+
+  for(int i=0; i < plane_count; i++) {
+    mrb_value fb = mrb_ary_ref(mrb, framebuffers, i);
+    if (!mrb_string_p(fb) || RSTRING_LEN(fb) < plane_size) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "framebuffer too small for canvas");
+    }
+    // Unshare the String before writing into it directly.
+    mrb_str_modify(mrb, RSTRING(fb));
+  }
+
+  // Anything but a rotation or reflection means the contents may have changed behind our back.
+  mrb_bool contents_changed = (format != canvas->format);
+
+  if (canvas->plane_count != plane_count) {
+    canvas->planes      = (uint8_t**)mrb_realloc(mrb, canvas->planes, sizeof(uint8_t*) * (plane_count > 0 ? plane_count : 1));
+    canvas->plane_count = plane_count;
+    contents_changed    = TRUE;
+  }
+
+  if (canvas->dirty_pages != pages) {
+    mrb_int size = sizeof(mrb_int) * (pages > 0 ? pages : 1);
+    canvas->dirty_min   = (mrb_int*)mrb_realloc(mrb, canvas->dirty_min, size);
+    canvas->dirty_max   = (mrb_int*)mrb_realloc(mrb, canvas->dirty_max, size);
+    canvas->dirty_pages = pages;
+    contents_changed    = TRUE;
+  }
+
+  for(int i=0; i < plane_count; i++) {
+    uint8_t* plane = (uint8_t*)RSTRING_PTR(mrb_ary_ref(mrb, framebuffers, i));
+    if (plane != canvas->planes[i]) contents_changed = TRUE;
+    canvas->planes[i] = plane;
+  }
+
+  canvas->framebuffers = framebuffers;
+  canvas->invert_x     = invert_x;
+  canvas->invert_y     = invert_y;
+  canvas->swap_xy      = swap_xy;
+  canvas->pixel_format = pixel_format;
+  canvas->format       = format;
+  canvas->colors       = colors;
+  canvas->color_max    = (format->color_max) ? format->color_max : colors;
+  canvas->columns      = columns;
+  canvas->rows         = rows;
+  canvas->x_max        = x_max;
+  canvas->y_max        = y_max;
+  canvas->pages        = pages;
+  canvas->plane_size   = plane_size;
+
+  // Pick writers for this orientation and format.
+  const canvas_writers_t* writers = &c_canvas_writers[(invert_x ? 1 : 0) | (invert_y ? 2 : 0) | (swap_xy ? 4 : 0)];
+  canvas->write_pixel = (format == PIXEL_FORMAT_PAGE) ? writers->page_pixel : writers->pixel;
+  canvas->write_rect  = writers->rect;
+  canvas->read_pixel  = (format == PIXEL_FORMAT_PAGE) ? writers->page_read : writers->read;
+
+  // The front set's state was for the old layout too.
+  if (contents_changed) {
+    c_canvas_dirty_all(canvas);
+    canvas->front.dirty_pages = 0;
+  }
+  c_canvas_update_clip(canvas);
+}
+
+// Cheap check that rotation, reflection, bounds, format and framebuffers haven't changed since loading.
+// #rotate, #reflect and #calculate_bounds assign these ivars directly, and they're all immediates.
+static mrb_bool
+mrb_canvas_data_valid(mrb_state* mrb, mrb_value self, canvas_t* canvas) {
+  // Never loaded, because the first load raised.
+  if (canvas->format == NULL) return FALSE;
+  if (!mrb_obj_equal(mrb, mrb_iv_get(mrb, self, canvas->sym_framebuffers), canvas->framebuffers)) return FALSE;
+  if (mrb_bool(mrb_iv_get(mrb, self, canvas->sym_invert_x)) != canvas->invert_x) return FALSE;
+  if (mrb_bool(mrb_iv_get(mrb, self, canvas->sym_invert_y)) != canvas->invert_y) return FALSE;
+  if (mrb_bool(mrb_iv_get(mrb, self, canvas->sym_swap_xy))  != canvas->swap_xy)  return FALSE;
+  if (!mrb_obj_equal(mrb, mrb_iv_get(mrb, self, canvas->sym_pixel_format), canvas->pixel_format)) return FALSE;
+  if (!mrb_obj_equal(mrb, mrb_iv_get(mrb, self, canvas->sym_x_max), mrb_fixnum_value(canvas->x_max))) return FALSE;
+  if (!mrb_obj_equal(mrb, mrb_iv_get(mrb, self, canvas->sym_y_max), mrb_fixnum_value(canvas->y_max))) return FALSE;
+
+  // Strings can be reallocated or replaced from Ruby. #dup shares their bytes, so unshare them again first,
+  // which moves them if they were.
+  if (RARRAY_LEN(canvas->framebuffers) < canvas->plane_count) return FALSE;
+  const mrb_value* fbs = RARRAY_PTR(canvas->framebuffers);
+  for(int i=0; i < canvas->plane_count; i++) {
+    if (!mrb_string_p(fbs[i])) return FALSE;
+    mrb_str_modify(mrb, RSTRING(fbs[i]));
+    if ((uint8_t*)RSTRING_PTR(fbs[i]) != canvas->planes[i] || RSTRING_LEN(fbs[i]) < canvas->plane_size) return FALSE;
+  }
+  return TRUE;
+}
+
+// The canvas_t attached to the Ruby Canvas, or NULL before its first draw.
+static canvas_t*
+mrb_canvas_cached_data(mrb_state* mrb, mrb_value self) {
+  mrb_value cache = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "__fastcanvas__"));
+  return (canvas_t*)mrb_data_check_get_ptr(mrb, cache, &mrb_canvas_data_type);
+}
+
+// Get the cached canvas_t attached to the Ruby Canvas, creating or reloading it as needed.
+static canvas_t*
+mrb_get_canvas_data(mrb_state* mrb, mrb_value self) {
+  canvas_t* canvas = mrb_canvas_cached_data(mrb, self);
+
+  if (canvas == NULL) {
+    canvas = (canvas_t*)mrb_calloc(mrb, 1, sizeof(canvas_t));
+    canvas->sym_framebuffers  = mrb_intern_lit(mrb, "@framebuffers");
+    canvas->sym_invert_x      = mrb_intern_lit(mrb, "@invert_x");
+    canvas->sym_invert_y      = mrb_intern_lit(mrb, "@invert_y");
+    canvas->sym_swap_xy       = mrb_intern_lit(mrb, "@swap_xy");
+    canvas->sym_current_color = mrb_intern_lit(mrb, "@current_color");
+    canvas->sym_pixel_format  = mrb_intern_lit(mrb, "@pixel_format");
+    canvas->sym_x_max         = mrb_intern_lit(mrb, "@x_max");
+    canvas->sym_y_max         = mrb_intern_lit(mrb, "@y_max");
+    canvas->pixel_format      = mrb_nil_value();
+    canvas->sym_font_characters = mrb_intern_lit(mrb, "@font_characters");
+    canvas->font_characters   = mrb_nil_value();
+    canvas->font_widths       = mrb_nil_value();
+    canvas->font_map          = mrb_nil_value();
+    canvas->stroke_width      = 1;
+
+    // Wrap before loading, so the struct is freed by GC if loading raises.
+    struct RData* data = mrb_data_object_alloc(mrb, mrb->object_class, canvas, &mrb_canvas_data_type);
+    mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__fastcanvas__"), mrb_obj_value(data));
+    mrb_canvas_data_load(mrb, self, canvas);
+  } else if (!mrb_canvas_data_valid(mrb, self, canvas)) {
+    mrb_canvas_data_load(mrb, self, canvas);
+  }
+  return canvas;
+}
+
+// Resolve the optional color argument. -1 means use @current_color, which is read fresh every time.
+static mrb_int
+mrb_canvas_color(mrb_state* mrb, mrb_value self, canvas_t* canvas, mrb_int color) {
+  if (color != -1) return color;
+  return mrb_fixnum(mrb_iv_get(mrb, self, canvas->sym_current_color));
 }
 
 //
@@ -42,16 +804,16 @@ mrb_get_canvas_data(mrb_state* mrb, mrb_value self, canvas_t* canvas) {
 //
 static mrb_value
 mrb_canvas_clear(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
 
-  for(int i=1; i <= canvas.colors; i++) {
-    mrb_value fb = mrb_ary_ref(mrb, canvas.framebuffers, i-1);
-    uint8_t* fb_data = (uint8_t*)RSTRING_PTR(fb);
-    mrb_int fb_size = RSTRING_LEN(fb);
-    memset(fb_data, 0, fb_size);
+  for(int i=0; i < canvas->plane_count; i++) {
+    memset(canvas->planes[i], 0, canvas->plane_size);
   }
+  c_canvas_dirty_all(canvas);
+  STATS_PIXELS(canvas, canvas->columns * canvas->rows);
+  STATS_END(canvas, STAT_CLEAR);
   return mrb_nil_value();
 }
 
@@ -60,579 +822,3337 @@ mrb_canvas_clear(mrb_state* mrb, mrb_value self) {
 //
 static mrb_value
 mrb_canvas_fill(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
-
-  for(int i=1; i <= canvas.colors; i++) {
-    mrb_value fb = mrb_ary_ref(mrb, canvas.framebuffers, i-1);
-    uint8_t* fb_data = (uint8_t*)RSTRING_PTR(fb);
-    mrb_int fb_size = RSTRING_LEN(fb);
-    if (i == 1) {
-      // color = 1 means 0th buffer (black). Fill with 255.
-      memset(fb_data, 255, fb_size);    
-    } else {
-      // Clear others with 0.
-      memset(fb_data, 0, fb_size);
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  if (canvas->format == PIXEL_FORMAT_PAGE_INTERLEAVED) {
+    // Color 1 in every pixel, same as separate planes.
+    for(mrb_int n=0; n < canvas->plane_size; n++) {
+      canvas->planes[0][n] = (n % canvas->colors == 0) ? 255 : 0;
+    }
+  } else {
+    // Formats that hold color values are filled with their largest value.
+    for(int i=0; i < canvas->plane_count; i++) {
+      if (i == 0) {
+        // color = 1 means 0th buffer (black). Fill with 255.
+        memset(canvas->planes[i], 255, canvas->plane_size);
+      } else {
+        // Clear others with 0.
+        memset(canvas->planes[i], 0, canvas->plane_size);
+      }
     }
   }
+  c_canvas_dirty_all(canvas);
+  STATS_PIXELS(canvas, canvas->columns * canvas->rows);
+  STATS_END(canvas, STAT_FILL);
+  return mrb_nil_value();
+}
+
+//
+// #_get_pixel
+//
+static int
+c_canvas_get_pixel(mrb_state* mrb, canvas_t* c, mrb_int x, mrb_int y) {
+  if ((x < 0) || (x >= c->columns) || (y < 0) || (y >= c->rows)) return 0;
+  return c->format->get_pixel(c, x, y);
+}
+
+static mrb_value
+mrb_canvas_get_pixel(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x, y;
+  mrb_get_args(mrb, "ii", &x, &y);
+
+  int color = c_canvas_get_pixel(mrb, canvas, x, y);
+  STATS_END(canvas, STAT_GET_PIXEL);
+  return mrb_fixnum_value(color);
+}
+
+//
+// #_set_pixel
+//
+static void
+c_canvas_set_pixel(mrb_state* mrb, canvas_t* c, int x, int y, int color) {
+  // Bounds check, against the visible area in canvas coordinates.
+  if ((x < c->clip_x1) || (x > c->clip_x2) || (y < c->clip_y1) || (y > c->clip_y2)) return;
+  if ((color < 0) || (color > c->color_max)) return;
+
+  c->write_pixel(c, x, y, color);
+}
+
+static mrb_value
+mrb_canvas_set_pixel(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x, y;
+  mrb_int color = -1;
+  mrb_get_args(mrb, "ii|i", &x, &y, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  c_canvas_set_pixel(mrb, canvas, x, y, color);
+
+  STATS_END(canvas, STAT_SET_PIXEL);
+  return mrb_nil_value();
+}
+
+//
+// Span kernels. Clipping and transforms are resolved once per span, then the pixel format writes whole bytes.
+//
+// Fill a rectangle in canvas coordinates. Clipping is resolved once, for the corners, and the orientation's writer maps them.
+static void
+c_canvas_fill_rect(mrb_state* mrb, canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, int color) {
+  if ((color < 0) || (color > c->color_max)) return;
+
+  // Ensure x1 <= x2 and y1 <= y2.
+  mrb_int t;
+  if (x2 < x1) { t = x1; x1 = x2; x2 = t; }
+  if (y2 < y1) { t = y1; y1 = y2; y2 = t; }
+
+  // Clip to visible area.
+  if (x1 < c->clip_x1) x1 = c->clip_x1;
+  if (y1 < c->clip_y1) y1 = c->clip_y1;
+  if (x2 > c->clip_x2) x2 = c->clip_x2;
+  if (y2 > c->clip_y2) y2 = c->clip_y2;
+  if ((x1 > x2) || (y1 > y2)) return;
+
+  c->write_rect(c, x1, y1, x2, y2, color);
+}
+
+// Reverse the order of the lowest count bits.
+static inline uint64_t
+c_reverse_bits(uint64_t bits, int count) {
+  bits = ((bits >> 1)  & 0x5555555555555555ULL) | ((bits & 0x5555555555555555ULL) << 1);
+  bits = ((bits >> 2)  & 0x3333333333333333ULL) | ((bits & 0x3333333333333333ULL) << 2);
+  bits = ((bits >> 4)  & 0x0F0F0F0F0F0F0F0FULL) | ((bits & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  bits = ((bits >> 8)  & 0x00FF00FF00FF00FFULL) | ((bits & 0x00FF00FF00FF00FFULL) << 8);
+  bits = ((bits >> 16) & 0x0000FFFF0000FFFFULL) | ((bits & 0x0000FFFF0000FFFFULL) << 16);
+  bits = (bits >> 32) | (bits << 32);
+  return bits >> (64 - count);
+}
+
+static inline uint64_t
+c_low_bits(int count) {
+  return (count >= 64) ? ~0ULL : ((1ULL << count) - 1);
+}
+
+// How a run of bits is combined with what's already in the framebuffer.
+enum {
+  DRAW_TRANSPARENT = 0, // Set bits drawn in color, others left alone.
+  DRAW_OPAQUE      = 1, // Set bits drawn in color, others in the region cleared.
+  DRAW_XOR         = 2, // Set bits toggle between color and blank.
+};
+
+// Combine one byte's worth of bits with every :page plane. region marks which bits are affected.
+static inline void
+c_canvas_write_bits(canvas_t* c, mrb_int byte_index, uint8_t region, uint8_t bits, int color, int mode) {
+  STATS_PIXELS(c, c_popcount(region));
+  if (mode == DRAW_XOR) {
+    if (color < 1) return;
+    uint8_t* color_byte = c->planes[color-1] + byte_index;
+    *color_byte ^= bits;
+
+    // Newly set pixels become this color only.
+    uint8_t now_set = *color_byte & bits;
+    for(int i=1; i <= c->plane_count; i++) {
+      if (i != color) c->planes[i-1][byte_index] &= ~now_set;
+    }
+    return;
+  }
+
+  for(int i=1; i <= c->plane_count; i++) {
+    uint8_t* fb_byte = c->planes[i-1] + byte_index;
+    if (i == color) {
+      *fb_byte = (*fb_byte & ~region) | bits;
+    } else {
+      *fb_byte &= ~region;
+    }
+  }
+}
+
+// Draw a vertical run of count (<= 64) pixels in canvas coordinates, starting at x, y and going down.
+// Bit 0 is the top pixel. Only pixels in region are affected, and bits should be a subset of it.
+static void
+c_canvas_column_bits(canvas_t* c, mrb_int x, mrb_int y, uint64_t bits, uint64_t region, int count, int color, int mode) {
+  if ((color < 0) || (color > c->color_max)) return;
+  // Clip to visible area, in canvas coordinates.
+  if ((x < c->clip_x1) || (x > c->clip_x2)) return;
+  if (y < c->clip_y1) {
+    if (c->clip_y1 - y >= count) return;
+    bits   >>= c->clip_y1 - y;
+    region >>= c->clip_y1 - y;
+    count   -= c->clip_y1 - y;
+    y        = c->clip_y1;
+  }
+  if (y > c->clip_y2) return;
+  if (y + count - 1 > c->clip_y2) count = c->clip_y2 - y + 1;
+
+  region &= c_low_bits(count);
+  bits   &= region;
+  if (region == 0) return;
+
+  // Other formats go pixel by pixel through their kernels. XOR matches :page, toggling between color and blank.
+  if (c->format != PIXEL_FORMAT_PAGE) {
+    for (int i=0; i<count; i++) {
+      if (!((region >> i) & 1)) continue;
+      mrb_bool set = (bits >> i) & 1;
+      if ((mode == DRAW_TRANSPARENT) && !set) continue;
+
+      mrb_int px = (c->invert_x) ? c->x_max - x : x;
+      mrb_int py = (c->invert_y) ? c->y_max - (y + i) : y + i;
+      if (c->swap_xy) { mrb_int t = px; px = py; py = t; }
+
+      int pixel_color = (set) ? color : 0;
+      if (mode == DRAW_XOR) {
+        if (!set || (color < 1)) continue;
+        pixel_color = (c->format->get_pixel(c, px, py) == color) ? 0 : color;
+      }
+      c->format->set_pixel(c, px, py, pixel_color);
+      STATS_PIXELS(c, 1);
+      c_canvas_dirty(c, py / 8, px, px);
+    }
+    return;
+  }
+
+  if (!c->swap_xy) {
+    // Column stays a column, written a page at a time.
+    mrb_int px = (c->invert_x) ? c->x_max - x : x;
+
+    // Inverted y runs upward, so flip it to start from its physical top.
+    mrb_int py = y;
+    if (c->invert_y) {
+      bits   = c_reverse_bits(bits, count);
+      region = c_reverse_bits(region, count);
+      py     = c->y_max - (y + count - 1);
+    }
+
+    // Shift into position and write each page's byte as a mask, at most count/8 + 2 pages.
+    mrb_int page = py / 8;
+    int shift    = py % 8;
+    while (region) {
+      uint8_t region_byte = (uint8_t)(region << shift);
+      if (region_byte) {
+        c_canvas_write_bits(c, (page * c->columns) + px, region_byte, (uint8_t)(bits << shift), color, mode);
+        c_canvas_dirty(c, page, px, px);
+      }
+      bits   >>= (8 - shift);
+      region >>= (8 - shift);
+      shift = 0;
+      page++;
+    }
+  } else {
+    // Column becomes a row, so one bit in each of a run of bytes on the same page.
+    mrb_int py = (c->invert_x) ? c->x_max - x : x;
+    mrb_int page = py / 8;
+    uint8_t mask = 1 << (py % 8);
+
+    for (int i=0; i<count; i++) {
+      if (!((region >> i) & 1)) continue;
+      mrb_int px = (c->invert_y) ? c->y_max - (y + i) : y + i;
+      c_canvas_write_bits(c, (page * c->columns) + px, mask, ((bits >> i) & 1) ? mask : 0, color, mode);
+      c_canvas_dirty(c, page, px, px);
+    }
+  }
+}
+
+// Outlines wider than 1px are filled as shapes instead. The stroke functions are defined further down, after
+// the polygon fill and ellipse walk they're built on.
+//
+// Edge of a thick outline: a rectangle with elliptical corners of radii a, b. Rectangles have none, and ellipses
+// are all corner. widths is scratch for the corner's half width on each row out from its center, 0 to b.
+typedef struct {
+  mrb_int x1, y1, x2, y2;
+  int a, b;
+  int* widths;
+} stroke_shape_t;
+
+static void c_canvas_stroke_path(mrb_state* mrb, canvas_t* c, const int* xs, const int* ys, mrb_int point_count, mrb_bool closed, int color);
+static void c_canvas_stroke_ring(mrb_state* mrb, canvas_t* c, stroke_shape_t* outer, stroke_shape_t* inner, int color);
+
+//
+// #_line
+//
+static void
+c_canvas_line(mrb_state* mrb, canvas_t* c, int x1, int y1, int x2, int y2, int color) {
+  // Deltas in each axis.
+  int dy = y2 - y1;
+  int dx = x2 - x1;
+
+  // Optimize vertical lines and avoid division by 0.
+  if (dx == 0) {
+    c_canvas_fill_rect(mrb, c, x1, y1, x1, y2, color);
+    return;
+  }
+
+  // Optimize horizontal lines.
+  if (dy == 0) {
+    c_canvas_fill_rect(mrb, c, x1, y1, x2, y1, color);
+    return;
+  }
+
+  // Bresenham's algorithm for sloped lines.
+  //
+  // Slope calculations
+  int dx_abs      = abs(dx);
+  int dy_abs      = abs(dy);
+  int step_axis   = (dx_abs > dy_abs) ? 0 : 1; // 0 = x, 1 = y
+  int step_count  = (step_axis == 0)  ? dx_abs : dy_abs;
+  int x_step      = (dx > 0) ? 1 : -1;
+  int y_step      = (dy > 0) ? 1 : -1;
+
+  // Error calculations
+  int error_step      = (step_axis == 0) ? dy_abs : dx_abs;
+  int error_threshold = (step_axis == 0) ? dx_abs : dy_abs;
+
+  // Clip. At step i, the stepped axis has moved i pixels, and the other floor(i * error_step / error_threshold).
+  // Both are monotonic, so the visible steps are one range, found for each axis separately.
+  mrb_int i_first = 0;
+  mrb_int i_last  = step_count;
+  int major_start = (step_axis == 0) ? x1 : y1;
+  int minor_start = (step_axis == 0) ? y1 : x1;
+  int major_step  = (step_axis == 0) ? x_step : y_step;
+  int minor_step  = (step_axis == 0) ? y_step : x_step;
+  mrb_int major_lo = (step_axis == 0) ? c->clip_x1 : c->clip_y1;
+  mrb_int major_hi = (step_axis == 0) ? c->clip_x2 : c->clip_y2;
+  mrb_int minor_lo = (step_axis == 0) ? c->clip_y1 : c->clip_x1;
+  mrb_int minor_hi = (step_axis == 0) ? c->clip_y2 : c->clip_x2;
+
+  // Steps along the stepped axis to reach each edge.
+  mrb_int major_first = (major_step > 0) ? major_lo - major_start : major_start - major_hi;
+  mrb_int major_last  = (major_step > 0) ? major_hi - major_start : major_start - major_lo;
+  if (major_first > i_first) i_first = major_first;
+  if (major_last  < i_last)  i_last  = major_last;
+
+  // Steps along the other axis to reach each edge, then the first and last step giving that many.
+  mrb_int minor_first = (minor_step > 0) ? minor_lo - minor_start : minor_start - minor_hi;
+  mrb_int minor_last  = (minor_step > 0) ? minor_hi - minor_start : minor_start - minor_lo;
+  if (minor_last < 0) return;
+  if (minor_first > 0) {
+    mrb_int i_min = ((minor_first * error_threshold) + error_step - 1) / error_step;
+    if (i_min > i_first) i_first = i_min;
+  }
+  mrb_int i_max = (((minor_last + 1) * error_threshold) - 1) / error_step;
+  if (i_max < i_last) i_last = i_max;
+  if (i_first > i_last) return;
+
+  // Start from the first visible step.
+  mrb_int minor_steps = (i_first * error_step) / error_threshold;
+  int error = (i_first * error_step) % error_threshold;
+  int x = (step_axis == 0) ? x1 + (i_first * x_step)     : x1 + (minor_steps * x_step);
+  int y = (step_axis == 0) ? y1 + (minor_steps * y_step) : y1 + (i_first * y_step);
+
+  // Every step in range is inside the clip, so skip straight to the writer.
+  if ((color < 0) || (color > c->color_max)) return;
+  for (mrb_int i=i_first; i<=i_last; i++) {
+    c->write_pixel(c, x, y, color);
+
+    if (step_axis == 0) { // Step on x-axis
+      x += x_step;
+      error += error_step;
+      if (error >= error_threshold) {
+        y += y_step;
+        error -= error_threshold;
+      }
+    } else { // Step on y-axis
+      y += y_step;
+      error += error_step;
+      if (error >= error_threshold) {
+        x += x_step;
+        error -= error_threshold;
+      }
+    }
+  }
+}
+
+// A line at the current stroke width. c_canvas_line is always 1px, for shapes that stroke themselves.
+static void
+c_canvas_stroke_line(mrb_state* mrb, canvas_t* c, int x1, int y1, int x2, int y2, int color) {
+  if (c->stroke_width > 1) {
+    int xs[2] = { x1, x2 };
+    int ys[2] = { y1, y2 };
+    c_canvas_stroke_path(mrb, c, xs, ys, 2, FALSE, color);
+  } else {
+    c_canvas_line(mrb, c, x1, y1, x2, y2, color);
+  }
+}
+
+static mrb_value
+mrb_canvas_line(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x1, y1, x2, y2;
+  mrb_int color = -1;
+  mrb_get_args(mrb, "iiii|i", &x1, &y1, &x2, &y2, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  c_canvas_stroke_line(mrb, canvas, x1, y1, x2, y2, color);
+
+  STATS_END(canvas, STAT_LINE);
+  return mrb_nil_value();
+}
+
+//
+// #_rectangle
+//
+static void
+c_canvas_rectangle(mrb_state* mrb, canvas_t* c, int x1, int y1, int x2, int y2, mrb_bool filled, int color) {
+  // Rectangles and squares as a combination of lines.
+  if (filled) {
+    c_canvas_fill_rect(mrb, c, x1, y1, x2, y2, color);
+  } else if (c->stroke_width > 1) {
+    // Thick outlines are what's left of the outer rectangle with the inner one taken out.
+    int t;
+    if (x2 < x1) { t = x1; x1 = x2; x2 = t; }
+    if (y2 < y1) { t = y1; y1 = y2; y2 = t; }
+    int out = (c->stroke_width - 1) / 2;
+    int in  = c->stroke_width / 2 + 1;
+    stroke_shape_t outer = { x1 - out, y1 - out, x2 + out, y2 + out, 0, 0, NULL };
+    stroke_shape_t inner = { x1 + in,  y1 + in,  x2 - in,  y2 - in,  0, 0, NULL };
+    c_canvas_stroke_ring(mrb, c, &outer, &inner, color);
+  } else {
+    c_canvas_line(mrb, c, x1, y1, x2, y1, color);
+    c_canvas_line(mrb, c, x2, y1, x2, y2, color);
+    c_canvas_line(mrb, c, x2, y2, x1, y2, color);
+    c_canvas_line(mrb, c, x1, y2, x1, y1, color);
+  }
+}
+
+static mrb_value
+mrb_canvas_rectangle(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x1, y1, x2, y2;
+  mrb_bool filled = FALSE;
+  mrb_int color = -1;
+  mrb_get_args(mrb, "iiii|bi", &x1, &y1, &x2, &y2, &filled, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  c_canvas_rectangle(mrb, canvas, x1, y1, x2, y2, filled, color);
+  STATS_END(canvas, STAT_RECTANGLE);
+  return mrb_nil_value();
+}
+
+//
+// #clear_rect and #fill_rect
+//
+// Same as a filled _rectangle. Named, so widgets can clear their area without going through outline options.
+// The format writes each page's partial top and bottom rows as masks, and whole bytes between with memset.
+static mrb_value
+mrb_canvas_clear_rect(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x1, y1, x2, y2;
+  mrb_get_args(mrb, "iiii", &x1, &y1, &x2, &y2);
+
+  c_canvas_fill_rect(mrb, canvas, x1, y1, x2, y2, 0);
+  STATS_END(canvas, STAT_CLEAR_RECT);
+  return mrb_nil_value();
+}
+
+static mrb_value
+mrb_canvas_fill_rect(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x1, y1, x2, y2;
+  mrb_int color = -1;
+  mrb_get_args(mrb, "iiii|i", &x1, &y1, &x2, &y2, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  c_canvas_fill_rect(mrb, canvas, x1, y1, x2, y2, color);
+  STATS_END(canvas, STAT_FILL_RECT);
+  return mrb_nil_value();
+}
+
+//
+// Point lists
+//
+// Points kept in C between frames, by a Canvas::PointBuffer. Cached on it the same way as canvas_t.
+typedef struct {
+  int*    xs;
+  int*    ys;
+  mrb_int count;
+  mrb_int capacity;
+} point_buffer_t;
+
+static void
+mrb_point_buffer_free(mrb_state* mrb, void* ptr) {
+  point_buffer_t* buffer = (point_buffer_t*)ptr;
+  if (buffer == NULL) return;
+  mrb_free(mrb, buffer->xs);
+  mrb_free(mrb, buffer->ys);
+  mrb_free(mrb, buffer);
+}
+
+static const struct mrb_data_type mrb_point_buffer_data_type = { "FastCanvasPoints", mrb_point_buffer_free };
+
+// The point_buffer_t of a PointBuffer, or NULL if value isn't one and create is FALSE.
+static point_buffer_t*
+mrb_get_point_buffer(mrb_state* mrb, mrb_value value, mrb_bool create) {
+  if (mrb_immediate_p(value)) return NULL;
+  mrb_sym sym_cache = mrb_intern_lit(mrb, "__points__");
+  point_buffer_t* buffer = (point_buffer_t*)mrb_data_check_get_ptr(mrb, mrb_iv_get(mrb, value, sym_cache), &mrb_point_buffer_data_type);
+
+  if ((buffer == NULL) && create) {
+    buffer = (point_buffer_t*)mrb_calloc(mrb, 1, sizeof(point_buffer_t));
+    struct RData* data = mrb_data_object_alloc(mrb, mrb->object_class, buffer, &mrb_point_buffer_data_type);
+    mrb_iv_set(mrb, value, sym_cache, mrb_obj_value(data));
+  }
+  return buffer;
+}
+
+// Radii are Int16 like points, which keeps the ellipse walk's error terms in range.
+static int
+mrb_canvas_radius(mrb_state* mrb, mrb_int value) {
+  if ((value < INT16_MIN) || (value > INT16_MAX)) mrb_raise(mrb, E_RANGE_ERROR, "radius must be -32768 to 32767");
+  return (int)value;
+}
+
+// Points in every form are Int16, the range packed points and #draw_batch can hold.
+static int
+mrb_canvas_point_coord(mrb_state* mrb, mrb_int value) {
+  if ((value < INT16_MIN) || (value > INT16_MAX)) mrb_raise(mrb, E_RANGE_ERROR, "point coordinates must be -32768 to 32767");
+  return (int)value;
+}
+
+// Get separate C arrays of x and y coords from any of:
+//   an Array of [x, y] Arrays,
+//   a String of packed little-endian Int16 x, y pairs, ie. points.flatten.pack("s<*"),
+//   a Canvas::PointBuffer, used as is, without copying.
+// Scratch memory is a Ruby String, so it's collected by GC even if a coord fails to convert.
+static mrb_int
+mrb_canvas_points(mrb_state* mrb, mrb_value mrb_points, int** xs, int** ys) {
+  if (!mrb_array_p(mrb_points) && !mrb_string_p(mrb_points)) {
+    point_buffer_t* buffer = mrb_get_point_buffer(mrb, mrb_points, FALSE);
+    if (buffer == NULL) mrb_raise(mrb, E_TYPE_ERROR, "points must be an Array, a packed String or a PointBuffer");
+    *xs = buffer->xs;
+    *ys = buffer->ys;
+    return buffer->count;
+  }
+  if (mrb_string_p(mrb_points) && (RSTRING_LEN(mrb_points) % 4 != 0)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "packed points must be Int16 x, y pairs");
+  }
+
+  mrb_int point_count = (mrb_array_p(mrb_points)) ? RARRAY_LEN(mrb_points) : RSTRING_LEN(mrb_points) / 4;
+  mrb_value scratch = mrb_str_new(mrb, NULL, sizeof(int) * 2 * point_count);
+  *xs = (int*)RSTRING_PTR(scratch);
+  *ys = *xs + point_count;
+
+  if (mrb_string_p(mrb_points)) {
+    const uint8_t* packed = (const uint8_t*)RSTRING_PTR(mrb_points);
+    for (int i=0; i<point_count; i++) {
+      (*xs)[i] = (int16_t)(packed[4*i]   | (packed[4*i+1] << 8));
+      (*ys)[i] = (int16_t)(packed[4*i+2] | (packed[4*i+3] << 8));
+    }
+    return point_count;
+  }
+
+  for (int i=0; i<point_count; i++) {
+    mrb_value point = mrb_ary_entry(mrb_points, i);
+    if (!mrb_array_p(point)) mrb_raise(mrb, E_TYPE_ERROR, "points must be [x, y] Arrays");
+    (*xs)[i] = mrb_canvas_point_coord(mrb, mrb_as_int(mrb, mrb_ary_entry(point, 0)));
+    (*ys)[i] = mrb_canvas_point_coord(mrb, mrb_as_int(mrb, mrb_ary_entry(point, 1)));
+  }
+  return point_count;
+}
+
+//
+// Canvas::PointBuffer
+//
+static mrb_value
+mrb_point_buffer_initialize(mrb_state* mrb, mrb_value self) {
+  mrb_get_point_buffer(mrb, self, TRUE);
+  return self;
+}
+
+// Add a point, growing by doubling. Memory is kept by #clear, so a buffer refilled every frame stops allocating.
+static mrb_value
+mrb_point_buffer_push(mrb_state* mrb, mrb_value self) {
+  // Get args
+  mrb_int x, y;
+  mrb_get_args(mrb, "ii", &x, &y);
+  int px = mrb_canvas_point_coord(mrb, x);
+  int py = mrb_canvas_point_coord(mrb, y);
+
+  point_buffer_t* buffer = mrb_get_point_buffer(mrb, self, TRUE);
+  if (buffer->count == buffer->capacity) {
+    mrb_int capacity = (buffer->capacity > 0) ? buffer->capacity * 2 : 16;
+    buffer->xs = (int*)mrb_realloc(mrb, buffer->xs, sizeof(int) * capacity);
+    buffer->ys = (int*)mrb_realloc(mrb, buffer->ys, sizeof(int) * capacity);
+    buffer->capacity = capacity;
+  }
+  buffer->xs[buffer->count] = px;
+  buffer->ys[buffer->count] = py;
+  buffer->count++;
+  return self;
+}
+
+static mrb_value
+mrb_point_buffer_clear(mrb_state* mrb, mrb_value self) {
+  mrb_get_point_buffer(mrb, self, TRUE)->count = 0;
+  return self;
+}
+
+static mrb_value
+mrb_point_buffer_size(mrb_state* mrb, mrb_value self) {
+  return mrb_fixnum_value(mrb_get_point_buffer(mrb, self, TRUE)->count);
+}
+
+//
+// #_path
+//
+static void
+c_canvas_path(mrb_state* mrb, canvas_t* c, const int* xs, const int* ys, mrb_int point_count, int color) {
+  if (c->stroke_width > 1) {
+    c_canvas_stroke_path(mrb, c, xs, ys, point_count, FALSE, color);
+    return;
+  }
+  for (int i=1; i<point_count; i++) {
+    c_canvas_line(mrb, c, xs[i-1], ys[i-1], xs[i], ys[i], color);
+  }
+}
+
+static mrb_value
+mrb_canvas_path(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_value mrb_points;
+  mrb_int color = -1;
+  mrb_get_args(mrb, "o|i", &mrb_points, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  int *xs, *ys;
+  mrb_int point_count = mrb_canvas_points(mrb, mrb_points, &xs, &ys);
+
+  c_canvas_path(mrb, canvas, xs, ys, point_count, color);
+  STATS_END(canvas, STAT_PATH);
+  return mrb_nil_value();
+}
+
+//
+// #_polygon
+//
+// Fill modes for polygons. The values match the filled byte of BATCH_POLYGON.
+enum {
+  POLYGON_STROKE   = 0,
+  POLYGON_EVEN_ODD = 1,
+  POLYGON_NONZERO  = 2,
+};
+
+// One polygon edge, stepped a row at a time. On each row it covers exactly the pixels c_canvas_line
+// would draw for it. With k rows from the start point, the first and last step on that row are
+// floor((k * dx_abs + bias) / dy_abs), kept as a whole part and remainder so stepping needs no division.
+typedef struct {
+  mrb_int y_top, y_bottom;   // Rows covered, inclusive
+  mrb_int y_start, x_start;  // Start point, in the direction the edge is drawn
+  int x_step, k_step;        // +1 or -1
+  int winding;               // +1 going down, -1 going up, 0 for horizontal
+  mrb_int dx_abs, dy_abs;
+  mrb_int whole, rem;        // dx_abs / dy_abs and dx_abs % dy_abs
+  mrb_int lo, lo_rem;        // First step on the current row
+  mrb_int hi, hi_rem;        // Last step on the current row
+  mrb_int x_lo, x_hi;        // Pixels covered on the current row
+} polygon_edge_t;
+
+static void
+c_polygon_edge_extent(polygon_edge_t* e) {
+  mrb_int hi = (e->hi < e->dx_abs) ? e->hi : e->dx_abs;
+  mrb_int xa = e->x_start + e->lo * e->x_step;
+  mrb_int xb = e->x_start + hi * e->x_step;
+  e->x_lo = (xa < xb) ? xa : xb;
+  e->x_hi = (xa < xb) ? xb : xa;
+}
+
+// Start stepping an edge at row y. This is the only division per edge.
+static void
+c_polygon_edge_start(polygon_edge_t* e, mrb_int y) {
+  // Horizontal edges only cover one row, all of it.
+  if (e->dy_abs == 0) {
+    e->lo = 0;
+    e->hi = e->dx_abs;
+    c_polygon_edge_extent(e);
+    return;
+  }
+
+  // Steep edges cover one pixel per row. Shallow ones cover every step that lands on the row.
+  mrb_bool steep  = (e->dy_abs >= e->dx_abs);
+  mrb_int bias_lo = steep ? 0 : e->dy_abs - 1;
+  mrb_int bias_hi = steep ? 0 : e->dx_abs - 1;
+  mrb_int k = (y - e->y_start) * e->k_step;
+
+  e->lo     = (k * e->dx_abs + bias_lo) / e->dy_abs;
+  e->lo_rem = (k * e->dx_abs + bias_lo) % e->dy_abs;
+  e->hi     = (k * e->dx_abs + bias_hi) / e->dy_abs;
+  e->hi_rem = (k * e->dx_abs + bias_hi) % e->dy_abs;
+  c_polygon_edge_extent(e);
+}
+
+// Move an edge down one row.
+static void
+c_polygon_edge_advance(polygon_edge_t* e) {
+  if (e->k_step > 0) {
+    e->lo += e->whole; e->lo_rem += e->rem;
+    if (e->lo_rem >= e->dy_abs) { e->lo++; e->lo_rem -= e->dy_abs; }
+    e->hi += e->whole; e->hi_rem += e->rem;
+    if (e->hi_rem >= e->dy_abs) { e->hi++; e->hi_rem -= e->dy_abs; }
+  } else {
+    e->lo -= e->whole; e->lo_rem -= e->rem;
+    if (e->lo_rem < 0) { e->lo--; e->lo_rem += e->dy_abs; }
+    e->hi -= e->whole; e->hi_rem -= e->rem;
+    if (e->hi_rem < 0) { e->hi--; e->hi_rem += e->dy_abs; }
+  }
+  c_polygon_edge_extent(e);
+}
+
+static int
+c_polygon_edge_compare(const void* a, const void* b) {
+  mrb_int ya = (*(polygon_edge_t* const*)a)->y_top;
+  mrb_int yb = (*(polygon_edge_t* const*)b)->y_top;
+  return (ya > yb) - (ya < yb);
+}
+
+// Fill closed contours as one shape. Contour k ends before point ends[k], and the next starts there.
+// All edges are stepped together, so where contours overlap, pixels are still written once.
+static void
+c_canvas_fill_contours(mrb_state* mrb, canvas_t* c, const int* xs, const int* ys, const mrb_int* ends, mrb_int contour_count, int fill, int color) {
+  mrb_int point_count = (contour_count > 0) ? ends[contour_count-1] : 0;
+  if (point_count == 0) return;
+  if ((color < 0) || (color > c->color_max)) return;
+
+  // Scratch for the edges, the edge table sorted by top row, and the active edge list.
+  // Memory is bounded by the point count, not the polygon's size, and freed by GC.
+  int arena = mrb_gc_arena_save(mrb);
+  mrb_value scratch = mrb_str_new(mrb, NULL, (sizeof(polygon_edge_t) + 2 * sizeof(polygon_edge_t*)) * point_count);
+  polygon_edge_t*  edges  = (polygon_edge_t*)RSTRING_PTR(scratch);
+  polygon_edge_t** table  = (polygon_edge_t**)(edges + point_count);
+  polygon_edge_t** active = table + point_count;
+
+  // Edge i goes from point i to i+1, and the last of each contour closes it, same as the stroke.
+  mrb_int y_min = ys[0];
+  mrb_int y_max = ys[0];
+  mrb_int start = 0;
+  for (mrb_int k=0; k<contour_count; k++) {
+    for (mrb_int i=start; i<ends[k]; i++) {
+      polygon_edge_t* e = &edges[i];
+      mrb_int j  = (i + 1 < ends[k]) ? i + 1 : start;
+      mrb_int dx = (mrb_int)xs[j] - xs[i];
+      mrb_int dy = (mrb_int)ys[j] - ys[i];
+
+      e->x_start = xs[i];
+      e->y_start = ys[i];
+      e->x_step  = (dx < 0) ? -1 : 1;
+      e->k_step  = (dy < 0) ? -1 : 1;
+      e->winding = (dy > 0) ? 1 : (dy < 0) ? -1 : 0;
+      e->dx_abs  = (dx < 0) ? -dx : dx;
+      e->dy_abs  = (dy < 0) ? -dy : dy;
+      e->whole   = (e->dy_abs) ? e->dx_abs / e->dy_abs : 0;
+      e->rem     = (e->dy_abs) ? e->dx_abs % e->dy_abs : 0;
+      e->y_top    = (dy < 0) ? ys[j] : ys[i];
+      e->y_bottom = (dy < 0) ? ys[i] : ys[j];
+      table[i] = e;
+
+      if (ys[i] < y_min) y_min = ys[i];
+      if (ys[i] > y_max) y_max = ys[i];
+    }
+    start = ends[k];
+  }
+  qsort(table, point_count, sizeof(polygon_edge_t*), c_polygon_edge_compare);
+
+  // Only scan visible rows.
+  if (y_min < c->clip_y1) y_min = c->clip_y1;
+  if (y_max > c->clip_y2) y_max = c->clip_y2;
+
+  mrb_int next = 0;
+  mrb_int active_count = 0;
+  for (mrb_int y=y_min; y<=y_max; y++) {
+    // Drop edges that ended on the row above.
+    mrb_int kept = 0;
+    for (mrb_int i=0; i<active_count; i++) {
+      if (active[i]->y_bottom >= y) active[kept++] = active[i];
+    }
+    active_count = kept;
+
+    // Add edges starting on this row, or above it on the first visible row.
+    while ((next < point_count) && (table[next]->y_top <= y)) {
+      polygon_edge_t* e = table[next++];
+      if (e->y_bottom < y) continue;
+      c_polygon_edge_start(e, y);
+      active[active_count++] = e;
+    }
+
+    // Insertion sort by left pixel. Order barely changes between rows, so this is close to linear.
+    for (mrb_int i=1; i<active_count; i++) {
+      polygon_edge_t* e = active[i];
+      mrb_int j = i;
+      while ((j > 0) && (active[j-1]->x_lo > e->x_lo)) {
+        active[j] = active[j-1];
+        j--;
+      }
+      active[j] = e;
+    }
+
+    // Walk edges left to right, merging their pixels with the inside spans between them,
+    // so each pixel on the row is written once. Edges count as crossings on all but their bottom row,
+    // so vertices shared by two edges count once, and peaks count twice.
+    mrb_int winding  = 0;
+    mrb_int run_lo   = 0;
+    mrb_int run_hi   = 0;
+    mrb_bool has_run = FALSE;
+    for (mrb_int i=0; i<active_count; i++) {
+      polygon_edge_t* e = active[i];
+      mrb_bool inside = (fill == POLYGON_NONZERO) ? (winding != 0) : (winding & 1);
+
+      if (has_run && (inside || (e->x_lo <= run_hi + 1))) {
+        if (e->x_hi > run_hi) run_hi = e->x_hi;
+      } else {
+        if (has_run) c_canvas_fill_rect(mrb, c, run_lo, y, run_hi, y, color);
+        run_lo  = e->x_lo;
+        run_hi  = e->x_hi;
+        has_run = TRUE;
+      }
+      if (y < e->y_bottom) winding += e->winding;
+    }
+    if (has_run) c_canvas_fill_rect(mrb, c, run_lo, y, run_hi, y, color);
+
+    // Step edges that continue onto the next row.
+    for (mrb_int i=0; i<active_count; i++) {
+      if (active[i]->y_bottom > y) c_polygon_edge_advance(active[i]);
+    }
+  }
+  mrb_gc_arena_restore(mrb, arena);
+}
+
+static void
+c_canvas_polygon(mrb_state* mrb, canvas_t* c, const int* xs, const int* ys, mrb_int point_count, int fill, int color) {
+  if (point_count == 0) return;
+
+  if (fill == POLYGON_STROKE) {
+    if (c->stroke_width > 1) {
+      c_canvas_stroke_path(mrb, c, xs, ys, point_count, TRUE, color);
+      return;
+    }
+
+    // Use _path to stroke without connecting last back to first.
+    c_canvas_path(mrb, c, xs, ys, point_count, color);
+
+    // Connect last to first. NOTE: order is important here.
+    c_canvas_line(mrb, c, xs[point_count-1], ys[point_count-1], xs[0], ys[0], color);
+    return;
+  }
+  c_canvas_fill_contours(mrb, c, xs, ys, &point_count, 1, fill, color);
+}
+
+static mrb_value
+mrb_canvas_polygon(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_value mrb_points;
+  mrb_value filled = mrb_false_value();
+  mrb_int color = -1;
+  mrb_get_args(mrb, "o|oi", &mrb_points, &filled, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  // filled can also be a fill rule. true is the same as :even_odd.
+  int fill = mrb_test(filled) ? POLYGON_EVEN_ODD : POLYGON_STROKE;
+  if (mrb_symbol_p(filled)) {
+    if      (mrb_symbol(filled) == mrb_intern_lit(mrb, "even_odd")) fill = POLYGON_EVEN_ODD;
+    else if (mrb_symbol(filled) == mrb_intern_lit(mrb, "nonzero"))  fill = POLYGON_NONZERO;
+    else mrb_raise(mrb, E_ARGUMENT_ERROR, "polygon fill rule must be :even_odd or :nonzero");
+  }
+
+  int *xs, *ys;
+  mrb_int point_count = mrb_canvas_points(mrb, mrb_points, &xs, &ys);
+
+  c_canvas_polygon(mrb, canvas, xs, ys, point_count, fill, color);
+  STATS_END(canvas, STAT_POLYGON);
+  return mrb_nil_value();
+}
+
+//
+// #_ellipse
+//
+// Midpoint ellipse, walked one point at a time so ellipses, arcs, pies and rounded corners share it.
+// Points go from (-a, 0) to (0, b), with x <= 0 and y >= 0. Mirror them into the other quadrants.
+// Error terms grow with the cube of the radii, so they're 64-bit. Radii are Int16, plus half a stroke width.
+// y never decreases, so the walk stops past y_limit, the furthest row from the center that's visible.
+typedef struct {
+  int x, y, b;
+  mrb_int y_limit;
+  int64_t x_increment, y_increment;
+  int64_t dx, dy, e1;
+} ellipse_walk_t;
+
+static void
+c_ellipse_walk_start(ellipse_walk_t* w, int a, int b, mrb_int y_limit) {
+  // Start position
+  w->x = -a;
+  w->y = 0;
+  w->b = b;
+  w->y_limit = y_limit;
+
+  // Precompute x and y increments for each step
+  w->x_increment = 2 * (int64_t)b * b;
+  w->y_increment = 2 * (int64_t)a * a;
+
+  // Start errors
+  w->dx = (1 + (2 * (int64_t)w->x)) * b * b;
+  w->dy = (int64_t)w->x * w->x;
+  w->e1 = w->dx + w->dy;
+}
+
+static mrb_bool
+c_ellipse_walk_next(ellipse_walk_t* w, int* x, int* y) {
+  if (w->y > w->y_limit) return FALSE;
+
+  // Since starting at max negative X, continue until x is 0
+  if (w->x <= 0) {
+    *x = w->x;
+    *y = w->y;
+
+    int64_t e2 = 2 * w->e1;
+    if (e2 >= w->dx) {
+      w->x  += 1;
+      w->dx += w->x_increment;
+      w->e1 += w->dx;
+    }
+    if (e2 <= w->dy) {
+      w->y  += 1;
+      w->dy += w->y_increment;
+      w->e1 += w->dy;
+    }
+    return TRUE;
+  }
+
+  // Continue if y hasn't reached the vertical size
+  if ((w->y < w->b) && (w->y < w->y_limit)) {
+    w->y += 1;
+    *x = 0;
+    *y = w->y;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+// Furthest visible row from a curve above top and below bottom, which are the same for one ellipse.
+static mrb_int
+c_ellipse_y_limit(canvas_t* c, mrb_int top, mrb_int bottom) {
+  mrb_int above = top - c->clip_y1;
+  mrb_int below = c->clip_y2 - bottom;
+  return (above > below) ? above : below;
+}
+
+static void
+c_canvas_ellipse(mrb_state* mrb, canvas_t* c, int x_center, int y_center, int a, int b, mrb_bool filled, int color) {
+  // Thick outlines are a ring between two filled ellipses. Too thick for a hole, it's just the outer one.
+  if (!filled && (c->stroke_width > 1)) {
+    int out = (c->stroke_width - 1) / 2;
+    int in  = c->stroke_width / 2 + 1;
+    a = abs(a);
+    b = abs(b);
+    stroke_shape_t outer = { x_center - a - out, y_center - b - out, x_center + a + out, y_center + b + out, a + out, b + out, NULL };
+    stroke_shape_t inner = { x_center - a + in,  y_center - b + in,  x_center + a - in,  y_center + b - in,  a - in,  b - in,  NULL };
+    c_canvas_stroke_ring(mrb, c, &outer, &inner, color);
+    return;
+  }
+
+  // Nothing to do if the bounding box is outside the visible area.
+  if ((x_center + abs(a) < c->clip_x1) || (x_center - abs(a) > c->clip_x2)) return;
+  if ((y_center + abs(b) < c->clip_y1) || (y_center - abs(b) > c->clip_y2)) return;
+
+  ellipse_walk_t walk;
+  c_ellipse_walk_start(&walk, a, b, c_ellipse_y_limit(c, y_center, y_center));
+  int x, y;
+  int y_filled = -1;
+
+  while (c_ellipse_walk_next(&walk, &x, &y)) {
+    if (filled) {
+      // The first point on each row is the widest, so fill each row once, when it's reached.
+      if (y == y_filled) continue;
+      y_filled = y;
+      c_canvas_fill_rect(mrb, c, x_center + x, y_center + y, x_center - x, y_center + y, color);
+      if (y != 0) c_canvas_fill_rect(mrb, c, x_center + x, y_center - y, x_center - x, y_center - y, color);
+    } else {
+      // Stroke quadrants in order, as if y-axis is reversed and going counter-clockwise from +ve X.
+      // Points on an axis are shared by two quadrants, so only set them once.
+      c_canvas_set_pixel(mrb, c, x_center - x, y_center - y, color);
+      if (x != 0) c_canvas_set_pixel(mrb, c, x_center + x, y_center - y, color);
+      if (y != 0) {
+        c_canvas_set_pixel(mrb, c, x_center + x, y_center + y, color);
+        if (x != 0) c_canvas_set_pixel(mrb, c, x_center - x, y_center + y, color);
+      }
+    }
+  }
+}
+
+static mrb_value
+mrb_canvas_ellipse(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x_center, y_center, a, b;
+  mrb_bool filled = FALSE;
+  mrb_int color = -1;
+  mrb_get_args(mrb, "iiii|bi", &x_center, &y_center, &a, &b, &filled, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  c_canvas_ellipse(mrb, canvas, x_center, y_center, mrb_canvas_radius(mrb, a), mrb_canvas_radius(mrb, b), filled, color);
+
+  STATS_END(canvas, STAT_ELLIPSE);
+  return mrb_nil_value();
+}
+
+//
+// #stroke_width= and #stroke_width
+//
+// Thick outlines are filled instead of stepped, so each pixel is written once, however much the parts overlap.
+// Of the extra width, half goes outside (or left of) the 1px outline, and half inside, with the odd pixel inside.
+//
+// Fill the rows of outer that aren't in inner. Rows with the same spans as the one above are merged,
+// so the straight sides of rectangles are one fill each.
+static void
+c_canvas_stroke_ring(mrb_state* mrb, canvas_t* c, stroke_shape_t* outer, stroke_shape_t* inner, int color) {
+  if ((color < 0) || (color > c->color_max)) return;
+
+  // Nothing to do if it's outside the visible area.
+  mrb_int y_first = (outer->y1 > c->clip_y1) ? outer->y1 : c->clip_y1;
+  mrb_int y_last  = (outer->y2 < c->clip_y2) ? outer->y2 : c->clip_y2;
+  if ((y_first > y_last) || (outer->x2 < c->clip_x1) || (outer->x1 > c->clip_x2)) return;
+
+  // The stroke is too thick to leave a hole.
+  mrb_bool hole = (inner->x1 <= inner->x2) && (inner->y1 <= inner->y2);
+
+  // Corner widths for each shape.
+  int arena = mrb_gc_arena_save(mrb);
+  mrb_value scratch = mrb_str_new(mrb, NULL, sizeof(int) * (outer->b + 1 + (hole ? inner->b + 1 : 0)));
+  outer->widths = (int*)RSTRING_PTR(scratch);
+  inner->widths = outer->widths + outer->b + 1;
+
+  stroke_shape_t* shapes[2] = { outer, inner };
+  for (int i=0; i<(hole ? 2 : 1); i++) {
+    // The first point on each row is the widest. Visible rows between the corners all use row 0.
+    stroke_shape_t* s = shapes[i];
+    mrb_int y_limit = c_ellipse_y_limit(c, s->y1 + s->b, s->y2 - s->b);
+    ellipse_walk_t walk;
+    c_ellipse_walk_start(&walk, s->a, s->b, (y_limit > 0) ? y_limit : 0);
+    int x, y;
+    int y_last_width = -1;
+    while (c_ellipse_walk_next(&walk, &x, &y)) {
+      if (y == y_last_width) continue;
+      y_last_width = y;
+      shapes[i]->widths[y] = -x;
+    }
+  }
+
+  // Spans waiting to be filled, from run_y to the row above.
+  mrb_int run[4];
+  mrb_int run_count = 0;
+  mrb_int run_y = y_first;
+
+  for (mrb_int y=y_first; y<=y_last+1; y++) {
+    mrb_int spans[4];
+    mrb_int span_count = 0;
+
+    if (y <= y_last) {
+      for (int i=0; i<(hole ? 2 : 1); i++) {
+        // Rows out from the corners' centers, on the rounded part.
+        stroke_shape_t* s = shapes[i];
+        if ((y < s->y1) || (y > s->y2)) break;
+        mrb_int k = 0;
+        if (y < s->y1 + s->b) k = s->y1 + s->b - y;
+        if (y > s->y2 - s->b) k = y - (s->y2 - s->b);
+        spans[2*i]   = s->x1 + s->a - s->widths[k];
+        spans[2*i+1] = s->x2 - s->a + s->widths[k];
+        span_count++;
+      }
+
+      // Split the outer span around the inner one.
+      if (span_count == 2) {
+        mrb_int inner_x1 = spans[2];
+        mrb_int inner_x2 = spans[3];
+        spans[2] = inner_x2 + 1;
+        spans[3] = spans[1];
+        spans[1] = inner_x1 - 1;
+      }
+    }
+
+    // Fill the waiting spans when this row is different.
+    if ((span_count != run_count) || (memcmp(spans, run, sizeof(mrb_int) * 2 * span_count) != 0)) {
+      for (int i=0; i<run_count; i++) {
+        if (run[2*i] <= run[2*i+1]) c_canvas_fill_rect(mrb, c, run[2*i], run_y, run[2*i+1], y - 1, color);
+      }
+      memcpy(run, spans, sizeof(mrb_int) * 2 * span_count);
+      run_count = span_count;
+      run_y = y;
+    }
+  }
+  mrb_gc_arena_restore(mrb, arena);
+}
+
+// Add the contour from start to count, turning it clockwise on screen if it isn't already, so all contours
+// wind the same way, and fill as their union with the nonzero rule.
+static void
+c_stroke_contour_end(int* xs, int* ys, mrb_int start, mrb_int count, mrb_int* ends, mrb_int* contour_count) {
+  int64_t area = 0;
+  for (mrb_int i=start; i<count; i++) {
+    mrb_int j = (i + 1 < count) ? i + 1 : start;
+    area += (int64_t)xs[i] * ys[j] - (int64_t)xs[j] * ys[i];
+  }
+  if (area < 0) {
+    for (mrb_int i=start, j=count-1; i<j; i++, j--) {
+      int t;
+      t = xs[i]; xs[i] = xs[j]; xs[j] = t;
+      t = ys[i]; ys[i] = ys[j]; ys[j] = t;
+    }
+  }
+  ends[(*contour_count)++] = count;
+}
+
+// Unit normal of the segment from point i to j, pointing left of it on screen.
+static void
+c_stroke_normal(const int* xs, const int* ys, mrb_int i, mrb_int j, double* nx, double* ny) {
+  double dx = xs[j] - xs[i];
+  double dy = ys[j] - ys[i];
+  double length = sqrt(dx * dx + dy * dy);
+  *nx = dy / length;
+  *ny = -dx / length;
+}
+
+// Stroke a path, closed for polygons, as contours: a box along each segment, and a wedge to fill the outside
+// of each join. Joins are mitered, or beveled when the miter would reach more than 4 widths out, like SVG.
+// Ends are flat, at the end points, so a line's length doesn't change with its width.
+static void
+c_canvas_stroke_path(mrb_state* mrb, canvas_t* c, const int* xs, const int* ys, mrb_int point_count, mrb_bool closed, int color) {
+  if (point_count == 0) return;
+  if ((color < 0) || (color > c->color_max)) return;
+  double out = (c->stroke_width - 1) / 2;
+  double in  = c->stroke_width / 2;
+
+  // Scratch for the path without repeated points, and a segment of 6 points and a join of up to 4 for each of those.
+  int arena = mrb_gc_arena_save(mrb);
+  mrb_value scratch = mrb_str_new(mrb, NULL, (2 * sizeof(mrb_int) + 22 * sizeof(int)) * point_count);
+  mrb_int* ends = (mrb_int*)RSTRING_PTR(scratch);
+  int* px = (int*)(ends + 2 * point_count);
+  int* py = px + point_count;
+  int* cx = py + point_count;
+  int* cy = cx + 10 * point_count;
+
+  // Repeated points have no direction to offset from.
+  mrb_int n = 0;
+  for (mrb_int i=0; i<point_count; i++) {
+    if ((n > 0) && (xs[i] == px[n-1]) && (ys[i] == py[n-1])) continue;
+    px[n] = xs[i];
+    py[n] = ys[i];
+    n++;
+  }
+  if (closed && (n > 1) && (px[n-1] == px[0]) && (py[n-1] == py[0])) n--;
+
+  // A single point is a square, where a 1px stroke would set one pixel.
+  if (n == 1) {
+    if (closed || (point_count > 1)) c_canvas_fill_rect(mrb, c, px[0] - out, py[0] - out, px[0] + in, py[0] + in, color);
+    mrb_gc_arena_restore(mrb, arena);
+    return;
+  }
+
+  mrb_int count = 0;
+  mrb_int contour_count = 0;
+  mrb_int segment_count = (closed) ? n : n - 1;
+  double nx, ny;
+
+  // Segments, out to the left and in to the right. The end points are corners too, so rounding the others
+  // can't leave them out.
+  for (mrb_int i=0; i<segment_count; i++) {
+    mrb_int j = (i + 1 < n) ? i + 1 : 0;
+    mrb_int start = count;
+    c_stroke_normal(px, py, i, j, &nx, &ny);
+    cx[count] = px[i];                     cy[count++] = py[i];
+    cx[count] = llround(px[i] + nx * out); cy[count++] = llround(py[i] + ny * out);
+    cx[count] = llround(px[j] + nx * out); cy[count++] = llround(py[j] + ny * out);
+    cx[count] = px[j];                     cy[count++] = py[j];
+    cx[count] = llround(px[j] - nx * in);  cy[count++] = llround(py[j] - ny * in);
+    cx[count] = llround(px[i] - nx * in);  cy[count++] = llround(py[i] - ny * in);
+    c_stroke_contour_end(cx, cy, start, count, ends, &contour_count);
+  }
+
+  // Joins. Open paths have none at their ends.
+  for (mrb_int i=(closed ? 0 : 1); i<(closed ? n : n - 1); i++) {
+    mrb_int h = (i > 0) ? i - 1 : n - 1;
+    mrb_int j = (i + 1 < n) ? i + 1 : 0;
+    double nx0, ny0, nx1, ny1;
+    c_stroke_normal(px, py, h, i, &nx0, &ny0);
+    c_stroke_normal(px, py, i, j, &nx1, &ny1);
+
+    // Straight through needs nothing. Otherwise, the gap is on the side turned away from.
+    double turn = nx0 * ny1 - ny0 * nx1;
+    double cos_angle = nx0 * nx1 + ny0 * ny1;
+    if ((fabs(turn) < 1e-9) && (cos_angle > 0)) continue;
+    double offset = (turn < 0) ? -in : out;
+    if (offset == 0) continue;
+
+    mrb_int start = count;
+    cx[count] = px[i]; cy[count++] = py[i];
+    cx[count] = llround(px[i] + nx0 * offset); cy[count++] = llround(py[i] + ny0 * offset);
+    // Miter length is 1 / cos(half the turn), which passes 4 when 1 + cos(turn) < 2 / 16.
+    if (1 + cos_angle >= 0.125) {
+      double miter = offset / (1 + cos_angle);
+      cx[count] = llround(px[i] + (nx0 + nx1) * miter); cy[count++] = llround(py[i] + (ny0 + ny1) * miter);
+    }
+    cx[count] = llround(px[i] + nx1 * offset); cy[count++] = llround(py[i] + ny1 * offset);
+    c_stroke_contour_end(cx, cy, start, count, ends, &contour_count);
+  }
+
+  c_canvas_fill_contours(mrb, c, cx, cy, ends, contour_count, POLYGON_NONZERO, color);
+  mrb_gc_arena_restore(mrb, arena);
+}
+
+static mrb_value
+mrb_canvas_set_stroke_width(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+
+  // Get args
+  mrb_int width;
+  mrb_get_args(mrb, "i", &width);
+  if ((width < 1) || (width > INT16_MAX)) mrb_raise(mrb, E_ARGUMENT_ERROR, "stroke width must be 1 to 32767");
+
+  canvas->stroke_width = width;
+  return mrb_fixnum_value(width);
+}
+
+static mrb_value
+mrb_canvas_stroke_width(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  return mrb_fixnum_value(canvas->stroke_width);
+}
+
+//
+// #_arc and #_pie
+//
+// Angles are in degrees, counter-clockwise from +ve X, like the ellipse stroke order, and the arc goes
+// counter-clockwise from start_angle to end_angle. Which pixels belong to the arc is decided by up to two
+// half-planes, a*dx + b*dy + c >= 0, around the center, with dy pointing up. Sectors up to 180 degrees are
+// inside both of their half-planes, and larger ones are inside either. Filled arcs add a third half-plane,
+// beyond their chord, the same way. Geometrically the sector doesn't change them, but it keeps rows where
+// the chord nearly touches the ellipse from spilling past the end angles.
+typedef struct {
+  int count;        // 0 = everything, or 2 half-planes
+  mrb_bool any;     // Inside either half-plane instead of both
+  mrb_bool chord;   // Also half-plane 2, the chord
+  int64_t a[3], b[3], c[3];
+} arc_region_t;
+
+// Fixed-point scale for direction vectors.
+#define ARC_SCALE 16384
+#define ARC_RADIANS_PER_DEGREE (3.14159265358979323846 / 180.0)
+
+static int64_t
+c_div_floor(int64_t n, int64_t d) {
+  int64_t q = n / d;
+  if ((n % d != 0) && ((n < 0) != (d < 0))) q--;
+  return q;
+}
+
+static mrb_bool
+c_arc_region_contains(const arc_region_t* r, int64_t dx, int64_t dy) {
+  if (r->count == 0) return TRUE;
+  mrb_bool in0 = (r->a[0] * dx + r->b[0] * dy + r->c[0] >= 0);
+  mrb_bool in1 = (r->a[1] * dx + r->b[1] * dy + r->c[1] >= 0);
+  mrb_bool in  = (r->any) ? (in0 || in1) : (in0 && in1);
+  if (!r->chord) return in;
+  mrb_bool in2 = (r->a[2] * dx + r->b[2] * dy + r->c[2] >= 0);
+  return (r->any) ? (in || in2) : (in && in2);
+}
+
+// Range of dx on row dy inside one half-plane, limited to [lo, hi]. Empty if lo > hi after.
+static void
+c_arc_half_plane_span(const arc_region_t* r, int i, int64_t dy, int64_t* lo, int64_t* hi) {
+  // a*dx >= rest
+  int64_t rest = -(r->b[i] * dy + r->c[i]);
+  if (r->a[i] > 0) {
+    int64_t first = -c_div_floor(-rest, r->a[i]);
+    if (first > *lo) *lo = first;
+  } else if (r->a[i] < 0) {
+    int64_t last = c_div_floor(rest, r->a[i]);
+    if (last < *hi) *hi = last;
+  } else if (rest > 0) {
+    *lo = *hi + 1;
+  }
+}
+
+// Fill the part of row dy, from dx = -width to width, that's inside the region. At most three spans.
+static void
+c_canvas_arc_row(mrb_state* mrb, canvas_t* c, const arc_region_t* r, int x_center, int y_center, int64_t dy, int64_t width, int color) {
+  int64_t y = y_center - dy;
+  int64_t lo[3], hi[3];
+  int count = 0;
+
+  if (r->count == 0) {
+    c_canvas_fill_rect(mrb, c, x_center - width, y, x_center + width, y, color);
+    return;
+  }
+
+  for (int i=0; i<2; i++) {
+    lo[i] = -width;
+    hi[i] = width;
+    c_arc_half_plane_span(r, i, dy, &lo[i], &hi[i]);
+  }
+  if (r->any) {
+    count = 2;
+  } else {
+    if (lo[1] > lo[0]) lo[0] = lo[1];
+    if (hi[1] < hi[0]) hi[0] = hi[1];
+    count = 1;
+  }
+
+  if (r->chord) {
+    int64_t lo2 = -width;
+    int64_t hi2 = width;
+    c_arc_half_plane_span(r, 2, dy, &lo2, &hi2);
+    if (r->any) {
+      lo[count] = lo2;
+      hi[count] = hi2;
+      count++;
+    } else {
+      if (lo2 > lo[0]) lo[0] = lo2;
+      if (hi2 < hi[0]) hi[0] = hi2;
+    }
+  }
+
+  // Union. Sort the non-empty spans by start, then merge any that touch.
+  int n = 0;
+  for (int i=0; i<count; i++) {
+    if (lo[i] > hi[i]) continue;
+    int64_t l = lo[i], h = hi[i];
+    int k = n++;
+    while ((k > 0) && (lo[k-1] > l)) { lo[k] = lo[k-1]; hi[k] = hi[k-1]; k--; }
+    lo[k] = l;
+    hi[k] = h;
+  }
+  if (n == 0) return;
+  int64_t start = lo[0];
+  int64_t end   = hi[0];
+  for (int i=1; i<n; i++) {
+    if (lo[i] <= end + 1) {
+      if (hi[i] > end) end = hi[i];
+    } else {
+      c_canvas_fill_rect(mrb, c, x_center + start, y, x_center + end, y, color);
+      start = lo[i];
+      end   = hi[i];
+    }
+  }
+  c_canvas_fill_rect(mrb, c, x_center + start, y, x_center + end, y, color);
+}
+
+// Modes for c_canvas_arc
+enum {
+  ARC_STROKE   = 0,   // Just the curve
+  ARC_SEGMENT  = 1,   // Filled between the curve and its chord
+  ARC_PIE      = 2,   // Curve and lines to the center
+  ARC_PIE_FILL = 3,   // Filled between the curve and the center
+};
+
+static void
+c_canvas_arc(mrb_state* mrb, canvas_t* c, int x_center, int y_center, int a, int b, double start_angle, double end_angle, int mode, int color) {
+  if ((color < 0) || (color > c->color_max)) return;
+  a = abs(a);
+  b = abs(b);
+
+  // Nothing to do if the bounding box is outside the visible area.
+  if ((x_center + a < c->clip_x1) || (x_center - a > c->clip_x2)) return;
+  if ((y_center + b < c->clip_y1) || (y_center - b > c->clip_y2)) return;
+
+  // Counter-clockwise sweep, in [0, 360). A full turn or more is the whole ellipse.
+  double sweep = end_angle - start_angle;
+  mrb_bool full = (sweep >= 360.0) || (sweep <= -360.0);
+  if (!full) {
+    sweep = fmod(sweep, 360.0);
+    if (sweep < 0) sweep += 360.0;
+    if (sweep == 0) return;
+  }
+
+  // Direction vectors of the start and end angles, and where they meet the ellipse.
+  double radians[2] = { start_angle * ARC_RADIANS_PER_DEGREE, end_angle * ARC_RADIANS_PER_DEGREE };
+  int64_t vx[2], vy[2], px[2], py[2];
+  for (int i=0; i<2; i++) {
+    double cos_a = cos(radians[i]);
+    double sin_a = sin(radians[i]);
+    double scale = (a == 0 || b == 0) ? 0 : (a * b) / sqrt((b * cos_a) * (b * cos_a) + (a * sin_a) * (a * sin_a));
+    vx[i] = llround(cos_a * ARC_SCALE);
+    vy[i] = llround(sin_a * ARC_SCALE);
+    px[i] = llround(cos_a * scale);
+    py[i] = llround(sin_a * scale);
+  }
+
+  arc_region_t region;
+  region.count = 0;
+  region.any   = FALSE;
+  region.chord = FALSE;
+  if (!full) {
+    // Left of the start direction, and right of the end direction.
+    region.count = 2;
+    region.any   = (sweep > 180.0);
+    region.a[0] = -vy[0]; region.b[0] = vx[0];  region.c[0] = 0;
+    region.a[1] = vy[1];  region.b[1] = -vx[1]; region.c[1] = 0;
+
+    if (mode == ARC_SEGMENT) {
+      // Right of the chord from start to end point. Empty if they round to the same pixel.
+      int64_t chord_x = px[1] - px[0];
+      int64_t chord_y = py[1] - py[0];
+      region.chord = TRUE;
+      region.a[2] = chord_y;
+      region.b[2] = -chord_x;
+      region.c[2] = (chord_x * py[0]) - (chord_y * px[0]);
+      if ((chord_x == 0) && (chord_y == 0)) region.c[2] = -1;
+    }
+  }
+
+  ellipse_walk_t walk;
+  c_ellipse_walk_start(&walk, a, b, c_ellipse_y_limit(c, y_center, y_center));
+  int x, y;
+  int y_filled = -1;
+
+  while (c_ellipse_walk_next(&walk, &x, &y)) {
+    if ((mode == ARC_SEGMENT) || (mode == ARC_PIE_FILL)) {
+      // Fill each row once, from its widest point.
+      if (y == y_filled) continue;
+      y_filled = y;
+      c_canvas_arc_row(mrb, c, &region, x_center, y_center, y, -x, color);
+      if (y != 0) c_canvas_arc_row(mrb, c, &region, x_center, y_center, -y, -x, color);
+    } else {
+      // Same points as the ellipse stroke, kept if they're inside the arc.
+      if (c_arc_region_contains(&region, -x, y)) c_canvas_set_pixel(mrb, c, x_center - x, y_center - y, color);
+      if ((x != 0) && c_arc_region_contains(&region, x, y)) c_canvas_set_pixel(mrb, c, x_center + x, y_center - y, color);
+      if (y != 0) {
+        if (c_arc_region_contains(&region, x, -y)) c_canvas_set_pixel(mrb, c, x_center + x, y_center + y, color);
+        if ((x != 0) && c_arc_region_contains(&region, -x, -y)) c_canvas_set_pixel(mrb, c, x_center - x, y_center + y, color);
+      }
+    }
+  }
+
+  // Close the pie with lines from the center to both ends.
+  if ((mode == ARC_PIE) && !full) {
+    for (int i=0; i<2; i++) {
+      c_canvas_line(mrb, c, x_center, y_center, x_center + px[i], y_center - py[i], color);
+    }
+  }
+}
+
+static mrb_value
+mrb_canvas_arc_shape(mrb_state* mrb, mrb_value self, int stroke_mode, int fill_mode) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x_center, y_center, a, b;
+  mrb_float start_angle, end_angle;
+  mrb_bool filled = FALSE;
+  mrb_int color = -1;
+  mrb_get_args(mrb, "iiiiff|bi", &x_center, &y_center, &a, &b, &start_angle, &end_angle, &filled, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  c_canvas_arc(mrb, canvas, x_center, y_center, mrb_canvas_radius(mrb, a), mrb_canvas_radius(mrb, b), start_angle, end_angle, (filled) ? fill_mode : stroke_mode, color);
+  STATS_END(canvas, (stroke_mode == ARC_STROKE) ? STAT_ARC : STAT_PIE);
+  return mrb_nil_value();
+}
+
+static mrb_value
+mrb_canvas_arc(mrb_state* mrb, mrb_value self) {
+  return mrb_canvas_arc_shape(mrb, self, ARC_STROKE, ARC_SEGMENT);
+}
+
+static mrb_value
+mrb_canvas_pie(mrb_state* mrb, mrb_value self) {
+  return mrb_canvas_arc_shape(mrb, self, ARC_PIE, ARC_PIE_FILL);
+}
+
+//
+// #_rounded_rectangle
+//
+static void
+c_canvas_rounded_rectangle(mrb_state* mrb, canvas_t* c, int x1, int y1, int x2, int y2, int r, mrb_bool filled, int color) {
+  if ((color < 0) || (color > c->color_max)) return;
+
+  // Ensure x1 <= x2 and y1 <= y2.
+  int t;
+  if (x2 < x1) { t = x1; x1 = x2; x2 = t; }
+  if (y2 < y1) { t = y1; y1 = y2; y2 = t; }
+
+  // Radius can't be more than half of either side.
+  if (r > (x2 - x1) / 2) r = (x2 - x1) / 2;
+  if (r > (y2 - y1) / 2) r = (y2 - y1) / 2;
+  if (r <= 0) {
+    c_canvas_rectangle(mrb, c, x1, y1, x2, y2, filled, color);
+    return;
+  }
+
+  // Thick outlines are a ring between two rounded rectangles. Their corners share centers until the inner radius reaches 0.
+  if (!filled && (c->stroke_width > 1)) {
+    int out  = (c->stroke_width - 1) / 2;
+    int in   = c->stroke_width / 2 + 1;
+    int r_in = (r > in) ? r - in : 0;
+    stroke_shape_t outer = { x1 - out, y1 - out, x2 + out, y2 + out, r + out, r + out, NULL };
+    stroke_shape_t inner = { x1 + in,  y1 + in,  x2 - in,  y2 - in,  r_in,    r_in,    NULL };
+    c_canvas_stroke_ring(mrb, c, &outer, &inner, color);
+    return;
+  }
+
+  // Nothing to do if it's outside the visible area.
+  if ((x2 < c->clip_x1) || (x1 > c->clip_x2) || (y2 < c->clip_y1) || (y1 > c->clip_y2)) return;
+
+  // Straight parts. When filled, everything between the corners' rows is one block.
+  if (filled) {
+    c_canvas_fill_rect(mrb, c, x1, y1 + r, x2, y2 - r, color);
+  } else {
+    c_canvas_fill_rect(mrb, c, x1 + r, y1, x2 - r, y1, color);
+    c_canvas_fill_rect(mrb, c, x1 + r, y2, x2 - r, y2, color);
+    c_canvas_fill_rect(mrb, c, x1, y1 + r, x1, y2 - r, color);
+    c_canvas_fill_rect(mrb, c, x2, y1 + r, x2, y2 - r, color);
+  }
+
+  // Corners are quarter circles centered r pixels in from each corner.
+  int left   = x1 + r;
+  int right  = x2 - r;
+  int top    = y1 + r;
+  int bottom = y2 - r;
+
+  ellipse_walk_t walk;
+  c_ellipse_walk_start(&walk, r, r, c_ellipse_y_limit(c, top, bottom));
+  int x, y;
+  int y_filled = 0;
+
+  while (c_ellipse_walk_next(&walk, &x, &y)) {
+    // Points on the axes belong to the straight parts.
+    if (y == 0) continue;
+
+    if (filled) {
+      if (y == y_filled) continue;
+      y_filled = y;
+      c_canvas_fill_rect(mrb, c, left + x, top - y,    right - x, top - y,    color);
+      c_canvas_fill_rect(mrb, c, left + x, bottom + y, right - x, bottom + y, color);
+    } else {
+      if (x == 0) continue;
+      c_canvas_set_pixel(mrb, c, left + x,  top - y,    color);
+      c_canvas_set_pixel(mrb, c, right - x, top - y,    color);
+      c_canvas_set_pixel(mrb, c, left + x,  bottom + y, color);
+      c_canvas_set_pixel(mrb, c, right - x, bottom + y, color);
+    }
+  }
+}
+
+static mrb_value
+mrb_canvas_rounded_rectangle(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x1, y1, x2, y2, r;
+  mrb_bool filled = FALSE;
+  mrb_int color = -1;
+  mrb_get_args(mrb, "iiiii|bi", &x1, &y1, &x2, &y2, &r, &filled, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  c_canvas_rounded_rectangle(mrb, canvas, x1, y1, x2, y2, mrb_canvas_radius(mrb, r), filled, color);
+  STATS_END(canvas, STAT_ROUNDED_RECTANGLE);
+  return mrb_nil_value();
+}
+
+//
+// #_char
+//
+static void
+c_canvas_char(mrb_state* mrb, canvas_t* c, const uint8_t* char_bytes, mrb_int byte_count, int x, int y, int width, int scale, int color) {
+  if (width < 1) return;
+  if (scale < 1) return;
+  if ((color < 0) || (color > c->color_max)) return;
+
+  // How many vertical chunks. Split by displayed font width, allowing partial last.
+  int chunks = byte_count / width;
+  if (byte_count % width > 0) chunks += 1;
+
+  // Fast path: unscaled and untransformed, starting on a page boundary. Each font byte is one framebuffer byte.
+  if ((c->format == PIXEL_FORMAT_PAGE) && (scale == 1) && !c->invert_x && !c->invert_y && !c->swap_xy && (y % 8 == 0)) {
+    for (int chunk=0; chunk<chunks; chunk++) {
+      // Canvas and framebuffer coordinates are the same here, so clip the page's rows directly.
+      mrb_int page = (y / 8) + chunk;
+      if ((page * 8 + 7 < c->clip_y1) || (page * 8 > c->clip_y2)) continue;
+      uint8_t row_mask = 0xFF;
+      if (c->clip_y1 > page * 8)     row_mask &= 0xFF << (c->clip_y1 - page * 8);
+      if (c->clip_y2 < page * 8 + 7) row_mask &= 0xFF >> (page * 8 + 7 - c->clip_y2);
+
+      for (int column=0; column<width; column++) {
+        int index = chunk*width + column;
+        mrb_int px = x + column;
+        if ((index >= byte_count) || (px < c->clip_x1) || (px > c->clip_x2)) continue;
+
+        uint8_t bite = char_bytes[index] & row_mask;
+        if (!bite) continue;
+        c_canvas_write_masked(c, (page * c->columns) + px, 1, bite, color);
+        STATS_PIXELS(c, c_popcount(bite));
+        c_canvas_dirty(c, page, px, px);
+      }
+    }
+    return;
+  }
+
+  int y_current = y;
+  for (int chunk=0; chunk<chunks; chunk++) {
+    for (int column=0; column<width; column++) {
+      // Which byte
+      int index = chunk*width + column;
+      if (index >= byte_count) continue;
+
+      // Get it and show the pixels.
+      uint8_t bite = char_bytes[index];
+      if (!bite) continue;
+
+      if (scale <= 8) {
+        // Expand each font bit into scale bits, then write that column scale times.
+        uint64_t bits = 0;
+        for (int bit=0; bit < 8; bit++) {
+          if ((bite >> bit) & 0b1) bits |= c_low_bits(scale) << (bit*scale);
+        }
+        for (int sx=0; sx<scale; sx++) {
+          c_canvas_column_bits(c, x + (column*scale) + sx, y_current, bits, bits, 8*scale, color, DRAW_TRANSPARENT);
+        }
+      } else {
+        // Too tall for one 64-bit column. Each font pixel is a scale x scale square.
+        for (int bit=0; bit < 8; bit++) {
+          if (!((bite >> bit) & 0b1)) continue;
+          int px = x + (column*scale);
+          int py = y_current + (bit*scale);
+          c_canvas_fill_rect(mrb, c, px, py, px + scale - 1, py + scale - 1, color);
+        }
+      }
+    }
+    y_current += (8 * scale);
+  }
+}
+
+// Copy a glyph's Array of column bytes into a scratch String.
+static mrb_value
+mrb_canvas_char_bytes(mrb_state* mrb, mrb_value char_bytes) {
+  mrb_int byte_count = RARRAY_LEN(char_bytes);
+  mrb_value scratch = mrb_str_new(mrb, NULL, byte_count);
+
+  uint8_t* bytes = (uint8_t*)RSTRING_PTR(scratch);
+  for (mrb_int i=0; i<byte_count; i++) {
+    bytes[i] = (uint8_t)mrb_as_int(mrb, mrb_ary_entry(char_bytes, i));
+  }
+  return scratch;
+}
+
+//
+// Font glyph cache
+//
+// Decode the UTF-8 character at *i, and step past it. Anything invalid gives -1 and steps one byte,
+// so each bad byte shows as one ?, same as when text was drawn a byte at a time.
+static int32_t
+c_utf8_next(const uint8_t* s, mrb_int len, mrb_int* i) {
+  uint8_t lead = s[*i];
+  int extra;
+  int32_t codepoint, min;
+  if      (lead < 0x80)           { (*i)++; return lead; }
+  else if ((lead & 0xE0) == 0xC0) { extra = 1; codepoint = lead & 0x1F; min = 0x80; }
+  else if ((lead & 0xF0) == 0xE0) { extra = 2; codepoint = lead & 0x0F; min = 0x800; }
+  else if ((lead & 0xF8) == 0xF0) { extra = 3; codepoint = lead & 0x07; min = 0x10000; }
+  else                            { (*i)++; return -1; }
+
+  if (*i + extra >= len) { (*i)++; return -1; }
+  for (int k=1; k<=extra; k++) {
+    uint8_t next = s[*i + k];
+    if ((next & 0xC0) != 0x80) { (*i)++; return -1; }
+    codepoint = (codepoint << 6) | (next & 0x3F);
+  }
+
+  // Overlong encodings, surrogates and anything past Unicode are invalid too.
+  if ((codepoint < min) || (codepoint > 0x10FFFF) || ((codepoint >= 0xD800) && (codepoint <= 0xDFFF))) { (*i)++; return -1; }
+  *i += extra + 1;
+  return codepoint;
+}
+
+static inline mrb_int
+c_font_lookup_slot(canvas_t* c, void* glyph) {
+  return (mrb_int)((((uintptr_t)glyph) >> 3) * 2654435761u) & (c->font_lookup_size - 1);
+}
+
+static int
+c_font_map_compare(const void* a, const void* b) {
+  uint32_t ca = ((const font_map_entry_t*)a)->codepoint;
+  uint32_t cb = ((const font_map_entry_t*)b)->codepoint;
+  return (ca > cb) - (ca < cb);
+}
+
+// Pack every glyph Array of the font into one C table. Called only when @font_characters,
+// @font_widths or @font_map is replaced.
+static void
+mrb_canvas_font_load(mrb_state* mrb, mrb_value self, canvas_t* c, mrb_value font_characters, mrb_value font_widths, mrb_value font_map) {
+  // Forget the old font first, so a failed load doesn't leave a half built table looking valid.
+  c->font_characters  = mrb_nil_value();
+  c->font_widths      = mrb_nil_value();
+  c->font_map         = mrb_nil_value();
+  c->font_glyph_count = 0;
+  c->font_map_count   = 0;
+
+  if (!mrb_array_p(font_characters)) mrb_raise(mrb, E_TYPE_ERROR, "@font_characters must be an Array");
+  mrb_int glyph_count = RARRAY_LEN(font_characters);
+
+  // Stride is the largest glyph, so each one can be found by index.
+  mrb_int stride = 0;
+  for (mrb_int i=0; i<glyph_count; i++) {
+    mrb_value glyph = mrb_ary_entry(font_characters, i);
+    if (!mrb_array_p(glyph)) mrb_raise(mrb, E_TYPE_ERROR, "font characters must be Arrays of bytes");
+    if (RARRAY_LEN(glyph) > stride) stride = RARRAY_LEN(glyph);
+  }
+  if (stride > UINT16_MAX) mrb_raise(mrb, E_ARGUMENT_ERROR, "font character too large");
+
+  // Lookup has at least twice as many slots as glyphs, and a power of 2 for masking.
+  mrb_int lookup_size = 1;
+  while (lookup_size < glyph_count * 2) lookup_size <<= 1;
+
+  c->font_table       = (uint8_t*)mrb_realloc(mrb, c->font_table, (glyph_count * stride) + 1);
+  c->font_glyph_sizes = (uint16_t*)mrb_realloc(mrb, c->font_glyph_sizes, sizeof(uint16_t) * (glyph_count + 1));
+  c->font_lookup      = (mrb_int*)mrb_realloc(mrb, c->font_lookup, sizeof(mrb_int) * lookup_size);
+  c->font_lookup_size = lookup_size;
+  for (mrb_int i=0; i<lookup_size; i++) c->font_lookup[i] = -1;
+
+  for (mrb_int i=0; i<glyph_count; i++) {
+    mrb_value glyph = mrb_ary_entry(font_characters, i);
+    uint8_t* bytes  = c->font_table + (i * stride);
+    c->font_glyph_sizes[i] = RARRAY_LEN(glyph);
+    for (mrb_int b=0; b<RARRAY_LEN(glyph); b++) {
+      bytes[b] = (uint8_t)mrb_as_int(mrb, mrb_ary_entry(glyph, b));
+    }
+
+    // Linear probing. First index wins if the same Array appears twice.
+    mrb_int slot = c_font_lookup_slot(c, mrb_ptr(glyph));
+    while (c->font_lookup[slot] >= 0) {
+      if (mrb_ptr(mrb_ary_entry(font_characters, c->font_lookup[slot])) == mrb_ptr(glyph)) break;
+      slot = (slot + 1) & (lookup_size - 1);
+    }
+    if (c->font_lookup[slot] < 0) c->font_lookup[slot] = i;
+  }
+
+  // Metrics are set together with @font_characters by Canvas#font=.
+  c->font_last_character = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_last_character")));
+  c->font_height         = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_height")));
+  c->font_width          = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_width")));
+
+  // Proportional fonts give each glyph's width in columns. Its bytes are that many columns for each 8 rows.
+  if (mrb_nil_p(font_widths)) {
+    mrb_free(mrb, c->font_glyph_widths);
+    c->font_glyph_widths = NULL;
+  } else {
+    if (!mrb_array_p(font_widths) || RARRAY_LEN(font_widths) < glyph_count) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "@font_widths needs a width for each font character");
+    }
+    c->font_glyph_widths = (uint16_t*)mrb_realloc(mrb, c->font_glyph_widths, sizeof(uint16_t) * (glyph_count + 1));
+    for (mrb_int i=0; i<glyph_count; i++) {
+      mrb_int width = mrb_as_int(mrb, mrb_ary_entry(font_widths, i));
+      if ((width < 0) || (width > UINT16_MAX)) mrb_raise(mrb, E_ARGUMENT_ERROR, "font character width out of range");
+      c->font_glyph_widths[i] = width;
+    }
+  }
+
+  // Characters past the run from SPACE map to glyphs sparsely. Keys are code points, or 1 character Strings.
+  mrb_int map_count = 0;
+  if (!mrb_nil_p(font_map)) {
+    if (!mrb_hash_p(font_map)) mrb_raise(mrb, E_TYPE_ERROR, "@font_map must be a Hash");
+    mrb_value keys = mrb_hash_keys(mrb, font_map);
+    map_count = RARRAY_LEN(keys);
+    c->font_map_entries = (font_map_entry_t*)mrb_realloc(mrb, c->font_map_entries, sizeof(font_map_entry_t) * (map_count + 1));
+
+    for (mrb_int i=0; i<map_count; i++) {
+      mrb_value key = mrb_ary_entry(keys, i);
+      mrb_int codepoint;
+      if (mrb_string_p(key)) {
+        mrb_int position = 0;
+        codepoint = (RSTRING_LEN(key) > 0) ? c_utf8_next((const uint8_t*)RSTRING_PTR(key), RSTRING_LEN(key), &position) : -1;
+      } else {
+        codepoint = mrb_as_int(mrb, key);
+      }
+      mrb_int glyph = mrb_as_int(mrb, mrb_hash_get(mrb, font_map, key));
+      if ((codepoint < 0) || (codepoint > 0x10FFFF)) mrb_raise(mrb, E_ARGUMENT_ERROR, "@font_map keys must be characters");
+      if ((glyph < 0) || (glyph >= glyph_count)) mrb_raise(mrb, E_ARGUMENT_ERROR, "@font_map glyph index out of range");
+      c->font_map_entries[i].codepoint = codepoint;
+      c->font_map_entries[i].glyph     = glyph;
+    }
+    qsort(c->font_map_entries, map_count, sizeof(font_map_entry_t), c_font_map_compare);
+  }
+
+  c->font_glyph_count  = glyph_count;
+  c->font_glyph_stride = stride;
+  c->font_map_count    = map_count;
+  c->font_characters   = font_characters;
+  c->font_widths       = font_widths;
+  c->font_map          = font_map;
+
+  // Keep the font alive while cached, so its addresses can't be reused by different objects.
+  mrb_value font = mrb_ary_new_capa(mrb, 3);
+  mrb_ary_push(mrb, font, font_characters);
+  mrb_ary_push(mrb, font, font_widths);
+  mrb_ary_push(mrb, font, font_map);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "__fastcanvas_font__"), font);
+}
+
+// Make sure the glyph table matches the current @font_characters, @font_widths and @font_map.
+static void
+mrb_canvas_font(mrb_state* mrb, mrb_value self, canvas_t* c) {
+  mrb_value font_characters = mrb_iv_get(mrb, self, c->sym_font_characters);
+  mrb_value font_widths     = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_widths"));
+  mrb_value font_map        = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_map"));
+
+  // Replacing any of the font's objects, adding or removing glyphs, or changing a metric rebuilds the table.
+  // Bytes changed inside a glyph Array aren't seen, so glyphs are replaced, not edited.
+  mrb_bool changed = !mrb_obj_equal(mrb, font_characters, c->font_characters) ||
+                     !mrb_obj_equal(mrb, font_widths, c->font_widths) ||
+                     !mrb_obj_equal(mrb, font_map, c->font_map);
+  if (!changed && mrb_array_p(font_characters)) {
+    changed = (RARRAY_LEN(font_characters) != c->font_glyph_count) ||
+              (mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_last_character"))) != c->font_last_character) ||
+              (mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_height"))) != c->font_height) ||
+              (mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_width"))) != c->font_width);
+  }
+  if (changed) {
+    mrb_canvas_font_load(mrb, self, c, font_characters, font_widths, font_map);
+  }
+}
+
+// Glyph index for a code point. The font starts at SPACE, and runs in code point order to @font_last_character.
+// Others are looked up in @font_map. Show ? for anything missing, including bytes that aren't valid UTF-8.
+static mrb_int
+c_font_glyph(canvas_t* c, int32_t codepoint) {
+  if ((codepoint >= 32) && (codepoint - 32 <= c->font_last_character)) return codepoint - 32;
+
+  mrb_int lo = 0;
+  mrb_int hi = c->font_map_count - 1;
+  while (lo <= hi) {
+    mrb_int mid = (lo + hi) / 2;
+    uint32_t found = c->font_map_entries[mid].codepoint;
+    if (found == (uint32_t)codepoint) return c->font_map_entries[mid].glyph;
+    if (found < (uint32_t)codepoint) lo = mid + 1; else hi = mid - 1;
+  }
+  return 31;
+}
+
+// Unscaled width of a glyph, also how far the cursor moves past it.
+static mrb_int
+c_font_glyph_width(canvas_t* c, mrb_int index) {
+  if ((c->font_glyph_widths != NULL) && (index < c->font_glyph_count)) return c->font_glyph_widths[index];
+  return c->font_width;
+}
+
+// Draw a glyph from the cached font, with its top left corner at x, y.
+static void
+c_canvas_glyph(mrb_state* mrb, canvas_t* c, mrb_int index, mrb_int x, mrb_int y, mrb_int scale, int color) {
+  if (index >= c->font_glyph_count) return;
+  uint8_t* glyph = c->font_table + (index * c->font_glyph_stride);
+  c_canvas_char(mrb, c, glyph, c->font_glyph_sizes[index], x, y, c_font_glyph_width(c, index), scale, color);
+}
+
+// Index of a glyph Array in the cached font, or -1 if it isn't one of the font's glyphs.
+static mrb_int
+c_font_glyph_index(canvas_t* c, mrb_value glyph) {
+  if (c->font_glyph_count == 0) return -1;
+  mrb_int slot = c_font_lookup_slot(c, mrb_ptr(glyph));
+  while (c->font_lookup[slot] >= 0) {
+    mrb_int index = c->font_lookup[slot];
+    if (mrb_ptr(mrb_ary_entry(c->font_characters, index)) == mrb_ptr(glyph)) return index;
+    slot = (slot + 1) & (c->font_lookup_size - 1);
+  }
+  return -1;
+}
+
+static mrb_value
+mrb_canvas_char(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_value char_bytes;
+  mrb_int x, y, width, scale;
+  mrb_int color = -1;
+  mrb_get_args(mrb, "Aiiii|i", &char_bytes, &x, &y, &width, &scale, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  // Glyphs from the current font are read from the cached table. Anything else is converted.
+  mrb_canvas_font(mrb, self, canvas);
+  mrb_int index = c_font_glyph_index(canvas, char_bytes);
+  if (index >= 0 && RARRAY_LEN(char_bytes) == canvas->font_glyph_sizes[index]) {
+    uint8_t* glyph = canvas->font_table + (index * canvas->font_glyph_stride);
+    c_canvas_char(mrb, canvas, glyph, canvas->font_glyph_sizes[index], x, y, width, scale, color);
+  } else {
+    mrb_value bytes = mrb_canvas_char_bytes(mrb, char_bytes);
+    c_canvas_char(mrb, canvas, (uint8_t*)RSTRING_PTR(bytes), RSTRING_LEN(bytes), x, y, width, scale, color);
+  }
+  STATS_END(canvas, STAT_CHAR);
+  return mrb_nil_value();
+}
+
+//
+// #text
+//
+static mrb_value
+mrb_canvas_text(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_value str;
+  mrb_value kwargs = mrb_nil_value();
+  mrb_int color = -1;
+  mrb_get_args(mrb, "S|H", &str, &kwargs);
+
+  // Get color kwarg if given
+  if (!mrb_nil_p(kwargs)) {
+    mrb_value color_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "color")));
+    if (!mrb_nil_p(color_val)) color = mrb_fixnum(color_val);
+  }
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  // Font glyphs and metrics are cached. Scale can change without changing font.
+  mrb_canvas_font(mrb, self, canvas);
+  mrb_int font_scale    = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_scale")));
+  mrb_value text_cursor = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@text_cursor"));
+
+  // String vars
+  const uint8_t* str_ptr = (const uint8_t*)mrb_string_cstr(mrb, str);
+  mrb_int str_len = RSTRING_LEN(str);
+
+  // Offset by scaled height, since bottom left of char starts at text cursor.
+  mrb_int line_height = canvas->font_height * font_scale;
+  mrb_int x_start = mrb_fixnum(mrb_ary_ref(mrb, text_cursor, 0));
+  mrb_int x = x_start;
+  mrb_int y = mrb_fixnum(mrb_ary_ref(mrb, text_cursor, 1)) + 1 - line_height;
+  mrb_bool new_line = FALSE;
+
+  // Each character of the string, decoded from UTF-8.
+  mrb_int i = 0;
+  while (i < str_len) {
+    // Newline goes back to the starting x, one line down.
+    if (str_ptr[i] == '\n') {
+      x = x_start;
+      y += line_height;
+      new_line = TRUE;
+      i++;
+      continue;
+    }
+
+    // Draw it, then increment x by its scaled width.
+    mrb_int index = c_font_glyph(canvas, c_utf8_next(str_ptr, str_len, &i));
+    c_canvas_glyph(mrb, canvas, index, x, y, font_scale, color);
+    x += c_font_glyph_width(canvas, index) * font_scale;
+  }
+
+  // Update @text_cursor ivar. y only moves for newlines.
+  mrb_ary_set(mrb, text_cursor, 0, mrb_fixnum_value(x));
+  if (new_line) mrb_ary_set(mrb, text_cursor, 1, mrb_fixnum_value(y + line_height - 1));
+  STATS_END(canvas, STAT_TEXT);
+  return mrb_nil_value();
+}
+
+//
+// #text_width and #text_box
+//
+// Lay out one line of text from start, and return where it ends. A line ends at a newline or the end of the
+// string. With wrap, it also ends before the first character that would pass max_width, after the last space
+// if there was one, else between characters. next is where the following line starts, and width is the
+// line's width in pixels. Spaces either side of a wrap are dropped, so they don't count toward the width.
+static mrb_int
+c_text_line(canvas_t* c, const uint8_t* str, mrb_int len, mrb_int start, mrb_bool wrap, mrb_int max_width, mrb_int scale, mrb_int* next, mrb_int* width) {
+  mrb_int x = 0;
+  mrb_int space = -1;
+  mrb_int space_x = 0;
+  mrb_int i = start;
+
+  while (i < len) {
+    if (str[i] == '\n') {
+      *next  = i + 1;
+      *width = x;
+      return i;
+    }
+
+    mrb_int char_start = i;
+    int32_t codepoint = c_utf8_next(str, len, &i);
+    mrb_int advance = c_font_glyph_width(c, c_font_glyph(c, codepoint)) * scale;
+    if (codepoint == ' ') {
+      space   = char_start;
+      space_x = x;
+    }
+
+    // Every line gets at least one character, so long words still make progress.
+    if (wrap && (x + advance > max_width) && (char_start > start)) {
+      mrb_int end = (space >= 0) ? space : char_start;
+      mrb_int end_x = (space >= 0) ? space_x : x;
+
+      // Next line starts after the spaces at the break, and this one ends before them.
+      *next = end;
+      while ((*next < len) && (str[*next] == ' ')) (*next)++;
+      mrb_int space_advance = c_font_glyph_width(c, c_font_glyph(c, ' ')) * scale;
+      while ((end > start) && (str[end - 1] == ' ')) {
+        end--;
+        end_x -= space_advance;
+      }
+      *width = end_x;
+      return end;
+    }
+    x += advance;
+  }
+  *next  = len;
+  *width = x;
+  return len;
+}
+
+// Width of the widest line, in pixels, at the current font and scale. Nothing is drawn.
+static mrb_value
+mrb_canvas_text_width(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_value str;
+  mrb_get_args(mrb, "S", &str);
+
+  mrb_canvas_font(mrb, self, canvas);
+  mrb_int font_scale = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_scale")));
+  const uint8_t* str_ptr = (const uint8_t*)RSTRING_PTR(str);
+  mrb_int str_len = RSTRING_LEN(str);
+
+  mrb_int widest = 0;
+  mrb_int start  = 0;
+  while (start < str_len) {
+    mrb_int width;
+    c_text_line(canvas, str_ptr, str_len, start, FALSE, 0, font_scale, &start, &width);
+    if (width > widest) widest = width;
+  }
+
+  STATS_END(canvas, STAT_TEXT_WIDTH);
+  return mrb_fixnum_value(widest);
+}
+
+// Alignment of each line in #text_box.
+enum {
+  TEXT_ALIGN_LEFT   = 0,
+  TEXT_ALIGN_CENTER = 1,
+  TEXT_ALIGN_RIGHT  = 2,
+};
+
+// Draw text into a box, top line first, from its top left corner. Lines are laid out and drawn one at a time,
+// and drawing is clipped to the box. Returns how many lines the text took, including any below the box.
+static mrb_value
+mrb_canvas_text_box(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x1, y1, x2, y2, t;
+  mrb_value str;
+  mrb_value kwargs = mrb_nil_value();
+  mrb_int color = -1;
+  mrb_bool wrap = TRUE;
+  int align = TEXT_ALIGN_LEFT;
+  mrb_get_args(mrb, "iiiiS|H", &x1, &y1, &x2, &y2, &str, &kwargs);
+  if (x2 < x1) { t = x1; x1 = x2; x2 = t; }
+  if (y2 < y1) { t = y1; y1 = y2; y2 = t; }
+
+  // Get kwargs if given
+  if (!mrb_nil_p(kwargs)) {
+    mrb_value color_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "color")));
+    if (!mrb_nil_p(color_val)) color = mrb_fixnum(color_val);
+
+    mrb_value wrap_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "wrap")));
+    if (!mrb_nil_p(wrap_val)) wrap = mrb_test(wrap_val);
+
+    mrb_value align_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "align")));
+    if (!mrb_nil_p(align_val)) {
+      mrb_sym align_sym = mrb_symbol_p(align_val) ? mrb_symbol(align_val) : 0;
+      if      (align_sym == mrb_intern_lit(mrb, "left"))   align = TEXT_ALIGN_LEFT;
+      else if (align_sym == mrb_intern_lit(mrb, "center")) align = TEXT_ALIGN_CENTER;
+      else if (align_sym == mrb_intern_lit(mrb, "right"))  align = TEXT_ALIGN_RIGHT;
+      else mrb_raise(mrb, E_ARGUMENT_ERROR, "text align must be :left, :center or :right");
+    }
+  }
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  mrb_canvas_font(mrb, self, canvas);
+  mrb_int font_scale  = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_scale")));
+  mrb_int line_height = canvas->font_height * font_scale;
+  const uint8_t* str_ptr = (const uint8_t*)RSTRING_PTR(str);
+  mrb_int str_len = RSTRING_LEN(str);
+
+  // Limit drawing to the box, inside any clip already set. Nothing below can raise, so it's always put back.
+  mrb_int clip_x1 = canvas->clip_x1;
+  mrb_int clip_y1 = canvas->clip_y1;
+  mrb_int clip_x2 = canvas->clip_x2;
+  mrb_int clip_y2 = canvas->clip_y2;
+  if (x1 > canvas->clip_x1) canvas->clip_x1 = x1;
+  if (y1 > canvas->clip_y1) canvas->clip_y1 = y1;
+  if (x2 < canvas->clip_x2) canvas->clip_x2 = x2;
+  if (y2 < canvas->clip_y2) canvas->clip_y2 = y2;
+
+  mrb_int line_count = 0;
+  mrb_int y = y1;
+  mrb_int start = 0;
+  while (start < str_len) {
+    mrb_int next, width;
+    mrb_int end = c_text_line(canvas, str_ptr, str_len, start, wrap, x2 - x1 + 1, font_scale, &next, &width);
+
+    // Only draw lines that are at least partly visible.
+    if ((y <= canvas->clip_y2) && (y + line_height - 1 >= canvas->clip_y1)) {
+      mrb_int x = x1;
+      if (align == TEXT_ALIGN_CENTER) x += (x2 - x1 + 1 - width) / 2;
+      if (align == TEXT_ALIGN_RIGHT)  x += (x2 - x1 + 1 - width);
+
+      mrb_int i = start;
+      while ((i < end) && (x <= canvas->clip_x2)) {
+        mrb_int index = c_font_glyph(canvas, c_utf8_next(str_ptr, str_len, &i));
+        c_canvas_glyph(mrb, canvas, index, x, y, font_scale, color);
+        x += c_font_glyph_width(canvas, index) * font_scale;
+      }
+    }
+    line_count++;
+    y += line_height;
+    start = next;
+  }
+
+  canvas->clip_x1 = clip_x1;
+  canvas->clip_y1 = clip_y1;
+  canvas->clip_x2 = clip_x2;
+  canvas->clip_y2 = clip_y2;
+  STATS_END(canvas, STAT_TEXT_BOX);
+  return mrb_fixnum_value(line_count);
+}
+
+//
+// #_bitmap
+//
+static void
+c_canvas_bitmap(mrb_state* mrb, canvas_t* c, int x, int y, int width, int height, const uint8_t* data, mrb_bool row_order, int color, int mode) {
+  mrb_int row_stride = (width + 7) / 8;
+
+  // Draw each column in strips of up to 64 rows.
+  for (int column=0; column<width; column++) {
+    for (int top=0; top<height; top+=64) {
+      int count = (height - top > 64) ? 64 : height - top;
+      uint64_t bits = 0;
+
+      if (row_order) {
+        // Rows of MSB first bytes.
+        for (int row=0; row<count; row++) {
+          uint8_t bite = data[((top + row) * row_stride) + (column / 8)];
+          if ((bite >> (7 - (column % 8))) & 0b1) bits |= 1ULL << row;
+        }
+      } else {
+        // Pages of LSB at top bytes, same as framebuffers and fonts.
+        for (int page=0; page*8 < count; page++) {
+          bits |= (uint64_t)data[(((top / 8) + page) * width) + column] << (page * 8);
+        }
+      }
+
+      uint64_t region = (mode == DRAW_OPAQUE) ? c_low_bits(count) : bits;
+      c_canvas_column_bits(c, x + column, y + top, bits, region, count, color, mode);
+    }
+  }
+}
+
+static mrb_value
+mrb_canvas_bitmap(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x, y, width, height;
+  mrb_value data;
+  mrb_value kwargs = mrb_nil_value();
+  mrb_int color = -1;
+  int mode = DRAW_TRANSPARENT;
+  mrb_bool row_order = FALSE;
+  mrb_get_args(mrb, "iiiiS|H", &x, &y, &width, &height, &data, &kwargs);
+
+  // Get kwargs if given
+  if (!mrb_nil_p(kwargs)) {
+    mrb_value color_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "color")));
+    if (!mrb_nil_p(color_val)) color = mrb_fixnum(color_val);
+
+    mrb_value mode_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "mode")));
+    if (!mrb_nil_p(mode_val)) {
+      mrb_sym mode_sym = mrb_symbol_p(mode_val) ? mrb_symbol(mode_val) : 0;
+      if      (mode_sym == mrb_intern_lit(mrb, "transparent")) mode = DRAW_TRANSPARENT;
+      else if (mode_sym == mrb_intern_lit(mrb, "opaque"))      mode = DRAW_OPAQUE;
+      else if (mode_sym == mrb_intern_lit(mrb, "xor"))         mode = DRAW_XOR;
+      else mrb_raise(mrb, E_ARGUMENT_ERROR, "bitmap mode must be :transparent, :opaque or :xor");
+    }
+
+    mrb_value order_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "order")));
+    if (!mrb_nil_p(order_val)) {
+      mrb_sym order_sym = mrb_symbol_p(order_val) ? mrb_symbol(order_val) : 0;
+      if      (order_sym == mrb_intern_lit(mrb, "page")) row_order = FALSE;
+      else if (order_sym == mrb_intern_lit(mrb, "row"))  row_order = TRUE;
+      else mrb_raise(mrb, E_ARGUMENT_ERROR, "bitmap order must be :page or :row");
+    }
+  }
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  if ((width < 0) || (height < 0)) mrb_raise(mrb, E_ARGUMENT_ERROR, "bitmap size can't be negative");
+  // Bytes per row (or page column) times rows (or pages), checked by dividing so it can't overflow.
+  mrb_int stride = (row_order) ? (width / 8) + (width % 8 != 0) : width;
+  mrb_int count  = (row_order) ? height : (height / 8) + (height % 8 != 0);
+  if ((count != 0) && (stride > RSTRING_LEN(data) / count)) mrb_raise(mrb, E_ARGUMENT_ERROR, "bitmap data too short for its size");
+
+  c_canvas_bitmap(mrb, canvas, x, y, width, height, (const uint8_t*)RSTRING_PTR(data), row_order, color, mode);
+  STATS_END(canvas, STAT_BITMAP);
+  return mrb_nil_value();
+}
+
+//
+// #_dither_image
+//
+// Ways to turn 8-bit gray into on/off pixels.
+enum {
+  DITHER_BAYER           = 0, // Ordered, against an 8x8 threshold matrix. Stable patterns, good for UI gradients.
+  DITHER_FLOYD_STEINBERG = 1, // Error diffusion. Better for photos.
+};
+
+static const uint8_t c_bayer_8x8[8][8] = {
+  {  0, 32,  8, 40,  2, 34, 10, 42 },
+  { 48, 16, 56, 24, 50, 18, 58, 26 },
+  { 12, 44,  4, 36, 14, 46,  6, 38 },
+  { 60, 28, 52, 20, 62, 30, 54, 22 },
+  {  3, 35, 11, 43,  1, 33,  9, 41 },
+  { 51, 19, 59, 27, 49, 17, 57, 25 },
+  { 15, 47,  7, 39, 13, 45,  5, 37 },
+  { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+// Each byte of data is how much of color a pixel gets, 0 to 255, in rows of width bytes. Rows are dithered
+// in order, into a strip of up to 64 rows of bits per column, which is drawn opaque like a bitmap.
+// Floyd-Steinberg only needs errors for the current row and the next, each with a spare entry at either end.
+static void
+c_canvas_dither_image(mrb_state* mrb, canvas_t* c, mrb_int x, mrb_int y, mrb_int width, mrb_int height, const uint8_t* data, int method, int color) {
+  if ((color < 0) || (color > c->color_max)) return;
+  if ((width == 0) || (height == 0)) return;
+
+  // Scratch memory is a Ruby String, so it's collected by GC.
+  mrb_value scratch = mrb_str_new(mrb, NULL, (sizeof(uint64_t) * width) + (sizeof(int16_t) * 2 * (width + 2)));
+  uint64_t* columns = (uint64_t*)RSTRING_PTR(scratch);
+  int16_t*  error   = (int16_t*)(columns + width);
+  int16_t*  error_next = error + (width + 2);
+  memset(error, 0, sizeof(int16_t) * 2 * (width + 2));
+
+  for (mrb_int top=0; top<height; top+=64) {
+    int count = (height - top > 64) ? 64 : (int)(height - top);
+    memset(columns, 0, sizeof(uint64_t) * width);
+
+    for (int row=0; row<count; row++) {
+      const uint8_t* gray = data + ((top + row) * width);
+
+      if (method == DITHER_BAYER) {
+        const uint8_t* thresholds = c_bayer_8x8[(top + row) % 8];
+        for (mrb_int column=0; column<width; column++) {
+          if (gray[column] > (thresholds[column % 8] * 4) + 2) columns[column] |= 1ULL << row;
+        }
+        continue;
+      }
+
+      // Push each pixel's error right, and onto the row below.
+      for (mrb_int column=0; column<width; column++) {
+        int value = gray[column] + error[column + 1];
+        int err   = value;
+        if (value >= 128) {
+          columns[column] |= 1ULL << row;
+          err = value - 255;
+        }
+        error[column + 2]      += (err * 7) / 16;
+        error_next[column]     += (err * 3) / 16;
+        error_next[column + 1] += (err * 5) / 16;
+        error_next[column + 2] += err / 16;
+      }
+      int16_t* swap = error;
+      error      = error_next;
+      error_next = swap;
+      memset(error_next, 0, sizeof(int16_t) * (width + 2));
+    }
+
+    for (mrb_int column=0; column<width; column++) {
+      c_canvas_column_bits(c, x + column, y + top, columns[column], c_low_bits(count), count, color, DRAW_OPAQUE);
+    }
+  }
+}
+
+static mrb_value
+mrb_canvas_dither_image(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x, y, width, height;
+  mrb_value data;
+  mrb_value kwargs = mrb_nil_value();
+  mrb_int color = -1;
+  int method = DITHER_BAYER;
+  mrb_get_args(mrb, "iiiiS|H", &x, &y, &width, &height, &data, &kwargs);
+
+  // Get kwargs if given
+  if (!mrb_nil_p(kwargs)) {
+    mrb_value color_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "color")));
+    if (!mrb_nil_p(color_val)) color = mrb_fixnum(color_val);
+
+    mrb_value method_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "method")));
+    if (!mrb_nil_p(method_val)) {
+      mrb_sym method_sym = mrb_symbol_p(method_val) ? mrb_symbol(method_val) : 0;
+      if      (method_sym == mrb_intern_lit(mrb, "bayer"))           method = DITHER_BAYER;
+      else if (method_sym == mrb_intern_lit(mrb, "floyd_steinberg")) method = DITHER_FLOYD_STEINBERG;
+      else mrb_raise(mrb, E_ARGUMENT_ERROR, "dither method must be :bayer or :floyd_steinberg");
+    }
+  }
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  if ((width < 0) || (height < 0)) mrb_raise(mrb, E_ARGUMENT_ERROR, "image size can't be negative");
+  // Divide instead of multiplying, which could overflow.
+  if ((height != 0) && (width > RSTRING_LEN(data) / height)) mrb_raise(mrb, E_ARGUMENT_ERROR, "image data too short for its size");
+
+  c_canvas_dither_image(mrb, canvas, x, y, width, height, (const uint8_t*)RSTRING_PTR(data), method, color);
+  STATS_END(canvas, STAT_DITHER_IMAGE);
+  return mrb_nil_value();
+}
+
+//
+// #_flood_fill
+//
+// Span based scanline fill (Heckbert's seed fill). Each stack entry is a span on row y, already filled,
+// whose neighbours on row y + dy still need checking. Coordinates are canvas coordinates.
+typedef struct {
+  int16_t y;
+  int16_t x1;
+  int16_t x2;
+  int16_t dy;
+} flood_span_t;
+
+// Stack entries per row and column of the visible area. Enough for all but pathological shapes.
+#define FLOOD_FILL_STACK_PER_LINE 4
+
+// Whether the pixel under mask in byte index of each :page plane is old_color: clear in every plane before
+// its own, and set in that one. 0 is clear in all of them.
+static inline mrb_bool
+c_flood_page_is(canvas_t* c, mrb_int index, uint8_t mask, int old_color) {
+  int clear = (old_color == 0) ? c->plane_count : old_color - 1;
+  for (int i=0; i<clear; i++) {
+    if (c->planes[i][index] & mask) return FALSE;
+  }
+  return (old_color == 0) || (c->planes[old_color - 1][index] & mask);
+}
+
+// Returns FALSE if the stack ran out, and the fill may be incomplete.
+static mrb_bool
+c_canvas_flood_fill(mrb_state* mrb, canvas_t* c, mrb_int x, mrb_int y, int color) {
+  if ((color < 0) || (color > c->color_max)) return TRUE;
+  if ((x < c->clip_x1) || (x > c->clip_x2) || (y < c->clip_y1) || (y > c->clip_y2)) return TRUE;
+
+  int old_color = c->read_pixel(c, x, y);
+  if (old_color == color) return TRUE;
+
+  // :page without rotation or reflection has each row as one bit of consecutive bytes, so test those directly.
+  // Anything else reads through the orientation's reader.
+  mrb_bool direct = (c->format == PIXEL_FORMAT_PAGE) && !c->invert_x && !c->invert_y && !c->swap_xy;
+  mrb_int  row_index = 0;
+  uint8_t  row_mask  = 0;
+  #define FLOOD_IS_OLD(X) \
+    ((direct) ? c_flood_page_is(c, row_index + (X), row_mask, old_color) : (c->read_pixel(c, (X), sy) == old_color))
+
+  // Scratch memory is a Ruby String, so it's collected by GC.
+  mrb_int capacity = FLOOD_FILL_STACK_PER_LINE * ((c->clip_x2 - c->clip_x1 + 1) + (c->clip_y2 - c->clip_y1 + 1)) + 2;
+  mrb_value scratch = mrb_str_new(mrb, NULL, sizeof(flood_span_t) * capacity);
+  flood_span_t* stack = (flood_span_t*)RSTRING_PTR(scratch);
+  mrb_int  top       = 0;
+  mrb_bool completed = TRUE;
+
+  // Only push spans whose next row is visible. Once the stack is full, finish what's on it and report.
+  #define FLOOD_PUSH(Y, X1, X2, DY) \
+    if (((Y) + (DY) >= c->clip_y1) && ((Y) + (DY) <= c->clip_y2)) { \
+      if (top < capacity) { \
+        stack[top].y = (Y); stack[top].x1 = (X1); stack[top].x2 = (X2); stack[top].dy = (DY); \
+        top++; \
+      } else { \
+        completed = FALSE; \
+      } \
+    }
+
+  // Seed with the row below, then the seed's own row, going up.
+  FLOOD_PUSH(y, x, x, 1);
+  FLOOD_PUSH(y + 1, x, x, -1);
+
+  while (top > 0) {
+    top--;
+    mrb_int dy = stack[top].dy;
+    mrb_int sy = stack[top].y + dy;
+    mrb_int x1 = stack[top].x1;
+    mrb_int x2 = stack[top].x2;
+    row_index = (sy / 8) * c->columns;
+    row_mask  = 1 << (sy % 8);
+
+    // Fill each run of old_color that touches x1..x2. Only the first can extend left, and only the last right.
+    mrb_int sx = x1;
+    while (sx <= x2) {
+      if (!FLOOD_IS_OLD(sx)) {
+        sx++;
+        continue;
+      }
+      mrb_int left  = sx;
+      mrb_int right = sx;
+      if (sx == x1) {
+        while ((left > c->clip_x1) && FLOOD_IS_OLD(left - 1)) left--;
+      }
+      while ((right < c->clip_x2) && FLOOD_IS_OLD(right + 1)) right++;
+      c->write_rect(c, left, sy, right, sy, color);
+
+      // Keep going the same way. Parts wider than the span we came from can leak back the other way.
+      FLOOD_PUSH(sy, left, right, dy);
+      if (left < x1)  FLOOD_PUSH(sy, left, x1 - 1, -dy);
+      if (right > x2) FLOOD_PUSH(sy, x2 + 1, right, -dy);
+
+      // right + 1 isn't old_color, or is outside the clip.
+      sx = right + 2;
+    }
+  }
+  #undef FLOOD_PUSH
+  #undef FLOOD_IS_OLD
+
+  return completed;
+}
+
+static mrb_value
+mrb_canvas_flood_fill(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x, y;
+  mrb_int color = -1;
+  mrb_get_args(mrb, "ii|i", &x, &y, &color);
+  color = mrb_canvas_color(mrb, self, canvas, color);
+
+  mrb_bool completed = c_canvas_flood_fill(mrb, canvas, x, y, color);
+
+  STATS_END(canvas, STAT_FLOOD_FILL);
+  return mrb_bool_value(completed);
+}
+
+//
+// #move_region and #scroll
+//
+// Copy a rectangle of :page bytes, in framebuffer coordinates, to dst_x, dst_y. Both are already clipped.
+// Source pages are copied out first, so any overlap is safe. Each destination byte is then two source
+// bytes shifted as one 16-bit word, and whole rows that don't need shifting are copied as they are.
+static void
+c_page_move_rect(mrb_state* mrb, canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, mrb_int dst_x, mrb_int dst_y) {
+  mrb_int width      = x2 - x1 + 1;
+  mrb_int page_first = y1 / 8;
+  mrb_int page_count = (y2 / 8) - page_first + 1;
+
+  // Scratch memory is a Ruby String, so it's collected by GC.
+  mrb_value scratch = mrb_str_new(mrb, NULL, width * page_count * c->plane_count);
+  uint8_t* source   = (uint8_t*)RSTRING_PTR(scratch);
+  for(int i=0; i < c->plane_count; i++) {
+    for(mrb_int page = 0; page < page_count; page++) {
+      memcpy(source + ((i * page_count) + page) * width, c->planes[i] + ((page_first + page) * c->columns) + x1, width);
+    }
+  }
+
+  mrb_int dst_y2 = dst_y + (y2 - y1);
+  for(mrb_int page = dst_y / 8; page <= dst_y2 / 8; page++) {
+    // Destination rows within this page.
+    mrb_int bit_first = (dst_y  > page*8)     ? dst_y  - page*8 : 0;
+    mrb_int bit_last  = (dst_y2 < page*8 + 7) ? dst_y2 - page*8 : 7;
+    uint8_t mask = (uint8_t)((0xFF << bit_first) & (0xFF >> (7 - bit_last)));
+
+    // Bit 0 of this page comes from source row base, in the low byte of a word starting at source page q.
+    // Only masked bits are used, and they always come from inside the source rectangle.
+    mrb_int base  = (page * 8) - (dst_y - y1);
+    mrb_int q     = (base >= 0) ? base / 8 : -((7 - base) / 8);
+    int     shift = (int)(base - (q * 8));
+    mrb_int low   = q - page_first;
+    mrb_int high  = low + 1;
+
+    for(int i=0; i < c->plane_count; i++) {
+      uint8_t* fb_data    = c->planes[i] + (page * c->columns) + dst_x;
+      uint8_t* plane      = source + (i * page_count * width);
+      uint8_t* low_bytes  = (low  >= 0 && low  < page_count) ? plane + (low  * width) : NULL;
+      uint8_t* high_bytes = (high >= 0 && high < page_count) ? plane + (high * width) : NULL;
+
+      if ((shift == 0) && (mask == 0xFF)) {
+        memcpy(fb_data, low_bytes, width);
+        continue;
+      }
+      for(mrb_int n=0; n < width; n++) {
+        uint16_t word = (low_bytes ? low_bytes[n] : 0) | ((high_bytes ? high_bytes[n] : 0) << 8);
+        fb_data[n] = (fb_data[n] & ~mask) | ((word >> shift) & mask);
+      }
+    }
+  }
+}
+
+// Other formats move one pixel at a time, in the order that reads each source pixel before it's overwritten.
+static void
+c_generic_move_rect(canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, mrb_int dst_x, mrb_int dst_y) {
+  mrb_int dx = dst_x - x1;
+  mrb_int dy = dst_y - y1;
+  mrb_int x_first = (dx > 0) ? x2 : x1;
+  mrb_int y_first = (dy > 0) ? y2 : y1;
+  mrb_int x_step  = (dx > 0) ? -1 : 1;
+  mrb_int y_step  = (dy > 0) ? -1 : 1;
+
+  for(mrb_int n = 0, y = y_first; n <= y2 - y1; n++, y += y_step) {
+    for(mrb_int m = 0, x = x_first; m <= x2 - x1; m++, x += x_step) {
+      c->format->set_pixel(c, x + dx, y + dy, c->format->get_pixel(c, x, y));
+    }
+  }
+}
+
+// Copy a rectangle in canvas coordinates so x1, y1 lands on dst_x, dst_y. Only source pixels inside the
+// framebuffer are copied, and only to destinations inside the clip.
+static void
+c_canvas_move_region(mrb_state* mrb, canvas_t* c, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, mrb_int dst_x, mrb_int dst_y) {
+  // Ensure x1 <= x2 and y1 <= y2.
+  mrb_int t;
+  if (x2 < x1) { t = x1; x1 = x2; x2 = t; }
+  if (y2 < y1) { t = y1; y1 = y2; y2 = t; }
+  mrb_int dx = dst_x - x1;
+  mrb_int dy = dst_y - y1;
+
+  // Clip the source to the framebuffer, then its destination to the clip.
+  mrb_int bx1, by1, bx2, by2;
+  c_canvas_bounds(c, &bx1, &by1, &bx2, &by2);
+  if (x1 < bx1) x1 = bx1;
+  if (y1 < by1) y1 = by1;
+  if (x2 > bx2) x2 = bx2;
+  if (y2 > by2) y2 = by2;
+  if (x1 + dx < c->clip_x1) x1 = c->clip_x1 - dx;
+  if (y1 + dy < c->clip_y1) y1 = c->clip_y1 - dy;
+  if (x2 + dx > c->clip_x2) x2 = c->clip_x2 - dx;
+  if (y2 + dy > c->clip_y2) y2 = c->clip_y2 - dy;
+  if ((x1 > x2) || (y1 > y2)) return;
+
+  // A translation stays one in framebuffer coordinates, so map both rectangles and move between them.
+  mrb_int sx1 = x1,      sy1 = y1,      sx2 = x2,      sy2 = y2;
+  mrb_int tx1 = x1 + dx, ty1 = y1 + dy, tx2 = x2 + dx, ty2 = y2 + dy;
+  c_canvas_physical_rect(c, &sx1, &sy1, &sx2, &sy2);
+  c_canvas_physical_rect(c, &tx1, &ty1, &tx2, &ty2);
+  if ((sx1 == tx1) && (sy1 == ty1)) return;
+
+  if (c->format == PIXEL_FORMAT_PAGE) {
+    c_page_move_rect(mrb, c, sx1, sy1, sx2, sy2, tx1, ty1);
+  } else {
+    c_generic_move_rect(c, sx1, sy1, sx2, sy2, tx1, ty1);
+  }
+  c_canvas_dirty_rect(c, tx1, ty1, tx2, ty2);
+  STATS_PIXELS(c, (tx2 - tx1 + 1) * (ty2 - ty1 + 1));
+}
+
+static mrb_value
+mrb_canvas_move_region(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int x1, y1, x2, y2, dst_x, dst_y;
+  mrb_get_args(mrb, "iiiiii", &x1, &y1, &x2, &y2, &dst_x, &dst_y);
+
+  c_canvas_move_region(mrb, canvas, x1, y1, x2, y2, dst_x, dst_y);
+
+  STATS_END(canvas, STAT_MOVE_REGION);
+  return mrb_nil_value();
+}
+
+// Move everything inside the clip by dx, dy, and fill what's uncovered with fill_color.
+static mrb_value
+mrb_canvas_scroll(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  // Get args
+  mrb_int dx, dy;
+  mrb_int fill_color = 0;
+  mrb_get_args(mrb, "ii|i", &dx, &dy, &fill_color);
+
+  mrb_int x1 = canvas->clip_x1;
+  mrb_int y1 = canvas->clip_y1;
+  mrb_int x2 = canvas->clip_x2;
+  mrb_int y2 = canvas->clip_y2;
+
+  if ((x1 <= x2) && (y1 <= y2)) {
+    c_canvas_move_region(mrb, canvas, x1, y1, x2, y2, x1 + dx, y1 + dy);
+
+    // Uncovered columns, then uncovered rows. Fills are clipped, so shifts bigger than the area just fill it.
+    if (dx > 0) c_canvas_fill_rect(mrb, canvas, x1, y1, x1 + dx - 1, y2, fill_color);
+    if (dx < 0) c_canvas_fill_rect(mrb, canvas, x2 + dx + 1, y1, x2, y2, fill_color);
+    if (dy > 0) c_canvas_fill_rect(mrb, canvas, x1, y1, x2, y1 + dy - 1, fill_color);
+    if (dy < 0) c_canvas_fill_rect(mrb, canvas, x1, y2 + dy + 1, x2, y2, fill_color);
+  }
+
+  STATS_END(canvas, STAT_SCROLL);
+  return mrb_nil_value();
+}
+
+//
+// #composite
+//
+// How layer pixels combine with the canvas, bitwise in each plane.
+enum {
+  COMPOSITE_COPY = 0,
+  COMPOSITE_OR   = 1,
+  COMPOSITE_AND  = 2,
+  COMPOSITE_XOR  = 3,
+  // Multi-color :xor, only where the layer has a color: same color clears, anything else takes the layer's.
+  COMPOSITE_XOR_COLOR = 4,
+};
+
+// Combine up to 8 columns at once. Only bits in mask change.
+static inline uint64_t
+c_composite_word(uint64_t dst, uint64_t src, uint64_t mask, int op) {
+  uint64_t result;
+  switch (op) {
+    case COMPOSITE_OR:  result = dst | src; break;
+    case COMPOSITE_AND: result = dst & src; break;
+    case COMPOSITE_XOR: result = dst ^ src; break;
+    case COMPOSITE_XOR_COLOR: result = src & ~dst; break;
+    default:            result = src;       break;
+  }
+  return (dst & ~mask) | (result & mask);
+}
+
+// One byte of a :page canvas, for source row base (bit 0) and the 7 below it, in column x. Rows outside it are 0.
+// Like c_page_move_rect, it's the low byte of two pages shifted as one 16-bit word.
+static inline uint8_t
+c_page_shifted_byte(canvas_t* c, uint8_t* plane, mrb_int base, mrb_int x) {
+  mrb_int q     = (base >= 0) ? base / 8 : -((7 - base) / 8);
+  int     shift = (int)(base - (q * 8));
+  uint16_t word = 0;
+  if ((q >= 0)     && (q < c->pages))     word  = plane[(q * c->columns) + x];
+  if ((q + 1 >= 0) && (q + 1 < c->pages)) word |= plane[((q + 1) * c->columns) + x] << 8;
+  return (uint8_t)(word >> shift);
+}
+
+// Blend a rectangle of layer, in its framebuffer coordinates, onto c at dst_x, dst_y. Both are already clipped.
+// Each destination page row is gathered into line buffers, then combined 8 bytes at a time.
+static void
+c_page_composite(mrb_state* mrb, canvas_t* c, canvas_t* layer, canvas_t* mask, mrb_int x1, mrb_int y1, mrb_int x2, mrb_int y2, mrb_int dst_x, mrb_int dst_y, int op) {
+  mrb_int width  = x2 - x1 + 1;
+  mrb_int dst_y2 = dst_y + (y2 - y1);
+
+  // Scratch memory is a Ruby String, so it's collected by GC.
+  mrb_value scratch  = mrb_str_new(mrb, NULL, width * (c->plane_count + 1));
+  uint8_t* mask_line = (uint8_t*)RSTRING_PTR(scratch);
+  uint8_t* src_lines = mask_line + width;
+
+  // With more than one color, :or and :xor per plane could leave a pixel set in two of them. Instead, they only
+  // change pixels where the layer has a color, and clear the canvas's other planes there.
+  mrb_bool by_color = (c->plane_count > 1) && ((op == COMPOSITE_OR) || (op == COMPOSITE_XOR));
+  if (by_color) op = (op == COMPOSITE_OR) ? COMPOSITE_COPY : COMPOSITE_XOR_COLOR;
+
+  for(mrb_int page = dst_y / 8; page <= dst_y2 / 8; page++) {
+    // Destination rows within this page, and the layer row that lands on bit 0.
+    mrb_int bit_first = (dst_y  > page*8)     ? dst_y  - page*8 : 0;
+    mrb_int bit_last  = (dst_y2 < page*8 + 7) ? dst_y2 - page*8 : 7;
+    uint8_t row_mask  = (uint8_t)((0xFF << bit_first) & (0xFF >> (7 - bit_last)));
+    mrb_int base      = (page * 8) - (dst_y - y1);
+
+    for(int i=0; i < c->plane_count; i++) {
+      for(mrb_int n=0; n < width; n++) {
+        src_lines[(i * width) + n] = c_page_shifted_byte(layer, layer->planes[i], base, x1 + n);
+      }
+    }
+
+    // Masked pixels are the ones with any color in the mask layer.
+    for(mrb_int n=0; n < width; n++) {
+      uint8_t bits = 0xFF;
+      if (mask) {
+        bits = 0;
+        for(int i=0; i < mask->plane_count; i++) bits |= c_page_shifted_byte(mask, mask->planes[i], base, x1 + n);
+      }
+      if (by_color) {
+        uint8_t colored = 0;
+        for(int i=0; i < c->plane_count; i++) colored |= src_lines[(i * width) + n];
+        bits &= colored;
+      }
+      mask_line[n] = bits & row_mask;
+    }
+
+    for(int i=0; i < c->plane_count; i++) {
+      uint8_t* fb_data = c->planes[i] + (page * c->columns) + dst_x;
+      uint8_t* src     = src_lines + (i * width);
+      mrb_int n = 0;
+      for(; n + 8 <= width; n += 8) {
+        uint64_t dst_word, src_word, mask_word;
+        memcpy(&dst_word,  fb_data + n,   8);
+        memcpy(&src_word,  src + n,       8);
+        memcpy(&mask_word, mask_line + n, 8);
+        dst_word = c_composite_word(dst_word, src_word, mask_word, op);
+        memcpy(fb_data + n, &dst_word, 8);
+      }
+      for(; n < width; n++) {
+        fb_data[n] = (uint8_t)c_composite_word(fb_data[n], src[n], mask_line[n], op);
+      }
+    }
+  }
+}
+
+// Layers must be laid out the same as the canvas, so blending is a translation between their framebuffers.
+static void
+mrb_canvas_check_layer(mrb_state* mrb, canvas_t* c, canvas_t* layer) {
+  if ((c->format != PIXEL_FORMAT_PAGE) || (layer->format != PIXEL_FORMAT_PAGE)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "composite needs :page framebuffers");
+  }
+  if ((layer->invert_x != c->invert_x) || (layer->invert_y != c->invert_y) || (layer->swap_xy != c->swap_xy)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "layer must have the same rotation and reflection as the canvas");
+  }
+}
+
+static mrb_value
+mrb_canvas_composite(mrb_state* mrb, mrb_value self) {
+  // Get args
+  mrb_value layer_obj;
+  mrb_int x, y;
+  mrb_value kwargs = mrb_nil_value();
+  mrb_value mask_obj = mrb_nil_value();
+  int op = COMPOSITE_COPY;
+  mrb_get_args(mrb, "oii|H", &layer_obj, &x, &y, &kwargs);
+
+  // Get kwargs if given
+  if (!mrb_nil_p(kwargs)) {
+    mrb_value op_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "op")));
+    if (!mrb_nil_p(op_val)) {
+      mrb_sym op_sym = mrb_symbol_p(op_val) ? mrb_symbol(op_val) : 0;
+      if      (op_sym == mrb_intern_lit(mrb, "copy")) op = COMPOSITE_COPY;
+      else if (op_sym == mrb_intern_lit(mrb, "or"))   op = COMPOSITE_OR;
+      else if (op_sym == mrb_intern_lit(mrb, "and"))  op = COMPOSITE_AND;
+      else if (op_sym == mrb_intern_lit(mrb, "xor"))  op = COMPOSITE_XOR;
+      else mrb_raise(mrb, E_ARGUMENT_ERROR, "composite op must be :copy, :or, :and or :xor");
+    }
+    mask_obj = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "mask")));
+  }
+  if (mrb_obj_equal(mrb, layer_obj, self) || mrb_obj_equal(mrb, mask_obj, self)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "can't composite a canvas onto itself");
+  }
+
+  // Get cached state for the layer, mask and canvas. The canvas last, since it's the one written to.
+  canvas_t* layer = mrb_get_canvas_data(mrb, layer_obj);
+  canvas_t* mask  = (mrb_nil_p(mask_obj)) ? NULL : mrb_get_canvas_data(mrb, mask_obj);
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
+
+  mrb_canvas_check_layer(mrb, canvas, layer);
+  if (layer->plane_count != canvas->plane_count) mrb_raise(mrb, E_ARGUMENT_ERROR, "layer must have the same colors as the canvas");
+  if (mask) {
+    mrb_canvas_check_layer(mrb, canvas, mask);
+    if ((mask->columns != layer->columns) || (mask->rows != layer->rows)) mrb_raise(mrb, E_ARGUMENT_ERROR, "mask must be the same size as the layer");
+  }
+
+  // The whole layer, placed at x, y in canvas coordinates, then clipped.
+  mrb_int x1, y1, x2, y2;
+  c_canvas_bounds(layer, &x1, &y1, &x2, &y2);
+  mrb_int dx = x - x1;
+  mrb_int dy = y - y1;
+  if (x1 + dx < canvas->clip_x1) x1 = canvas->clip_x1 - dx;
+  if (y1 + dy < canvas->clip_y1) y1 = canvas->clip_y1 - dy;
+  if (x2 + dx > canvas->clip_x2) x2 = canvas->clip_x2 - dx;
+  if (y2 + dy > canvas->clip_y2) y2 = canvas->clip_y2 - dy;
+
+  if ((x1 <= x2) && (y1 <= y2)) {
+    // Same orientation means a translation in framebuffer coordinates too.
+    mrb_int sx1 = x1,      sy1 = y1,      sx2 = x2,      sy2 = y2;
+    mrb_int tx1 = x1 + dx, ty1 = y1 + dy, tx2 = x2 + dx, ty2 = y2 + dy;
+    c_canvas_physical_rect(layer,  &sx1, &sy1, &sx2, &sy2);
+    c_canvas_physical_rect(canvas, &tx1, &ty1, &tx2, &ty2);
+
+    c_page_composite(mrb, canvas, layer, mask, sx1, sy1, sx2, sy2, tx1, ty1, op);
+    c_canvas_dirty_rect(canvas, tx1, ty1, tx2, ty2);
+    STATS_PIXELS(canvas, (tx2 - tx1 + 1) * (ty2 - ty1 + 1));
+  }
+
+  STATS_END(canvas, STAT_COMPOSITE);
   return mrb_nil_value();
 }
 
 //
-// #_get_pixel
+// #draw_batch
 //
-static int
-c_canvas_get_pixel(mrb_state* mrb, canvas_t* c, int x, int y) {
-  int byte_index = ((y / 8) * c->columns) + x;
-  int bit = y % 8;
+// Every command is an opcode byte followed by little-endian fields:
+//   BATCH_SET_PIXEL  x:s16 y:s16 color:s32
+//   BATCH_LINE       x1:s16 y1:s16 x2:s16 y2:s16 color:s32
+//   BATCH_RECTANGLE  x1:s16 y1:s16 x2:s16 y2:s16 filled:u8 color:s32
+//   BATCH_ELLIPSE    x:s16 y:s16 a:s16 b:s16 filled:u8 color:s32
+//   BATCH_PATH       count:u16 color:s32, then count * (x:s16 y:s16)
+//   BATCH_POLYGON    count:u16 filled:u8 color:s32, then count * (x:s16 y:s16). filled 2 uses the nonzero rule.
+//   BATCH_CHAR       x:s16 y:s16 width:u8 scale:u8 color:s32 count:u16, then count glyph bytes
+// Color -1 means @current_color, same as leaving color out of the individual methods.
+enum {
+  BATCH_SET_PIXEL = 1,
+  BATCH_LINE      = 2,
+  BATCH_RECTANGLE = 3,
+  BATCH_ELLIPSE   = 4,
+  BATCH_PATH      = 5,
+  BATCH_POLYGON   = 6,
+  BATCH_CHAR      = 7,
+};
 
-  // If bit not set in any framebuffer, color is 0.
-  int color = 0;
-
-  // Check all the framebuffers. If bit set, color is i.
-  for(int i=1; i <= c->colors; i++) {
-    mrb_value fb = mrb_ary_ref(mrb, c->framebuffers, i-1);
-    uint8_t* fb_data = (uint8_t*)RSTRING_PTR(fb);
-    uint8_t fb_byte = fb_data[byte_index];
-    if ((fb_byte >> bit) & 0b1) {
-      color = i;
-      break;
-    }
-  }
+typedef struct {
+  const uint8_t* ptr;
+  const uint8_t* end;
+} batch_reader_t;
 
-  return color;
+static inline uint8_t
+batch_u8(batch_reader_t* r) {
+  return *(r->ptr++);
 }
 
-static mrb_value
-mrb_canvas_get_pixel(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
-
-  // Get args
-  mrb_int x, y;
-  mrb_get_args(mrb, "ii", &x, &y);
-
-  int color = c_canvas_get_pixel(mrb, &canvas, x, y);
-  return mrb_fixnum_value(color);
+static inline uint16_t
+batch_u16(batch_reader_t* r) {
+  uint16_t value = (uint16_t)(r->ptr[0] | (r->ptr[1] << 8));
+  r->ptr += 2;
+  return value;
 }
 
-//
-// #_set_pixel
-//
-static void
-c_canvas_set_pixel(mrb_state* mrb, canvas_t* c, int x, int y, int color) {
-  // Reverse current canvas transformations.
-  mrb_int xt = (c->invert_x) ? c->x_max - x : x;
-  mrb_int yt = (c->invert_y) ? c->y_max - y : y;
-  if (c->swap_xy) {
-    mrb_int tt;
-    tt = xt;
-    xt = yt;
-    yt = tt;
-  }
+static inline int16_t
+batch_s16(batch_reader_t* r) {
+  return (int16_t)batch_u16(r);
+}
 
-  // Bounds check
-  if ((xt < 0) || (xt >= c->columns) || (yt < 0) || (yt >= c->rows)) return;
-  if ((color < 0) || (color > c->colors)) return;
+static inline int32_t
+batch_s32(batch_reader_t* r) {
+  uint32_t value = (uint32_t)r->ptr[0] | ((uint32_t)r->ptr[1] << 8) | ((uint32_t)r->ptr[2] << 16) | ((uint32_t)r->ptr[3] << 24);
+  r->ptr += 4;
+  return (int32_t)value;
+}
 
-  mrb_int byte_index = ((yt / 8) * c->columns) + xt;
-  uint8_t bit = yt % 8;
+// Walk the whole batch before drawing anything, so a malformed one raises without partially drawing.
+// Returns the largest point count of any path or polygon, to size scratch memory once.
+static mrb_int
+mrb_canvas_batch_check(mrb_state* mrb, batch_reader_t r) {
+  mrb_int max_points = 0;
 
-  // Colors are 1-indexed so "0" means blank/clear.
-  for(int i=1; i <= c->colors; i++) {
-    mrb_value fb = mrb_ary_ref(mrb, c->framebuffers, i-1);
-    uint8_t* fb_data = (uint8_t*)RSTRING_PTR(fb);
-    uint8_t fb_byte = fb_data[byte_index];
+  while (r.ptr < r.end) {
+    uint8_t opcode = batch_u8(&r);
+    mrb_int remaining = r.end - r.ptr;
+    mrb_int size, count;
 
-    // Set pixel in fb for given color
-    if (i == color) {
-      fb_byte = fb_byte | (0b1 << bit);
-    // Clear in other colors
-    } else {
-      fb_byte = fb_byte & ~(0b1 << bit);
+    switch (opcode) {
+      case BATCH_SET_PIXEL: size = 8;  break;
+      case BATCH_LINE:      size = 12; break;
+      case BATCH_RECTANGLE: size = 13; break;
+      case BATCH_ELLIPSE:   size = 13; break;
+      case BATCH_PATH:
+      case BATCH_POLYGON:
+        if (remaining < 2) mrb_raise(mrb, E_ARGUMENT_ERROR, "truncated draw_batch command");
+        count = r.ptr[0] | (r.ptr[1] << 8);
+        size  = ((opcode == BATCH_PATH) ? 6 : 7) + count * 4;
+        if (count > max_points) max_points = count;
+        break;
+      case BATCH_CHAR:
+        if (remaining < 12) mrb_raise(mrb, E_ARGUMENT_ERROR, "truncated draw_batch command");
+        size = 12 + (r.ptr[10] | (r.ptr[11] << 8));
+        break;
+      default:
+        mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown draw_batch opcode %i", (mrb_int)opcode);
     }
-    fb_data[byte_index] = fb_byte;
+    if (remaining < size) mrb_raise(mrb, E_ARGUMENT_ERROR, "truncated draw_batch command");
+    r.ptr += size;
   }
+  return max_points;
 }
 
 static mrb_value
-mrb_canvas_set_pixel(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
+mrb_canvas_draw_batch(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  STATS_BEGIN(canvas);
 
   // Get args
-  mrb_int x, y;
-  mrb_int color = -1;
-  mrb_get_args(mrb, "ii|i", &x, &y, &color);
-  if (color == -1) color = canvas.current_color;
+  mrb_value batch;
+  mrb_get_args(mrb, "S", &batch);
 
-  c_canvas_set_pixel(mrb, &canvas, x, y, color);
+  batch_reader_t r;
+  r.ptr = (const uint8_t*)RSTRING_PTR(batch);
+  r.end = r.ptr + RSTRING_LEN(batch);
 
-  return mrb_nil_value();
-}
+  // Scratch for decoded path and polygon points, sized for the largest.
+  mrb_int max_points = mrb_canvas_batch_check(mrb, r);
+  mrb_value scratch = mrb_str_new(mrb, NULL, sizeof(int) * 2 * max_points);
+  int* xs = (int*)RSTRING_PTR(scratch);
+  int* ys = xs + max_points;
 
-//
-// #_line
-//
-static void
-c_canvas_line(mrb_state* mrb, canvas_t* c, int x1, int y1, int x2, int y2, int color) {
-  // Deltas in each axis.
-  int dy = y2 - y1;
-  int dx = x2 - x1;
+  // Only read @current_color once, since it can't change during the batch.
+  mrb_int current_color = mrb_canvas_color(mrb, self, canvas, -1);
 
-  // Optimize vertical lines and avoid division by 0.
-  if (dx == 0) {
-    // Ensure y1 < y2.
-    if (y2 < y1) {
-      int t = y1;
-      y1 = y2;
-      y2 = t;
-    }
-    for(int y=y1; y<=y2; y++) {
-      c_canvas_set_pixel(mrb, c, x1, y, color);
-    }
-    return;
-  }
+  while (r.ptr < r.end) {
+    uint8_t opcode = batch_u8(&r);
+    int x1, y1, x2, y2, color;
+    mrb_bool filled;
+    int fill;
+    mrb_int count;
 
-  // Optimize horizontal lines.
-  if (dy == 0) {
-    // Ensure x1 < x2.
-    if (x2 < x1) {
-      int t = x1;
-      x1 = x2;
-      x2 = t;
-    }
-    for(int x=x1; x<=x2; x++) {
-      c_canvas_set_pixel(mrb, c, x, y1, color);
-    }
-    return;
-  }
+    switch (opcode) {
+      case BATCH_SET_PIXEL:
+        x1 = batch_s16(&r); y1 = batch_s16(&r);
+        color = batch_s32(&r);
+        c_canvas_set_pixel(mrb, canvas, x1, y1, (color == -1) ? current_color : color);
+        break;
 
-  // Bresenham's algorithm for sloped lines.
-  //
-  // Slope calculations
-  int dx_abs      = abs(dx);
-  int dy_abs      = abs(dy);
-  int step_axis   = (dx_abs > dy_abs) ? 0 : 1; // 0 = x, 1 = y
-  int step_count  = (step_axis == 0)  ? dx_abs : dy_abs;
-  int x_step      = (dx > 0) ? 1 : -1;
-  int y_step      = (dy > 0) ? 1 : -1;
+      case BATCH_LINE:
+        x1 = batch_s16(&r); y1 = batch_s16(&r); x2 = batch_s16(&r); y2 = batch_s16(&r);
+        color = batch_s32(&r);
+        c_canvas_stroke_line(mrb, canvas, x1, y1, x2, y2, (color == -1) ? current_color : color);
+        break;
 
-  // Error calculations
-  int error_step      = (step_axis == 0) ? dy_abs : dx_abs;
-  int error_threshold = (step_axis == 0) ? dx_abs : dy_abs;
+      case BATCH_RECTANGLE:
+      case BATCH_ELLIPSE:
+        x1 = batch_s16(&r); y1 = batch_s16(&r); x2 = batch_s16(&r); y2 = batch_s16(&r);
+        filled = batch_u8(&r);
+        color = batch_s32(&r);
+        if (color == -1) color = current_color;
+        if (opcode == BATCH_ELLIPSE) {
+          c_canvas_ellipse(mrb, canvas, x1, y1, x2, y2, filled, color);
+        } else {
+          c_canvas_rectangle(mrb, canvas, x1, y1, x2, y2, filled, color);
+        }
+        break;
 
-  int x = x1;
-  int y = y1;
-  int error = 0;
-  for (int i=0; i<=step_count; i++) {
-    c_canvas_set_pixel(mrb, c, x, y, color);
+      case BATCH_PATH:
+      case BATCH_POLYGON:
+        count = batch_u16(&r);
+        fill = (opcode == BATCH_POLYGON) ? batch_u8(&r) : POLYGON_STROKE;
+        color = batch_s32(&r);
+        if (color == -1) color = current_color;
+        for (mrb_int i=0; i<count; i++) {
+          xs[i] = batch_s16(&r);
+          ys[i] = batch_s16(&r);
+        }
+        if (opcode == BATCH_POLYGON) {
+          if ((fill != POLYGON_STROKE) && (fill != POLYGON_NONZERO)) fill = POLYGON_EVEN_ODD;
+          c_canvas_polygon(mrb, canvas, xs, ys, count, fill, color);
+        } else {
+          c_canvas_path(mrb, canvas, xs, ys, count, color);
+        }
+        break;
 
-    if (step_axis == 0) { // Step on x-axis
-      x += x_step;
-      error += error_step;
-      if (error >= error_threshold) {
-        y += y_step;
-        error -= error_threshold;
-      }
-    } else { // Step on y-axis
-      y += y_step;
-      error += error_step;
-      if (error >= error_threshold) {
-        x += x_step;
-        error -= error_threshold;
-      }
+      case BATCH_CHAR:
+        x1 = batch_s16(&r); y1 = batch_s16(&r);
+        x2 = batch_u8(&r);  y2 = batch_u8(&r); // width and scale
+        color = batch_s32(&r);
+        count = batch_u16(&r);
+        c_canvas_char(mrb, canvas, r.ptr, count, x1, y1, x2, y2, (color == -1) ? current_color : color);
+        r.ptr += count;
+        break;
     }
   }
+  STATS_END(canvas, STAT_DRAW_BATCH);
+  return mrb_nil_value();
 }
 
+//
+// #clip
+//
 static mrb_value
-mrb_canvas_line(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
+mrb_canvas_clip(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
 
   // Get args
-  mrb_int x1, y1, x2, y2;
-  mrb_int color = -1;
-  mrb_get_args(mrb, "iiii|i", &x1, &y1, &x2, &y2, &color);
-  if (color == -1) color = canvas.current_color;
-
-  c_canvas_line(mrb, &canvas, x1, y1, x2, y2, color);
+  mrb_int x1, y1, x2, y2, t;
+  mrb_get_args(mrb, "iiii", &x1, &y1, &x2, &y2);
+  if (x2 < x1) { t = x1; x1 = x2; x2 = t; }
+  if (y2 < y1) { t = y1; y1 = y2; y2 = t; }
 
+  canvas->user_clip    = TRUE;
+  canvas->user_clip_x1 = x1;
+  canvas->user_clip_y1 = y1;
+  canvas->user_clip_x2 = x2;
+  canvas->user_clip_y2 = y2;
+  c_canvas_update_clip(canvas);
   return mrb_nil_value();
 }
 
 //
-// #_rectangle
+// #unclip
 //
 static mrb_value
-mrb_canvas_rectangle(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
-
-  // Get args
-  mrb_int x1, y1, x2, y2;
-  mrb_bool filled = FALSE;
-  mrb_int color = -1;
-  mrb_get_args(mrb, "iiii|bi", &x1, &y1, &x2, &y2, &filled, &color);
-  if (color == -1) color = canvas.current_color;
-
-  // Rectangles and squares as a combination of lines.
-  if (filled) {
-    mrb_int yt;
-    if (y2 < y1) {
-      yt = y2;
-      y2 = y1;
-      y1 = yt;
-    }
-    for(int y=y1; y<=y2; y++) {
-      c_canvas_line(mrb, &canvas, x1, y, x2, y, color);
-    }
-  } else {
-    c_canvas_line(mrb, &canvas, x1, y1, x2, y1, color);
-    c_canvas_line(mrb, &canvas, x2, y1, x2, y2, color);
-    c_canvas_line(mrb, &canvas, x2, y2, x1, y2, color);
-    c_canvas_line(mrb, &canvas, x1, y2, x1, y1, color);
-  }
+mrb_canvas_unclip(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
 
+  canvas->user_clip = FALSE;
+  c_canvas_update_clip(canvas);
   return mrb_nil_value();
 }
 
 //
-// #_path
+// #dirty_regions
 //
-static void
-c_canvas_path(mrb_state* mrb, canvas_t* c, mrb_value mrb_points, int color) {
-  mrb_int point_count = RARRAY_LEN(mrb_points);
-  if (point_count == 0) return;
-
-  mrb_int x1;
-  mrb_int y1;
-  mrb_value point = mrb_ary_entry(mrb_points, 0);
-  mrb_int x2 = mrb_as_int(mrb, mrb_ary_entry(point, 0));
-  mrb_int y2 = mrb_as_int(mrb, mrb_ary_entry(point, 1));
+static mrb_value
+mrb_canvas_dirty_regions(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
 
-  for (int i=1; i<point_count; i++) {
-    x1 = x2;
-    y1 = y2;
-    point = mrb_ary_entry(mrb_points, i);
-    x2 = mrb_as_int(mrb, mrb_ary_entry(point, 0));
-    y2 = mrb_as_int(mrb, mrb_ary_entry(point, 1));
-    c_canvas_line(mrb, c, x1, y1, x2, y2, color);
+  // One [page, x_min, x_max] entry for each page with changed bytes.
+  mrb_value regions = mrb_ary_new(mrb);
+  for(int page=0; page < canvas->dirty_pages; page++) {
+    if (canvas->dirty_min[page] > canvas->dirty_max[page]) continue;
+    mrb_value region = mrb_ary_new_capa(mrb, 3);
+    mrb_ary_push(mrb, region, mrb_fixnum_value(page));
+    mrb_ary_push(mrb, region, mrb_fixnum_value(canvas->dirty_min[page]));
+    mrb_ary_push(mrb, region, mrb_fixnum_value(canvas->dirty_max[page]));
+    mrb_ary_push(mrb, regions, region);
   }
+  return regions;
 }
 
+//
+// #clear_dirty
+//
 static mrb_value
-mrb_canvas_path(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
-
-  // Get args
-  mrb_value mrb_points;
-  mrb_int color = -1;
-  mrb_get_args(mrb, "A|i", &mrb_points, &color);
-  if (color == -1) color = canvas.current_color;
+mrb_canvas_clear_dirty(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
 
-  c_canvas_path(mrb, &canvas, mrb_points, color);
+  c_canvas_dirty_reset(canvas);
   return mrb_nil_value();
 }
 
 //
-// #_polygon
+// #diff_and_commit
 //
-static void
-c_canvas_polygon(mrb_state* mrb, canvas_t* c, mrb_value mrb_points, mrb_bool filled, int color) {
-  mrb_int point_count = RARRAY_LEN(mrb_points);
-  if (point_count == 0) return;
+// Find the first and last bytes that differ between a and b, comparing 8 bytes at a time from each end.
+// Returns FALSE if they're the same.
+static mrb_bool
+c_diff_span(const uint8_t* a, const uint8_t* b, mrb_int length, mrb_int* first, mrb_int* last) {
+  uint64_t word_a, word_b;
 
-  if (filled) {
-    // y_min and y_max both start as the first point's y value.
-    mrb_value point = mrb_ary_entry(mrb_points, 0);
-    mrb_int y_min = mrb_as_int(mrb, mrb_ary_entry(point, 1));
-    mrb_int y_max = mrb_as_int(mrb, mrb_ary_entry(point, 1));
+  mrb_int start = 0;
+  while (start + 8 <= length) {
+    memcpy(&word_a, a + start, 8);
+    memcpy(&word_b, b + start, 8);
+    if (word_a != word_b) break;
+    start += 8;
+  }
+  while (start < length && a[start] == b[start]) start++;
+  if (start == length) return FALSE;
 
-    // Separate x and y coords into float arrays, and also find true y_min and y_max.
-    float coords_x[point_count];
-    float coords_y[point_count];
+  // Byte at start differs, so the backward scan always stops after it.
+  mrb_int end = length;
+  while (end - 8 > start) {
+    memcpy(&word_a, a + end - 8, 8);
+    memcpy(&word_b, b + end - 8, 8);
+    if (word_a != word_b) break;
+    end -= 8;
+  }
+  while (a[end-1] == b[end-1]) end--;
 
-    for (int i=0; i<point_count; i++) {
-      point = mrb_ary_entry(mrb_points, i);
-      int x = mrb_as_int(mrb, mrb_ary_entry(point, 0));
-      int y = mrb_as_int(mrb, mrb_ary_entry(point, 1));
-
-      coords_x[i] = x;
-      coords_y[i] = y;
-
-      if (y < y_min) y_min = y;
-      if (y > y_max) y_max = y;
-    }
-
-    // Cast horizontal ray on each row, storing nodes where it intersects polygon edges.
-    for (int y=y_min; y <= y_max; y++) {
-      // Maximum possible intersections
-      int nodes[point_count*2];
-      int node_count = 0;
-      int i = 0;
-      int j = point_count - 1;
-
-      while (i < point_count) {
-        // First condition excludes horizontal edges.
-        // Second and third check for +ve and -ve intersection respectively.
-        if (coords_y[i] != coords_y[j] && ((coords_y[i] < y && coords_y[j] >= y) || (coords_y[j] < y && coords_y[i] >= y))) {
-          // Interoplate to find the intersection point (node).
-          float x_intersect = coords_x[i] + (float)(y - coords_y[i]) / (coords_y[j] - coords_y[i]) * (coords_x[j] - coords_x[i]);
-          nodes[node_count++] = (int)(x_intersect + 0.5f);
-        }
-        j = i;
-        i++;
-      }
-
-      // Sort the nodes.
-      for (int a=0; a < node_count-1; a++) {
-        for (int b=0; b < node_count-a-1; b++) {
-          if (nodes[b] > nodes[b+1]) {
-            int temp = nodes[b];
-            nodes[b] = nodes[b+1];
-            nodes[b+1] = temp;
-          }
-        }
-      }
+  *first = start;
+  *last  = end - 1;
+  return TRUE;
+}
 
-      // Take pairs of nodes and fill between them.
-      // This ignores the spaces between odd then even nodes (eg. 1->2), which are outside the polygon.
-      for (int n=0; n < node_count-1; n += 2) {
-        if (n+1 < node_count) {
-          c_canvas_line(mrb, c, nodes[n], y, nodes[n+1], y, color);
-        }
-      }
+// Compare one 8 row page of every plane with the shadow, copying changed bytes into it.
+// Widens x_min..x_max to cover the changed columns.
+static void
+c_canvas_diff_page(canvas_t* c, mrb_int page, mrb_int* x_min, mrb_int* x_max) {
+  mrb_int first, last;
+
+  for(int i=0; i < c->plane_count; i++) {
+    uint8_t* fb     = c->planes[i];
+    uint8_t* shadow = c->shadow + (i * c->plane_size);
+
+    // :page and :page_interleaved keep a whole page in one run of bytes, the same number for each column.
+    if (c->format == PIXEL_FORMAT_PAGE || c->format == PIXEL_FORMAT_PAGE_INTERLEAVED) {
+      mrb_int stride = c->plane_size / c->pages;
+      mrb_int offset = page * stride;
+      if (!c_diff_span(fb + offset, shadow + offset, stride, &first, &last)) continue;
+      memcpy(shadow + offset + first, fb + offset + first, last - first + 1);
+
+      mrb_int x1 = (first * c->columns) / stride;
+      mrb_int x2 = (last  * c->columns) / stride;
+      if (x1 < *x_min) *x_min = x1;
+      if (x2 > *x_max) *x_max = x2;
+      continue;
     }
-  }
 
-  // Stroke regardless, since floating point math misses thin areas of fill.
-  // Use _path to stroke without connecting last back to first.
-  c_canvas_path(mrb, c, mrb_points, color);
+    // Other formats have one run per row. Map changed bytes back to the columns they hold.
+    mrb_int stride = ((c->columns * c->format->bits) + 7) / 8;
+    mrb_int y_last = (page*8 + 7 < c->rows) ? page*8 + 7 : c->rows - 1;
+    for(mrb_int y = page*8; y <= y_last; y++) {
+      mrb_int offset = y * stride;
+      if (!c_diff_span(fb + offset, shadow + offset, stride, &first, &last)) continue;
+      memcpy(shadow + offset + first, fb + offset + first, last - first + 1);
 
-  // Connect last to first. NOTE: order is important here.
-  mrb_value first = mrb_ary_entry(mrb_points, 0);
-  mrb_value last  = mrb_ary_entry(mrb_points, point_count-1);
-  int x1 = mrb_as_int(mrb, mrb_ary_entry(last, 0));
-  int y1 = mrb_as_int(mrb, mrb_ary_entry(last, 1));
-  int x2 = mrb_as_int(mrb, mrb_ary_entry(first, 0));
-  int y2 = mrb_as_int(mrb, mrb_ary_entry(first, 1));
-  c_canvas_line(mrb, c, x1, y1, x2, y2, color);
+      mrb_int x1 = (first * 8) / c->format->bits;
+      mrb_int x2 = (((last + 1) * 8) - 1) / c->format->bits;
+      if (x2 > c->columns - 1) x2 = c->columns - 1;
+      if (x1 < *x_min) *x_min = x1;
+      if (x2 > *x_max) *x_max = x2;
+    }
+  }
 }
 
+// Compare the framebuffers with what they held at the last call, and make them the new reference.
+// Returns [page, x_min, x_max] for each 8 row page that differs, in physical coordinates, like #dirty_regions.
 static mrb_value
-mrb_canvas_polygon(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
+mrb_canvas_diff_and_commit(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
 
-  // Get args
-  mrb_value mrb_points;
-  mrb_bool filled = FALSE;
-  mrb_int color = -1;
-  mrb_get_args(mrb, "A|bi", &mrb_points, &filled, &color);
-  if (color == -1) color = canvas.current_color;
+  // First call, or the layout changed. Everything differs from what the display has.
+  mrb_int size = canvas->plane_count * canvas->plane_size;
+  mrb_bool full = (canvas->shadow == NULL || canvas->shadow_size != size || canvas->shadow_format != canvas->format ||
+                   canvas->shadow_columns != canvas->columns || canvas->shadow_rows != canvas->rows);
+  if (full) {
+    canvas->shadow         = (uint8_t*)mrb_realloc(mrb, canvas->shadow, (size > 0) ? size : 1);
+    canvas->shadow_size    = size;
+    canvas->shadow_format  = canvas->format;
+    canvas->shadow_columns = canvas->columns;
+    canvas->shadow_rows    = canvas->rows;
+    for(int i=0; i < canvas->plane_count; i++) {
+      memcpy(canvas->shadow + (i * canvas->plane_size), canvas->planes[i], canvas->plane_size);
+    }
+  }
 
-  c_canvas_polygon(mrb, &canvas, mrb_points, filled, color);
-  return mrb_nil_value();
+  mrb_value regions = mrb_ary_new(mrb);
+  for(mrb_int page=0; page < canvas->pages; page++) {
+    mrb_int x_min = canvas->columns;
+    mrb_int x_max = -1;
+    if (full) {
+      x_min = 0;
+      x_max = canvas->columns - 1;
+    } else {
+      c_canvas_diff_page(canvas, page, &x_min, &x_max);
+    }
+    if (x_min > x_max) continue;
+
+    mrb_value region = mrb_ary_new_capa(mrb, 3);
+    mrb_ary_push(mrb, region, mrb_fixnum_value(page));
+    mrb_ary_push(mrb, region, mrb_fixnum_value(x_min));
+    mrb_ary_push(mrb, region, mrb_fixnum_value(x_max));
+    mrb_ary_push(mrb, regions, region);
+  }
+  return regions;
 }
 
 //
-// #_ellipse
+// #swap_buffers
 //
-static void
-c_canvas_ellipse(mrb_state* mrb, canvas_t* c, int x_center, int y_center, int a, int b, mrb_bool filled, int color) {
-  // Start position
-  int x = -a;
-  int y = 0;
+// A cleared set of framebuffer Strings, the same size as the ones being drawn into.
+static mrb_value
+mrb_canvas_new_framebuffers(mrb_state* mrb, canvas_t* canvas) {
+  mrb_value framebuffers = mrb_ary_new_capa(mrb, canvas->plane_count);
+  for(int i=0; i < canvas->plane_count; i++) {
+    mrb_value fb = mrb_str_new(mrb, NULL, canvas->plane_size);
+    memset(RSTRING_PTR(fb), 0, canvas->plane_size);
+    mrb_ary_push(mrb, framebuffers, fb);
+  }
+  return framebuffers;
+}
 
-  // Precompute x and y increments for each step
-  int x_increment = 2 * b * b;
-  int y_increment = 2 * a * a;
+// Check the front set still fits the canvas. Size or @pixel_format may have changed since it was made.
+static mrb_bool
+mrb_canvas_framebuffers_fit(mrb_state* mrb, canvas_t* canvas, mrb_value framebuffers) {
+  if (!mrb_array_p(framebuffers) || RARRAY_LEN(framebuffers) < canvas->plane_count) return FALSE;
+  for(int i=0; i < canvas->plane_count; i++) {
+    mrb_value fb = mrb_ary_ref(mrb, framebuffers, i);
+    if (!mrb_string_p(fb) || RSTRING_LEN(fb) < canvas->plane_size) return FALSE;
+  }
+  return TRUE;
+}
 
-  // Start errors
-  int dx = (1 + (2 * x)) * b * b;
-  int dy = x * x;
-  int e1 = dx + dy;
-  int e2 = dx;
+// Exchange @framebuffers with @front_framebuffers, so drawing continues in one set while a driver sends the other.
+// Only references are swapped, never contents. Returns the new front set.
+static mrb_value
+mrb_canvas_swap_buffers(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
+  mrb_sym sym_front = mrb_intern_lit(mrb, "@front_framebuffers");
 
-  // Since starting at max negative X, continue until x is 0
-  while (x <= 0) {
-    if (filled) {
-      // Fill quadrants using horizontal lines
-      c_canvas_line(mrb, c, x_center - x, y_center + y, x_center + x, y_center + y, color);
-      c_canvas_line(mrb, c, x_center - x, y_center - y, x_center + x, y_center - y, color);
-    } else {
-      // Stroke quadrants in order, as if y-axis is reversed and going counter-clockwise from +ve X.
-      c_canvas_set_pixel(mrb, c, x_center - x, y_center - y, color);
-      c_canvas_set_pixel(mrb, c, x_center + x, y_center - y, color);
-      c_canvas_set_pixel(mrb, c, x_center + x, y_center + y, color);
-      c_canvas_set_pixel(mrb, c, x_center - x, y_center + y, color);
-    }
+  // The second set is made on the first swap, and again if the canvas outgrows it.
+  mrb_value front = mrb_iv_get(mrb, self, sym_front);
+  mrb_bool remade = !mrb_canvas_framebuffers_fit(mrb, canvas, front);
+  if (remade) front = mrb_canvas_new_framebuffers(mrb, canvas);
 
-    e2 = 2 * e1;
-    if (e2 >= dx) {
-      x += 1;
-      dx += x_increment;
-      e1 += dx;
-    }
-    if (e2 <= dy) {
-      y  += 1;
-      dy += y_increment;
-      e1 += dy;
+  // Unshare every String before touching the cache, in case one raises.
+  for(int i=0; i < canvas->plane_count; i++) {
+    mrb_str_modify(mrb, RSTRING(mrb_ary_ref(mrb, front, i)));
+  }
+
+  // A new set, or one from before the layout changed, has no state of its own yet. All of it differs from the display.
+  canvas_front_t* f = &canvas->front;
+  if (remade || f->dirty_pages != canvas->dirty_pages) {
+    mrb_int size = sizeof(mrb_int) * (canvas->dirty_pages > 0 ? canvas->dirty_pages : 1);
+    f->dirty_min     = (mrb_int*)mrb_realloc(mrb, f->dirty_min, size);
+    f->dirty_max     = (mrb_int*)mrb_realloc(mrb, f->dirty_max, size);
+    f->dirty_pages   = canvas->dirty_pages;
+    f->shadow_format = NULL;
+    for(int page=0; page < f->dirty_pages; page++) {
+      f->dirty_min[page] = 0;
+      f->dirty_max[page] = canvas->columns - 1;
     }
   }
 
-  // Continue if y hasn't reached the vertical size
-  while (y < b) {
-    y += 1;
-    c_canvas_set_pixel(mrb, c, x_center, y_center + y, color);
-    c_canvas_set_pixel(mrb, c, x_center, y_center - y, color);
+  // Each set keeps its own dirty regions and #diff_and_commit copy, so they swap with it.
+  canvas_front_t back_state = {
+    canvas->dirty_min, canvas->dirty_max, canvas->dirty_pages, canvas->shadow,
+    canvas->shadow_size, canvas->shadow_columns, canvas->shadow_rows, canvas->shadow_format
+  };
+  canvas->dirty_min      = f->dirty_min;
+  canvas->dirty_max      = f->dirty_max;
+  canvas->shadow         = f->shadow;
+  canvas->shadow_size    = f->shadow_size;
+  canvas->shadow_columns = f->shadow_columns;
+  canvas->shadow_rows    = f->shadow_rows;
+  canvas->shadow_format  = f->shadow_format;
+  *f = back_state;
+
+  // Point the cache straight at the new back set, so swapping doesn't reload it.
+  mrb_value back = canvas->framebuffers;
+  for(int i=0; i < canvas->plane_count; i++) {
+    canvas->planes[i] = (uint8_t*)RSTRING_PTR(mrb_ary_ref(mrb, front, i));
   }
+  canvas->framebuffers = front;
+  mrb_iv_set(mrb, self, canvas->sym_framebuffers, front);
+  mrb_iv_set(mrb, self, sym_front, back);
+  return back;
 }
 
+//
+// #front_framebuffers
+//
+// The set last swapped out by #swap_buffers, for the display driver to send. nil before the first swap.
 static mrb_value
-mrb_canvas_ellipse(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
-
-  // Get args
-  mrb_int x_center, y_center, a, b;
-  mrb_bool filled = FALSE;
-  mrb_int color = -1;
-  mrb_get_args(mrb, "iiii|bi", &x_center, &y_center, &a, &b, &filled, &color);
-  if (color == -1) color = canvas.current_color;
-
-  c_canvas_ellipse(mrb, &canvas, x_center, y_center, a, b, filled, color);
-
-  return mrb_nil_value();
+mrb_canvas_front_framebuffers(mrb_state* mrb, mrb_value self) {
+  return mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@front_framebuffers"));
 }
 
+#ifdef FASTCANVAS_STATS
 //
-// #_char
+// #fastcanvas_stats
 //
-static void
-c_canvas_char(mrb_state* mrb, canvas_t* c, mrb_value char_bytes, int x, int y, int width, int scale, int color) {
-  // How many total bytes
-  mrb_int byte_count = RARRAY_LEN(char_bytes);
-
-  // How many vertical chunks. Split by displayed font width, allowing partial last.
-  int chunks = byte_count / width;
-  if (byte_count % width > 0) chunks += 1;
-  int y_current = y;
+// Hash of method name => { calls:, pixels:, usec: }, for methods called since the last reset.
+static mrb_value
+mrb_canvas_fastcanvas_stats(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
 
-  for (int chunk=0; chunk<chunks; chunk++) {
-    for (int column=0; column<width; column++) {
-      // Which byte
-      int index = chunk*width + column;
-      if (index >= byte_count) continue;
+  mrb_value stats = mrb_hash_new(mrb);
+  for (int i=0; i<STAT_COUNT; i++) {
+    canvas_stat_t* stat = &canvas->stats[i];
+    if (stat->calls == 0) continue;
 
-      // Get it and show the pixels.
-      uint8_t bite = (uint8_t)mrb_as_int(mrb, mrb_ary_entry(char_bytes, index));
-      for (int bit=0; bit < 8; bit++) {
-        // Don't do anything if this bit isn't set in the font.
-        if (((bite >> bit) & 0b1)) {
-          for (int sx=0; sx<scale; sx++){
-            for(int sy=0; sy<scale; sy++){
-              c_canvas_set_pixel(
-                mrb,
-                c,
-                x + (column*scale) + sx,
-                y_current + (bit*scale) + sy,
-                color
-              );
-            }
-          }
-        }
-      }
-    }
-    y_current += (8 * scale);
+    mrb_value entry = mrb_hash_new(mrb);
+    mrb_hash_set(mrb, entry, mrb_symbol_value(mrb_intern_lit(mrb, "calls")),  mrb_fixnum_value((mrb_int)stat->calls));
+    mrb_hash_set(mrb, entry, mrb_symbol_value(mrb_intern_lit(mrb, "pixels")), mrb_fixnum_value((mrb_int)stat->pixels));
+    mrb_hash_set(mrb, entry, mrb_symbol_value(mrb_intern_lit(mrb, "usec")),   mrb_fixnum_value((mrb_int)(stat->nsec / 1000)));
+    mrb_hash_set(mrb, stats, mrb_symbol_value(mrb_intern_cstr(mrb, c_stat_names[i])), entry);
   }
+  return stats;
 }
 
+//
+// #reset_fastcanvas_stats
+//
 static mrb_value
-mrb_canvas_char(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
-
-  // Get args
-  mrb_value char_bytes;
-  mrb_int x, y, width, scale;
-  mrb_int color = -1;
-  mrb_get_args(mrb, "Aiiii|i", &char_bytes, &x, &y, &width, &scale, &color);
-  if (color == -1) color = canvas.current_color;
+mrb_canvas_reset_fastcanvas_stats(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
 
-  c_canvas_char(mrb, &canvas, char_bytes, x, y, width, scale, color);
+  memset(canvas->stats, 0, sizeof(canvas->stats));
   return mrb_nil_value();
 }
+#endif
 
 //
-// #text
+// #framebuffer_size
 //
+// Bytes each framebuffer String needs for @pixel_format. Doesn't use the cache, so it works before they exist.
 static mrb_value
-mrb_canvas_text(mrb_state* mrb, mrb_value self) {
-  // Get canvas ivars
-  canvas_t canvas;
-  mrb_get_canvas_data(mrb, self, &canvas);
+mrb_canvas_framebuffer_size(mrb_state* mrb, mrb_value self) {
+  const pixel_format_t* format = mrb_canvas_pixel_format(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@pixel_format")));
+  mrb_int columns = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@columns")));
+  mrb_int rows    = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@rows")));
+  mrb_int colors  = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@colors")));
+  return mrb_fixnum_value(format->buffer_size(columns, rows, colors));
+}
+
+//
+// #framebuffer_plane
+//
+// One color's 1bpp plane, for drivers that send each color separately. Planar formats already have a
+// framebuffer per color, so that String itself is returned, not a copy. For :page_interleaved, the plane is
+// copied out in :page layout, into the String given if any, so drivers can reuse one buffer every frame.
+static mrb_value
+mrb_canvas_framebuffer_plane(mrb_state* mrb, mrb_value self) {
+  // Get cached canvas state
+  canvas_t* canvas = mrb_get_canvas_data(mrb, self);
 
   // Get args
-  mrb_value str;
-  mrb_value kwargs = mrb_nil_value();
-  mrb_int color = -1;
-  mrb_get_args(mrb, "S|H", &str, &kwargs);
+  mrb_int color;
+  mrb_value into = mrb_nil_value();
+  mrb_get_args(mrb, "i|S!", &color, &into);
 
-  // Get color kwarg if given
-  if (!mrb_nil_p(kwargs)) {
-    mrb_value color_val = mrb_hash_get(mrb, kwargs, mrb_symbol_value(mrb_intern_lit(mrb, "color")));
-    if (!mrb_nil_p(color_val)) color = mrb_fixnum(color_val);
+  if (!canvas->format->planar && canvas->format != PIXEL_FORMAT_PAGE_INTERLEAVED) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "pixel format has no color planes");
   }
-  if (color == -1) color = canvas.current_color;
-
-  // Font ivars
-  mrb_value font_characters   = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_characters"));
-  mrb_int font_last_character = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_last_character")));
-  mrb_int font_height         = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_height")));
-  mrb_int font_scale          = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_scale")));
-  mrb_int font_width          = mrb_fixnum(mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@font_width")));
-  mrb_value text_cursor       = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@text_cursor"));
-
-  // String vars
-  const char* str_ptr = mrb_string_cstr(mrb, str);
-  mrb_int str_len = RSTRING_LEN(str);
-
-  // Offset by scaled height, since bottom left of char starts at text cursor.
-  mrb_int x = mrb_fixnum(mrb_ary_ref(mrb, text_cursor, 0));
-  mrb_int y = mrb_fixnum(mrb_ary_ref(mrb, text_cursor, 1)) + 1 - (font_height * font_scale);
+  if ((color < 1) || (color > canvas->colors)) mrb_raise(mrb, E_ARGUMENT_ERROR, "color out of range");
+  if (canvas->format->planar) return mrb_ary_ref(mrb, canvas->framebuffers, color - 1);
 
-  // Each char of string
-  for (mrb_int i = 0; i < str_len; i++) {
-    unsigned char ch = (unsigned char)str_ptr[i];
-
-    // 0th character in font is SPACE. Offset ASCII code and show ? if character doesn't exist in font.
-    mrb_int index = ch - 32;
-    if (index < 0 || index > font_last_character) index = 31;
-    mrb_value char_map = mrb_ary_ref(mrb, font_characters, index);
-
-    // Draw it
-    c_canvas_char(mrb, &canvas, char_map, x, y, font_width, font_scale, color);
-
-    // Increment x, scaling width.
-    x += font_width * font_scale;
+  mrb_int size     = canvas->plane_size / canvas->colors;
+  mrb_value plane  = into;
+  if (mrb_nil_p(plane)) {
+    plane = mrb_str_new(mrb, NULL, size);
+  } else {
+    // Resizing the framebuffer itself would move the pixels being copied.
+    if (mrb_obj_equal(mrb, plane, mrb_ary_ref(mrb, canvas->framebuffers, 0))) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "can't copy a plane into the framebuffer");
+    }
+    mrb_str_modify(mrb, RSTRING(plane));
+    mrb_str_resize(mrb, plane, size);
   }
-
-  // Update x value of @text_cursor ivar.
-  mrb_ary_set(mrb, text_cursor, 0, mrb_fixnum_value(x));
-  return mrb_nil_value();
+  uint8_t* src     = canvas->planes[0] + (color - 1);
+  uint8_t* dst     = (uint8_t*)RSTRING_PTR(plane);
+  for(mrb_int n=0; n < size; n++) {
+    dst[n] = src[n * canvas->colors];
+  }
+  return plane;
 }
 
 void
@@ -653,11 +4173,74 @@ mrb_mruby_denko_fastcanvas_gem_init(mrb_state* mrb) {
   mrb_define_method(mrb, mrb_Canvas, "_set_pixel",  mrb_canvas_set_pixel,    MRB_ARGS_REQ(2) | MRB_ARGS_OPT(1));
   mrb_define_method(mrb, mrb_Canvas, "_line",       mrb_canvas_line,         MRB_ARGS_REQ(4) | MRB_ARGS_OPT(1));
   mrb_define_method(mrb, mrb_Canvas, "_rectangle",  mrb_canvas_rectangle,    MRB_ARGS_REQ(4) | MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, mrb_Canvas, "clear_rect",  mrb_canvas_clear_rect,   MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, mrb_Canvas, "fill_rect",   mrb_canvas_fill_rect,    MRB_ARGS_REQ(4) | MRB_ARGS_OPT(1));
   mrb_define_method(mrb, mrb_Canvas, "_path",       mrb_canvas_path,         MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
   mrb_define_method(mrb, mrb_Canvas, "_polygon",    mrb_canvas_polygon,      MRB_ARGS_REQ(1) | MRB_ARGS_OPT(2));
   mrb_define_method(mrb, mrb_Canvas, "_ellipse",    mrb_canvas_ellipse,      MRB_ARGS_REQ(4) | MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, mrb_Canvas, "_arc",        mrb_canvas_arc,          MRB_ARGS_REQ(6) | MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, mrb_Canvas, "_pie",        mrb_canvas_pie,          MRB_ARGS_REQ(6) | MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, mrb_Canvas, "_rounded_rectangle", mrb_canvas_rounded_rectangle, MRB_ARGS_REQ(5) | MRB_ARGS_OPT(2));
   mrb_define_method(mrb, mrb_Canvas, "_char",       mrb_canvas_char,         MRB_ARGS_REQ(5) | MRB_ARGS_OPT(1));
   mrb_define_method(mrb, mrb_Canvas, "text",        mrb_canvas_text,         MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, mrb_Canvas, "text_width",  mrb_canvas_text_width,   MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, mrb_Canvas, "text_box",    mrb_canvas_text_box,     MRB_ARGS_REQ(5) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, mrb_Canvas, "_bitmap",     mrb_canvas_bitmap,       MRB_ARGS_REQ(5) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, mrb_Canvas, "_flood_fill", mrb_canvas_flood_fill,   MRB_ARGS_REQ(2) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, mrb_Canvas, "_dither_image", mrb_canvas_dither_image, MRB_ARGS_REQ(5) | MRB_ARGS_OPT(1));
+
+  // Moving what's already drawn
+  mrb_define_method(mrb, mrb_Canvas, "move_region", mrb_canvas_move_region,  MRB_ARGS_REQ(6));
+  mrb_define_method(mrb, mrb_Canvas, "scroll",      mrb_canvas_scroll,       MRB_ARGS_REQ(2) | MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, mrb_Canvas, "composite",   mrb_canvas_composite,    MRB_ARGS_REQ(3) | MRB_ARGS_OPT(1));
+
+  // Reusable point list for _path and _polygon
+  struct RClass *mrb_PointBuffer = mrb_define_class_under(mrb, mrb_Canvas, "PointBuffer", mrb->object_class);
+  mrb_define_method(mrb, mrb_PointBuffer, "initialize", mrb_point_buffer_initialize, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb_PointBuffer, "push",  mrb_point_buffer_push,  MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, mrb_PointBuffer, "clear", mrb_point_buffer_clear, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb_PointBuffer, "size",  mrb_point_buffer_size,  MRB_ARGS_NONE());
+
+  // Many primitives in one call, from a packed String of commands
+  mrb_define_method(mrb, mrb_Canvas, "draw_batch",  mrb_canvas_draw_batch,   MRB_ARGS_REQ(1));
+  mrb_define_const(mrb, mrb_Canvas, "BATCH_SET_PIXEL", mrb_fixnum_value(BATCH_SET_PIXEL));
+  mrb_define_const(mrb, mrb_Canvas, "BATCH_LINE",      mrb_fixnum_value(BATCH_LINE));
+  mrb_define_const(mrb, mrb_Canvas, "BATCH_RECTANGLE", mrb_fixnum_value(BATCH_RECTANGLE));
+  mrb_define_const(mrb, mrb_Canvas, "BATCH_ELLIPSE",   mrb_fixnum_value(BATCH_ELLIPSE));
+  mrb_define_const(mrb, mrb_Canvas, "BATCH_PATH",      mrb_fixnum_value(BATCH_PATH));
+  mrb_define_const(mrb, mrb_Canvas, "BATCH_POLYGON",   mrb_fixnum_value(BATCH_POLYGON));
+  mrb_define_const(mrb, mrb_Canvas, "BATCH_CHAR",      mrb_fixnum_value(BATCH_CHAR));
+
+  // Writers for cached state, which make the next call reload it
+
+  // Clip rectangle respected by every primitive
+  mrb_define_method(mrb, mrb_Canvas, "clip",        mrb_canvas_clip,         MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, mrb_Canvas, "unclip",      mrb_canvas_unclip,       MRB_ARGS_NONE());
+
+  // Width of outlines drawn by the primitives above
+  mrb_define_method(mrb, mrb_Canvas, "stroke_width=", mrb_canvas_set_stroke_width, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, mrb_Canvas, "stroke_width",  mrb_canvas_stroke_width,     MRB_ARGS_NONE());
+
+  // Dirty region tracking for partial display updates
+  mrb_define_method(mrb, mrb_Canvas, "dirty_regions", mrb_canvas_dirty_regions, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb_Canvas, "clear_dirty",   mrb_canvas_clear_dirty,   MRB_ARGS_NONE());
+
+  // Frame diffing against the last frame sent to the display
+  mrb_define_method(mrb, mrb_Canvas, "diff_and_commit", mrb_canvas_diff_and_commit, MRB_ARGS_NONE());
+
+  // Double buffering
+  mrb_define_method(mrb, mrb_Canvas, "swap_buffers",       mrb_canvas_swap_buffers,       MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb_Canvas, "front_framebuffers", mrb_canvas_front_framebuffers, MRB_ARGS_NONE());
+
+  // Pixel formats
+  mrb_define_method(mrb, mrb_Canvas, "framebuffer_size", mrb_canvas_framebuffer_size, MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb_Canvas, "framebuffer_plane", mrb_canvas_framebuffer_plane, MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+
+#ifdef FASTCANVAS_STATS
+  // Per-method performance counters
+  mrb_define_method(mrb, mrb_Canvas, "fastcanvas_stats",       mrb_canvas_fastcanvas_stats,       MRB_ARGS_NONE());
+  mrb_define_method(mrb, mrb_Canvas, "reset_fastcanvas_stats", mrb_canvas_reset_fastcanvas_stats, MRB_ARGS_NONE());
+#endif
 }
 
 void
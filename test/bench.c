@@ -0,0 +1,92 @@
+//
+// Drawing speed in each orientation, for the gem and for the baseline it
+// replaced. Built by `make -C test bench` at -O2, without sanitizers or
+// performance counters.
+//
+// Workload, on a 128x64 single color canvas:
+//   _line       200 random lines across the screen, each call
+//   _path       4000 random points zig-zagging the width of the screen
+//   _ellipse    a 28x25 outline near the middle
+//   _rectangle  a filled 100x50 rectangle
+//   text        "Hello, world!" in the 6x8 font at scale 1
+//
+// Pixels per second counts the set bits one call leaves on a clear canvas,
+// so it undercounts pixels drawn twice.
+//
+#include "harness.h"
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+  const char* name;
+  int reps;
+} workload;
+
+static const workload workloads[] = {
+  {"_line", 20000}, {"_path", 200}, {"_ellipse", 20000}, {"_rectangle", 20000}, {"text", 20000},
+};
+#define WORKLOADS (int)(sizeof workloads / sizeof workloads[0])
+
+static mrb_value lines[200][5], path_points[2];
+
+static void prepare(canvas* c) {
+  seed(1);
+  for (int i = 0; i < 200; i++) {
+    lines[i][0] = I(rnd(0, c->x_max)); lines[i][1] = I(rnd(0, c->y_max));
+    lines[i][2] = I(rnd(0, c->x_max)); lines[i][3] = I(rnd(0, c->y_max));
+    lines[i][4] = I(1);
+  }
+  static int xs[4000], ys[4000];
+  for (int i = 0; i < 4000; i++) { xs[i] = rnd(0, c->x_max); ys[i] = rnd(0, c->y_max); }
+  path_points[0] = points(c->mrb, xs, ys, 4000);
+  path_points[1] = I(1);
+}
+
+static void run(canvas* c, int w, int rep) {
+  mrb_state* mrb = c->mrb;
+  switch (w) {
+  case 0: stub_call(mrb, c->obj, "_line", 5, lines[rep % 200]); break;
+  case 1: stub_call(mrb, c->obj, "_path", 2, path_points); break;
+  case 2: call(mrb, c->obj, "_ellipse", 6, I(c->x_max / 2), I(c->y_max / 2), I(28), I(25), mrb_false_value(), I(1)); break;
+  case 3: call(mrb, c->obj, "_rectangle", 6, I(10), I(6), I(c->x_max - 10), I(c->y_max - 6), mrb_true_value(), I(1)); break;
+  case 4: {
+    mrb_value cursor = iv(mrb, c->obj, "@text_cursor");
+    mrb_ary_set(mrb, cursor, 0, I(3));
+    mrb_ary_set(mrb, cursor, 1, I(20));
+    call(mrb, c->obj, "text", 1, str(mrb, "Hello, world!"));
+    break;
+  }
+  }
+}
+
+int main(void) {
+  ref_gem_init(REF);
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+  printf("%-11s %-4s %14s %14s %14s %9s\n", "method", "o", "baseline op/s", "gem op/s", "gem Mpx/s", "speedup");
+
+  for (int w = 0; w < WORKLOADS; w++) for (int o = 0; o < 8; o++) {
+    double ops[2];
+    long pixels = 0;
+    for (int q = 0; q < 2; q++) {
+      canvas c = new_canvas(q ? GEM : REF, 128, 64, 1, o);
+      prepare(&c);
+      pixels = 0;
+      for (int rep = 0; rep < 200; rep++) {
+        call(c.mrb, c.obj, "clear", 0);
+        run(&c, w, rep);
+        pixels += set_bits(&c);
+      }
+      int reps = workloads[w].reps;
+      double t0 = now();
+      for (int rep = 0; rep < reps; rep++) run(&c, w, rep);
+      ops[q] = reps / (now() - t0);
+    }
+    printf("%-11s %-4d %14.0f %14.0f %14.1f %8.1fx\n", workloads[w].name, o, ops[0], ops[1], ops[1] * pixels / 200 / 1e6, ops[1] / ops[0]);
+  }
+  return 0;
+}
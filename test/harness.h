@@ -0,0 +1,242 @@
+//
+// Shared helpers for the C test programs.
+//
+// Each program links the gem against a small stand-in for the mruby runtime
+// (support/), and most also link the original, pure pixel-at-a-time version
+// of the gem (reference/) under a different init name. Canvases are built the
+// way Denko::Display::Canvas sets its ivars, so both can be driven with the
+// same calls and their framebuffers compared byte for byte. Helpers are static
+// inline, since no one test uses them all.
+//
+#ifndef FASTCANVAS_TEST_HARNESS_H
+#define FASTCANVAS_TEST_HARNESS_H
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/variable.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void ref_gem_init(mrb_state* mrb);
+void mrb_mruby_denko_fastcanvas_gem_init(mrb_state* mrb);
+mrb_value stub_call(mrb_state* mrb, mrb_value self, const char* name, int argc, mrb_value* argv);
+
+// REF runs the baseline gem, GEM runs the one in src/.
+static mrb_state ref_state __attribute__((unused)), gem_state;
+#define REF (&ref_state)
+#define GEM (&gem_state)
+
+#define I(x) mrb_fixnum_value(x)
+#define F(m, x) mrb_float_value(m, x)
+
+static int checks, failures;
+
+#define CHECK(cond, ...) do { \
+  checks++; \
+  if (!(cond)) { \
+    failures++; \
+    if (failures <= 20) { printf("  FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } \
+  } \
+} while (0)
+
+static inline int report(const char* name) {
+  printf("%s: %d checks, %d failures\n", name, checks, failures);
+  return failures != 0;
+}
+
+// Deterministic, seedable, and independent of libc rand().
+static unsigned long rng_state = 1;
+static inline void seed(unsigned long s) { rng_state = s * 6364136223846793005UL + 1442695040888963407UL; }
+static inline int rnd(int lo, int hi) {
+  rng_state = rng_state * 6364136223846793005UL + 1442695040888963407UL;
+  return lo + (int)((rng_state >> 33) % (unsigned long)(hi - lo + 1));
+}
+static inline int coin(void) { return rnd(0, 1); }
+
+static inline mrb_value sym(mrb_state* mrb, const char* name) { return mrb_symbol_value(mrb_intern_cstr(mrb, name)); }
+static inline mrb_value str(mrb_state* mrb, const char* s) { return mrb_str_new(mrb, s, strlen(s)); }
+static inline mrb_value iv(mrb_state* mrb, mrb_value obj, const char* name) { return mrb_iv_get(mrb, obj, mrb_intern_cstr(mrb, name)); }
+static inline void iv_set(mrb_state* mrb, mrb_value obj, const char* name, mrb_value v) { mrb_iv_set(mrb, obj, mrb_intern_cstr(mrb, name), v); }
+
+static inline mrb_value call(mrb_state* mrb, mrb_value obj, const char* name, int argc, ...) {
+  mrb_value argv[16];
+  va_list ap;
+  va_start(ap, argc);
+  for (int i = 0; i < argc; i++) argv[i] = va_arg(ap, mrb_value);
+  va_end(ap);
+  return stub_call(mrb, obj, name, argc, argv);
+}
+
+static inline mrb_value kwargs(mrb_state* mrb, const char* k1, mrb_value v1, const char* k2, mrb_value v2) {
+  mrb_value h = mrb_hash_new(mrb);
+  if (k1) mrb_hash_set(mrb, h, sym(mrb, k1), v1);
+  if (k2) mrb_hash_set(mrb, h, sym(mrb, k2), v2);
+  return h;
+}
+
+// Calls a method that is expected to raise, and returns the exception class name.
+static inline const char* call_raises(mrb_state* mrb, mrb_value obj, const char* name, int argc, mrb_value* argv) {
+  jmp_buf jb;
+  jmp_buf* prev = mrb->jmp;
+  mrb->jmp = &jb;
+  mrb->errclass = NULL;
+  if (!setjmp(jb)) stub_call(mrb, obj, name, argc, argv);
+  mrb->jmp = prev;
+  return mrb->errclass ? mrb->errclass->name : NULL;
+}
+
+//
+// Canvases
+//
+// Orientation index o matches the writer table in the gem:
+// bit 0 = @invert_x, bit 1 = @invert_y, bit 2 = @swap_xy.
+//
+typedef struct {
+  mrb_state* mrb;
+  mrb_value obj;
+  int cols, rows, x_max, y_max, o;
+} canvas;
+
+static inline mrb_value font_characters(mrb_state* mrb, int width, int height, unsigned long s) {
+  unsigned long saved = rng_state;
+  seed(s);
+  mrb_value chars = mrb_ary_new(mrb);
+  int bytes = width * ((height + 7) / 8);
+  for (int c = 0; c < 95; c++) {
+    mrb_value glyph = mrb_ary_new(mrb);
+    for (int b = 0; b < bytes; b++) mrb_ary_push(mrb, glyph, I(rnd(0, 255)));
+    mrb_ary_push(mrb, chars, glyph);
+  }
+  rng_state = saved;
+  return chars;
+}
+
+static inline void set_orientation(canvas* c, int o) {
+  int swap = (o >> 2) & 1;
+  c->o = o;
+  c->x_max = swap ? c->rows - 1 : c->cols - 1;
+  c->y_max = swap ? c->cols - 1 : c->rows - 1;
+  iv_set(c->mrb, c->obj, "@invert_x", mrb_bool_value(o & 1));
+  iv_set(c->mrb, c->obj, "@invert_y", mrb_bool_value((o >> 1) & 1));
+  iv_set(c->mrb, c->obj, "@swap_xy", mrb_bool_value(swap));
+  iv_set(c->mrb, c->obj, "@x_max", I(c->x_max));
+  iv_set(c->mrb, c->obj, "@y_max", I(c->y_max));
+}
+
+static inline canvas new_font_canvas(mrb_state* mrb, int cols, int rows, int colors, int o, int font_width, int font_height, int font_scale) {
+  struct RClass* denko = mrb_define_module(mrb, "Denko");
+  struct RClass* display = mrb_define_module_under(mrb, denko, "Display");
+  struct RClass* klass = mrb_define_class_under(mrb, display, "Canvas", mrb->object_class);
+  canvas c = {mrb, mrb_obj_new(mrb, klass, 0, NULL), cols, rows, 0, 0, 0};
+
+  mrb_value framebuffers = mrb_ary_new(mrb);
+  int size = cols * ((rows + 7) / 8);
+  for (int i = 0; i < colors; i++) mrb_ary_push(mrb, framebuffers, mrb_str_new(mrb, NULL, size));
+  iv_set(mrb, c.obj, "@framebuffers", framebuffers);
+  iv_set(mrb, c.obj, "@framebuffer", mrb_ary_ref(mrb, framebuffers, 0));
+  iv_set(mrb, c.obj, "@colors", I(colors));
+  iv_set(mrb, c.obj, "@columns", I(cols));
+  iv_set(mrb, c.obj, "@rows", I(rows));
+  iv_set(mrb, c.obj, "@current_color", I(1));
+  set_orientation(&c, o);
+
+  iv_set(mrb, c.obj, "@font_characters", font_characters(mrb, font_width, font_height, font_width * 100 + font_height));
+  iv_set(mrb, c.obj, "@font_last_character", I(94));
+  iv_set(mrb, c.obj, "@font_height", I(font_height));
+  iv_set(mrb, c.obj, "@font_width", I(font_width));
+  iv_set(mrb, c.obj, "@font_scale", I(font_scale));
+  mrb_value cursor = mrb_ary_new(mrb);
+  mrb_ary_push(mrb, cursor, I(0));
+  mrb_ary_push(mrb, cursor, I(font_height * font_scale - 1));
+  iv_set(mrb, c.obj, "@text_cursor", cursor);
+  return c;
+}
+
+static inline canvas new_canvas(mrb_state* mrb, int cols, int rows, int colors, int o) {
+  return new_font_canvas(mrb, cols, rows, colors, o, 6, 8, 1);
+}
+
+// Switch a fresh canvas to another @pixel_format, with framebuffers sized by the gem.
+static inline void set_pixel_format(canvas* c, const char* format, int colors) {
+  iv_set(c->mrb, c->obj, "@pixel_format", sym(c->mrb, format));
+  mrb_int size = mrb_fixnum(call(c->mrb, c->obj, "framebuffer_size", 0));
+  mrb_value framebuffers = mrb_ary_new(c->mrb);
+  int planes = strcmp(format, "row") ? 1 : colors;
+  for (int i = 0; i < planes; i++) mrb_ary_push(c->mrb, framebuffers, mrb_str_new(c->mrb, NULL, size));
+  iv_set(c->mrb, c->obj, "@framebuffers", framebuffers);
+}
+
+static inline mrb_value plane(canvas* c, int i) { return mrb_ary_ref(c->mrb, iv(c->mrb, c->obj, "@framebuffers"), i); }
+static inline int plane_count(canvas* c) { return (int)RARRAY_LEN(iv(c->mrb, c->obj, "@framebuffers")); }
+
+// Logical (x, y) to physical column and row, the same transform the gem applies.
+static inline void physical(canvas* c, int x, int y, int* px, int* py) {
+  int xt = (c->o & 1) ? c->x_max - x : x;
+  int yt = (c->o & 2) ? c->y_max - y : y;
+  *px = (c->o & 4) ? yt : xt;
+  *py = (c->o & 4) ? xt : yt;
+}
+
+// Bit of one page-format plane, by physical position.
+static inline int bit(canvas* c, int i, int px, int py) {
+  return (RSTRING_PTR(plane(c, i))[(py / 8) * c->cols + px] >> (py % 8)) & 1;
+}
+
+// Color of a page-format pixel, by logical position: the first set plane, or 0.
+static inline int color_at(canvas* c, int x, int y) {
+  int px, py;
+  physical(c, x, y, &px, &py);
+  for (int i = 0; i < plane_count(c); i++) if (bit(c, i, px, py)) return i + 1;
+  return 0;
+}
+
+static inline void fill_random(canvas* c) {
+  for (int i = 0; i < plane_count(c); i++) {
+    mrb_value fb = plane(c, i);
+    for (int k = 0; k < RSTRING_LEN(fb); k++) RSTRING_PTR(fb)[k] = rnd(0, 255) & rnd(0, 255);
+  }
+}
+
+static inline int same_pixels(canvas* a, canvas* b) {
+  if (plane_count(a) != plane_count(b)) return 0;
+  for (int i = 0; i < plane_count(a); i++) {
+    mrb_value fa = plane(a, i), fb = plane(b, i);
+    if (RSTRING_LEN(fa) != RSTRING_LEN(fb) || memcmp(RSTRING_PTR(fa), RSTRING_PTR(fb), RSTRING_LEN(fa))) return 0;
+  }
+  return 1;
+}
+
+// Every set bit of a is also set in b.
+static inline int covered_by(canvas* a, canvas* b) {
+  for (int i = 0; i < plane_count(a); i++) {
+    mrb_value fa = plane(a, i), fb = plane(b, i);
+    for (int k = 0; k < RSTRING_LEN(fa); k++) if ((uint8_t)RSTRING_PTR(fa)[k] & ~(uint8_t)RSTRING_PTR(fb)[k]) return 0;
+  }
+  return 1;
+}
+
+static inline long set_bits(canvas* c) {
+  long n = 0;
+  for (int i = 0; i < plane_count(c); i++) {
+    mrb_value fb = plane(c, i);
+    for (int k = 0; k < RSTRING_LEN(fb); k++) n += __builtin_popcount((uint8_t)RSTRING_PTR(fb)[k]);
+  }
+  return n;
+}
+
+// Array of [x, y] pairs, the shape Canvas#path and #polygon pass down.
+static inline mrb_value points(mrb_state* mrb, const int* xs, const int* ys, int n) {
+  mrb_value pts = mrb_ary_new(mrb);
+  for (int i = 0; i < n; i++) {
+    mrb_value p = mrb_ary_new(mrb);
+    mrb_ary_push(mrb, p, I(xs[i]));
+    mrb_ary_push(mrb, p, I(ys[i]));
+    mrb_ary_push(mrb, pts, p);
+  }
+  return pts;
+}
+
+#endif
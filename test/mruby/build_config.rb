@@ -0,0 +1,16 @@
+# A real mruby with this gem, for test/mruby/smoke.rb. The C tests use a stand-in runtime,
+# so this is what checks the gem against mruby's own GC, String sharing and Data freeing.
+#
+#   make -C test mruby MRUBY_DIR=/path/to/mruby
+#
+# Builds into test/build/mruby, not the mruby checkout's own build directory.
+MRuby::Build.new('host', File.expand_path('../build/mruby', __dir__)) do |conf|
+  conf.toolchain
+  conf.enable_debug
+  conf.gembox 'default'
+  conf.gem File.expand_path('../..', __dir__)
+
+  sanitize = ENV['SANITIZE'].to_s.split
+  conf.cc.flags.concat(sanitize)
+  conf.linker.flags.concat(sanitize)
+end
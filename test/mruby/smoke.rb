@@ -0,0 +1,101 @@
+# Smoke test for the gem built into a real mruby. Run by `make -C test mruby`.
+#
+# Canvas here has only the ivars the gem reads, set the way Denko::Display::Canvas
+# sets them. Raises at the end if any check failed, so mruby exits non-zero.
+module Denko
+  module Display
+    class Canvas
+      def initialize(columns, rows, colors = 1)
+        @columns, @rows, @colors = columns, rows, colors
+        @framebuffers = Array.new(colors) { "\0" * (columns * ((rows + 7) / 8)) }
+        @framebuffer = @framebuffers[0]
+        @current_color = 1
+        @invert_x = @invert_y = @swap_xy = false
+        @x_max, @y_max = columns - 1, rows - 1
+        @font_characters = Array.new(95) { |i| Array.new(6) { |b| (i * 7 + b * 13) & 0xFF } }
+        @font_last_character = 94
+        @font_height, @font_width, @font_scale = 8, 6, 1
+        @text_cursor = [0, 7]
+      end
+
+      attr_reader :framebuffers
+
+      # Same as Canvas#rotate(180): the ivars are assigned directly.
+      def rotate_180
+        @invert_x = !@invert_x
+        @invert_y = !@invert_y
+      end
+
+      def use_pixel_format(format)
+        @pixel_format = format
+        @framebuffers = ["\0" * framebuffer_size]
+      end
+    end
+  end
+end
+
+$checks = 0
+$failures = 0
+def check(ok, what)
+  $checks += 1
+  return if ok
+  $failures += 1
+  puts "FAIL #{what}"
+end
+
+def raised(klass)
+  yield
+  nil
+rescue klass => e
+  e
+end
+
+Canvas = Denko::Display::Canvas
+
+# Drawing, and a rotation assigned straight to the ivars.
+c = Canvas.new(16, 16)
+c._set_pixel(1, 2, 1)
+check c._get_pixel(1, 2) == 1, "_set_pixel"
+c.rotate_180
+c._set_pixel(1, 2, 1)
+check c._get_pixel(14, 13) == 1, "draw after assigning @invert_x and @invert_y"
+
+# A dup shares the framebuffer's bytes until one of them is written.
+saved = c.framebuffers[0].dup
+before = saved.bytes
+c.fill
+check saved.bytes == before, "drawing after #dup changed the copy"
+check c.framebuffers[0].bytes.all? { |b| b == 0xFF }, "fill after #dup"
+
+# Canvases, caches and PointBuffers collected while others draw. Thick rings and
+# text_box use scratch Strings inside the GC arena.
+200.times do |i|
+  t = Canvas.new(64, 32, 2)
+  t.stroke_width = 1 + i % 5
+  t._ellipse(32, 16, 20, 10, false, 2)
+  t._rounded_rectangle(2, 2, 60, 28, 6, false, 1)
+  points = Canvas::PointBuffer.new
+  8.times { |k| points.push((k * 37) % 64, (k * 11) % 32) }
+  t._polygon(points, :nonzero, 1)
+  t.text_box(0, 0, 63, 31, "smoke test #{i} é", align: :right)
+  GC.start if i % 20 == 0
+end
+GC.start
+check Canvas.new(8, 8)._get_pixel(0, 0) == 0, "new canvas after GC"
+
+# Errors raised with mruby's own format specifiers.
+e = raised(ArgumentError) { c.draw_batch("\x09") }
+check e && e.message == "unknown draw_batch opcode 9", "draw_batch opcode message: #{e && e.message}"
+check raised(RangeError) { Canvas::PointBuffer.new.push(40000, 0) }, "PointBuffer#push past Int16"
+check raised(RangeError) { c._ellipse(0, 0, 32768, 1) }, "_ellipse radius past Int16"
+
+# A plane copied out of :page_interleaved, into a String that's reused.
+i = Canvas.new(8, 8, 2)
+i.use_pixel_format(:page_interleaved)
+i._set_pixel(3, 0, 2)
+into = "x"
+check i.framebuffer_plane(2, into).equal?(into), "framebuffer_plane returns the String given"
+check into.bytes[3] == 1 && into.bytesize == 8, "framebuffer_plane copies the plane"
+
+puts "smoke: #{$checks} checks, #{$failures} failures"
+raise "#{$failures} smoke checks failed" if $failures > 0
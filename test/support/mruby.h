@@ -0,0 +1,155 @@
+/* Minimal stand-in for the mruby C API, only for compiling/testing outside mruby. */
+#ifndef STUB_MRUBY_H
+#define STUB_MRUBY_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <setjmp.h>
+
+typedef int64_t mrb_int;
+typedef double mrb_float;
+typedef uint32_t mrb_sym;
+typedef bool mrb_bool;
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+#define MRB_INT_MAX INT64_MAX
+#define MRB_INT_MIN INT64_MIN
+
+enum mrb_vtype {
+  MRB_TT_FALSE, MRB_TT_TRUE, MRB_TT_INTEGER, MRB_TT_FLOAT, MRB_TT_SYMBOL,
+  MRB_TT_STRING, MRB_TT_ARRAY, MRB_TT_HASH, MRB_TT_OBJECT, MRB_TT_DATA, MRB_TT_CLASS, MRB_TT_MODULE,
+};
+#define MRB_TT_CDATA MRB_TT_DATA
+
+struct RClass; struct mrb_state;
+typedef struct { mrb_sym sym; struct mrb_value_s* dummy; } _unused;
+
+typedef struct mrb_value {
+  enum mrb_vtype tt;
+  int nil;
+  union { mrb_int i; mrb_float f; void* p; mrb_sym sym; } value;
+} mrb_value;
+
+typedef struct iv_tbl { mrb_sym* keys; mrb_value* vals; int len, capa; } iv_tbl;
+struct RBasic { enum mrb_vtype tt; struct RClass* c; iv_tbl iv; int frozen; };
+struct RString { struct RBasic b; char* ptr; mrb_int len, capa; };
+struct RArray { struct RBasic b; mrb_value* ptr; mrb_int len, capa; };
+struct RHash { struct RBasic b; mrb_value* keys; mrb_value* vals; mrb_int len, capa; };
+struct RObject { struct RBasic b; };
+typedef struct mrb_data_type { const char* struct_name; void (*dfree)(struct mrb_state*, void*); } mrb_data_type;
+struct RData { struct RBasic b; void* data; const mrb_data_type* type; };
+typedef struct mrb_state mrb_state;
+typedef mrb_value (*mrb_func_t)(mrb_state*, mrb_value);
+struct method_entry { mrb_sym name; mrb_func_t fn; };
+struct RClass { struct RBasic b; const char* name; struct RClass* outer; struct RClass* super;
+  struct method_entry* methods; int mlen, mcapa; enum mrb_vtype itt; };
+
+struct mrb_state {
+  struct RClass* object_class;
+  struct RClass** classes; int nclasses;
+  int argc; mrb_value* argv;
+  jmp_buf* jmp; char errmsg[256]; struct RClass* errclass;
+};
+
+typedef uint32_t mrb_aspec;
+#define MRB_ARGS_REQ(n) ((mrb_aspec)(n) << 18)
+#define MRB_ARGS_OPT(n) ((mrb_aspec)(n) << 13)
+#define MRB_ARGS_NONE() ((mrb_aspec)0)
+#define MRB_ARGS_ANY() ((mrb_aspec)1 << 12)
+#define MRB_ARGS_REST() ((mrb_aspec)1 << 12)
+#define MRB_ARGS_KEY(n,r) ((mrb_aspec)0)
+#define MRB_ARGS_BLOCK() ((mrb_aspec)1)
+
+static inline mrb_value mrb_nil_value(void) { mrb_value v; v.tt = MRB_TT_FALSE; v.nil = 1; v.value.i = 0; return v; }
+static inline mrb_value mrb_false_value(void) { mrb_value v; v.tt = MRB_TT_FALSE; v.nil = 0; v.value.i = 0; return v; }
+static inline mrb_value mrb_true_value(void) { mrb_value v; v.tt = MRB_TT_TRUE; v.nil = 0; v.value.i = 1; return v; }
+static inline mrb_value mrb_bool_value(mrb_bool b) { return b ? mrb_true_value() : mrb_false_value(); }
+static inline mrb_value mrb_fixnum_value(mrb_int i) { mrb_value v; v.tt = MRB_TT_INTEGER; v.nil = 0; v.value.i = i; return v; }
+#define mrb_int_value(mrb, i) mrb_fixnum_value(i)
+static inline mrb_value mrb_float_value(mrb_state* m, mrb_float f) { (void)m; mrb_value v; v.tt = MRB_TT_FLOAT; v.nil = 0; v.value.f = f; return v; }
+static inline mrb_value mrb_symbol_value(mrb_sym s) { mrb_value v; v.tt = MRB_TT_SYMBOL; v.nil = 0; v.value.i = 0; v.value.sym = s; return v; }
+static inline mrb_value mrb_obj_value(void* p) { mrb_value v; v.tt = ((struct RBasic*)p)->tt; v.nil = 0; v.value.p = p; return v; }
+#define mrb_type(v) ((v).tt)
+#define mrb_nil_p(v) ((v).tt == MRB_TT_FALSE && (v).nil)
+#define mrb_test(v) (!((v).tt == MRB_TT_FALSE))
+#define mrb_bool(v) mrb_test(v)
+#define mrb_integer(v) ((v).value.i)
+#define mrb_fixnum(v) ((v).value.i)
+#define mrb_float(v) ((v).value.f)
+#define mrb_symbol(v) ((v).value.sym)
+#define mrb_ptr(v) ((v).value.p)
+#define mrb_obj_ptr(v) ((struct RObject*)(v).value.p)
+#define mrb_integer_p(v) ((v).tt == MRB_TT_INTEGER)
+#define mrb_fixnum_p(v) mrb_integer_p(v)
+#define mrb_float_p(v) ((v).tt == MRB_TT_FLOAT)
+#define mrb_symbol_p(v) ((v).tt == MRB_TT_SYMBOL)
+#define mrb_string_p(v) ((v).tt == MRB_TT_STRING)
+#define mrb_array_p(v) ((v).tt == MRB_TT_ARRAY)
+#define mrb_hash_p(v) ((v).tt == MRB_TT_HASH)
+#define mrb_data_p(v) ((v).tt == MRB_TT_DATA)
+#define mrb_true_p(v) ((v).tt == MRB_TT_TRUE)
+#define mrb_false_p(v) ((v).tt == MRB_TT_FALSE && !(v).nil)
+#define mrb_undef_p(v) (0)
+#define mrb_immediate_p(v) ((v).tt < MRB_TT_STRING)
+mrb_bool mrb_obj_equal(mrb_state*, mrb_value, mrb_value);
+mrb_bool mrb_frozen_p_v(mrb_value);
+#define mrb_frozen_p(p) (((struct RBasic*)(p))->frozen)
+#define MRB_FROZEN_P(p) mrb_frozen_p(p)
+
+struct RClass* mrb_define_module(mrb_state*, const char*);
+struct RClass* mrb_define_module_under(mrb_state*, struct RClass*, const char*);
+struct RClass* mrb_define_class_under(mrb_state*, struct RClass*, const char*, struct RClass*);
+struct RClass* mrb_class_get_under(mrb_state*, struct RClass*, const char*);
+struct RClass* mrb_module_get(mrb_state*, const char*);
+void mrb_define_method(mrb_state*, struct RClass*, const char*, mrb_func_t, mrb_aspec);
+void mrb_define_class_method(mrb_state*, struct RClass*, const char*, mrb_func_t, mrb_aspec);
+void mrb_define_const(mrb_state*, struct RClass*, const char*, mrb_value);
+mrb_value mrb_obj_new(mrb_state*, struct RClass*, mrb_int, const mrb_value*);
+mrb_value mrb_funcall(mrb_state*, mrb_value, const char*, mrb_int, ...);
+#define MRB_SET_INSTANCE_TT(c, tt) ((c)->itt = (tt))
+struct RClass* mrb_obj_class(mrb_state*, mrb_value);
+#define mrb_class_ptr(v) ((struct RClass*)(v).value.p)
+
+mrb_sym mrb_intern_cstr(mrb_state*, const char*);
+mrb_sym mrb_intern(mrb_state*, const char*, size_t);
+#define mrb_intern_lit(mrb, lit) mrb_intern_cstr(mrb, lit)
+const char* mrb_sym_name(mrb_state*, mrb_sym);
+#define mrb_sym2name mrb_sym_name
+
+mrb_int mrb_get_args(mrb_state*, const char*, ...);
+mrb_int mrb_get_argc(mrb_state*);
+
+void mrb_raise(mrb_state*, struct RClass*, const char*) __attribute__((noreturn));
+void mrb_raisef(mrb_state*, struct RClass*, const char*, ...) __attribute__((noreturn));
+extern struct RClass stub_exc_argument, stub_exc_type, stub_exc_range, stub_exc_runtime, stub_exc_index, stub_exc_nomem, stub_exc_frozen;
+#define E_ARGUMENT_ERROR (&stub_exc_argument)
+#define E_TYPE_ERROR (&stub_exc_type)
+#define E_RANGE_ERROR (&stub_exc_range)
+#define E_RUNTIME_ERROR (&stub_exc_runtime)
+#define E_INDEX_ERROR (&stub_exc_index)
+#define E_FROZEN_ERROR (&stub_exc_frozen)
+
+void* mrb_malloc(mrb_state*, size_t);
+void* mrb_malloc_simple(mrb_state*, size_t);
+void* mrb_calloc(mrb_state*, size_t, size_t);
+void* mrb_realloc(mrb_state*, void*, size_t);
+void  mrb_free(mrb_state*, void*);
+
+mrb_int mrb_as_int(mrb_state*, mrb_value);
+mrb_float mrb_as_float(mrb_state*, mrb_value);
+#define mrb_to_flo mrb_as_float
+mrb_value mrb_to_int(mrb_state*, mrb_value);
+int mrb_gc_arena_save(mrb_state*);
+void mrb_gc_arena_restore(mrb_state*, int);
+void mrb_gc_register(mrb_state*, mrb_value);
+void mrb_gc_unregister(mrb_state*, mrb_value);
+#define mrb_field_write_barrier(m, a, b) ((void)0)
+#define mrb_write_barrier(m, a) ((void)0)
+#define mrb_field_write_barrier_value(m, a, b) ((void)0)
+void mrb_check_frozen(mrb_state*, void*);
+#define MRB_INLINE static inline
+#define MRB_API
+#endif
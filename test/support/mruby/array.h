@@ -0,0 +1,12 @@
+#include <mruby.h>
+#define RARRAY(v) ((struct RArray*)(v).value.p)
+#define RARRAY_LEN(v) (RARRAY(v)->len)
+#define RARRAY_PTR(v) (RARRAY(v)->ptr)
+mrb_value mrb_ary_new(mrb_state*);
+mrb_value mrb_ary_new_capa(mrb_state*, mrb_int);
+mrb_value mrb_ary_new_from_values(mrb_state*, mrb_int, const mrb_value*);
+mrb_value mrb_ary_ref(mrb_state*, mrb_value, mrb_int);
+mrb_value mrb_ary_entry(mrb_value, mrb_int);
+void mrb_ary_set(mrb_state*, mrb_value, mrb_int, mrb_value);
+void mrb_ary_push(mrb_state*, mrb_value, mrb_value);
+mrb_value mrb_assoc_new(mrb_state*, mrb_value, mrb_value);
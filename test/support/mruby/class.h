@@ -0,0 +1 @@
+#include <mruby.h>
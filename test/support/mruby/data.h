@@ -0,0 +1,10 @@
+#include <mruby.h>
+#define RDATA(v) ((struct RData*)(v).value.p)
+#define DATA_PTR(v) (RDATA(v)->data)
+#define DATA_TYPE(v) (RDATA(v)->type)
+struct RData* mrb_data_object_alloc(mrb_state*, struct RClass*, void*, const mrb_data_type*);
+#define Data_Wrap_Struct(mrb,klass,type,ptr) mrb_data_object_alloc(mrb,klass,ptr,type)
+void* mrb_data_get_ptr(mrb_state*, mrb_value, const mrb_data_type*);
+void* mrb_data_check_get_ptr(mrb_state*, mrb_value, const mrb_data_type*);
+#define DATA_GET_PTR(mrb,obj,dtype,type) (type*)mrb_data_get_ptr(mrb,obj,dtype)
+static inline void mrb_data_init(mrb_value v, void* ptr, const mrb_data_type* type) { DATA_PTR(v) = ptr; DATA_TYPE(v) = type; }
@@ -0,0 +1,7 @@
+#include <mruby.h>
+mrb_value mrb_hash_new(mrb_state*);
+mrb_value mrb_hash_get(mrb_state*, mrb_value, mrb_value);
+mrb_value mrb_hash_fetch(mrb_state*, mrb_value, mrb_value, mrb_value);
+void mrb_hash_set(mrb_state*, mrb_value, mrb_value, mrb_value);
+mrb_bool mrb_hash_key_p(mrb_state*, mrb_value, mrb_value);
+mrb_value mrb_hash_keys(mrb_state*, mrb_value);
@@ -0,0 +1,12 @@
+#include <mruby.h>
+#define RSTRING(v) ((struct RString*)(v).value.p)
+#define RSTRING_PTR(v) (RSTRING(v)->ptr)
+#define RSTRING_LEN(v) (RSTRING(v)->len)
+#define RSTRING_CAPA(v) (RSTRING(v)->capa)
+mrb_value mrb_str_new(mrb_state*, const char*, size_t);
+mrb_value mrb_str_new_capa(mrb_state*, size_t);
+#define mrb_str_new_lit(m, l) mrb_str_new(m, l, sizeof(l)-1)
+mrb_value mrb_str_resize(mrb_state*, mrb_value, mrb_int);
+const char* mrb_string_cstr(mrb_state*, mrb_value);
+void mrb_str_modify(mrb_state*, struct RString*);
+mrb_value mrb_str_cat(mrb_state*, mrb_value, const char*, size_t);
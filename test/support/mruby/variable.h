@@ -0,0 +1,4 @@
+#include <mruby.h>
+mrb_value mrb_iv_get(mrb_state*, mrb_value, mrb_sym);
+void mrb_iv_set(mrb_state*, mrb_value, mrb_sym, mrb_value);
+mrb_bool mrb_iv_defined(mrb_state*, mrb_value, mrb_sym);
@@ -0,0 +1,180 @@
+/*
+ * Just enough of the mruby runtime to load the gem and call its methods from C:
+ * objects with ivars, Strings, Arrays, Hashes, Symbols, Data, method tables and
+ * mrb_get_args. Raises longjmp to mrb->jmp when set, and abort otherwise.
+ */
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/variable.h>
+#include <mruby/string.h>
+#include <mruby/data.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct RClass stub_exc_argument = {.name="ArgumentError"}, stub_exc_type = {.name="TypeError"},
+  stub_exc_range = {.name="RangeError"}, stub_exc_runtime = {.name="RuntimeError"},
+  stub_exc_index = {.name="IndexError"}, stub_exc_nomem = {.name="NoMemoryError"}, stub_exc_frozen = {.name="FrozenError"};
+
+static char** symtab; static int nsyms, csyms;
+mrb_sym mrb_intern(mrb_state* m, const char* s, size_t n) {
+  (void)m;
+  for (int i=0;i<nsyms;i++) if (strlen(symtab[i])==n && !memcmp(symtab[i],s,n)) return i+1;
+  if (nsyms==csyms) { csyms = csyms?csyms*2:64; symtab = realloc(symtab, csyms*sizeof(char*)); }
+  symtab[nsyms] = strndup(s,n); return ++nsyms;
+}
+mrb_sym mrb_intern_cstr(mrb_state* m, const char* s) { return mrb_intern(m, s, strlen(s)); }
+const char* mrb_sym_name(mrb_state* m, mrb_sym s) { (void)m; return symtab[s-1]; }
+
+void* mrb_malloc(mrb_state* m, size_t n) { (void)m; void* p = malloc(n ? n : 1); if (!p) abort(); return p; }
+void* mrb_malloc_simple(mrb_state* m, size_t n) { (void)m; return malloc(n ? n : 1); }
+void* mrb_calloc(mrb_state* m, size_t a, size_t b) { (void)m; void* p = calloc(a?a:1, b?b:1); if(!p) abort(); return p; }
+void* mrb_realloc(mrb_state* m, void* p, size_t n) { (void)m; p = realloc(p, n ? n : 1); if (!p) abort(); return p; }
+void mrb_free(mrb_state* m, void* p) { (void)m; free(p); }
+
+void mrb_raise(mrb_state* m, struct RClass* c, const char* msg) {
+  m->errclass = c; snprintf(m->errmsg, sizeof m->errmsg, "%s", msg);
+  if (m->jmp) longjmp(*m->jmp, 1);
+  fprintf(stderr, "uncaught %s: %s\n", c->name, msg); abort();
+}
+/* mruby's own specifiers: %d is an int, %i an mrb_int, %s a C string. Anything else aborts,
+ * so a mismatch shows up here instead of reading the wrong vararg. */
+void mrb_raisef(mrb_state* m, struct RClass* c, const char* fmt, ...) {
+  char buf[256]; int j = 0; va_list ap; va_start(ap, fmt);
+  for (int i = 0; fmt[i] && j < 200; i++) {
+    if (fmt[i] != '%') { buf[j++] = fmt[i]; continue; }
+    switch (fmt[++i]) {
+    case 'd': j += snprintf(buf + j, sizeof buf - j, "%d", va_arg(ap, int)); break;
+    case 'i': j += snprintf(buf + j, sizeof buf - j, "%lld", (long long)va_arg(ap, mrb_int)); break;
+    case 's': j += snprintf(buf + j, sizeof buf - j, "%.40s", va_arg(ap, const char*)); break;
+    case '%': buf[j++] = '%'; break;
+    default: fprintf(stderr, "mrb_raisef: unsupported specifier in \"%s\"\n", fmt); abort();
+    }
+  }
+  buf[j] = 0; va_end(ap); mrb_raise(m, c, buf);
+}
+
+static void* newobj(enum mrb_vtype tt, size_t sz, struct RClass* c) { struct RBasic* b = calloc(1, sz); b->tt = tt; b->c = c; return b; }
+
+mrb_value mrb_str_new(mrb_state* m, const char* p, size_t n) { (void)m;
+  struct RString* s = newobj(MRB_TT_STRING, sizeof *s, NULL); s->ptr = malloc(n+1); if (p) memcpy(s->ptr,p,n); else memset(s->ptr,0,n); s->ptr[n]=0; s->len=n; s->capa=n; return mrb_obj_value(s); }
+mrb_value mrb_str_new_capa(mrb_state* m, size_t n) { mrb_value v = mrb_str_new(m, NULL, n); RSTRING(v)->len = 0; return v; }
+mrb_value mrb_str_resize(mrb_state* m, mrb_value v, mrb_int n) { (void)m; struct RString* s = RSTRING(v); s->ptr = realloc(s->ptr, n+1); if (n > s->len) memset(s->ptr+s->len, 0, n-s->len); s->len = n; s->ptr[n]=0; return v; }
+const char* mrb_string_cstr(mrb_state* m, mrb_value v) { (void)m; return RSTRING_PTR(v); }
+void mrb_str_modify(mrb_state* m, struct RString* s) { (void)m; (void)s; }
+mrb_value mrb_str_cat(mrb_state* m, mrb_value v, const char* p, size_t n) { mrb_int l = RSTRING_LEN(v); mrb_str_resize(m, v, l+n); memcpy(RSTRING_PTR(v)+l, p, n); return v; }
+
+mrb_value mrb_ary_new_capa(mrb_state* m, mrb_int n) { (void)m; struct RArray* a = newobj(MRB_TT_ARRAY, sizeof *a, NULL); a->capa = n>4?n:4; a->ptr = calloc(a->capa, sizeof(mrb_value)); return mrb_obj_value(a); }
+mrb_value mrb_ary_new(mrb_state* m) { return mrb_ary_new_capa(m, 4); }
+mrb_value mrb_ary_new_from_values(mrb_state* m, mrb_int n, const mrb_value* v) { mrb_value a = mrb_ary_new_capa(m,n); for (int i=0;i<n;i++) mrb_ary_push(m,a,v[i]); return a; }
+mrb_value mrb_ary_entry(mrb_value a, mrb_int i) { struct RArray* r = RARRAY(a); if (i<0) i+=r->len; if (i<0||i>=r->len) return mrb_nil_value(); return r->ptr[i]; }
+mrb_value mrb_ary_ref(mrb_state* m, mrb_value a, mrb_int i) { (void)m; return mrb_ary_entry(a, i); }
+void mrb_ary_push(mrb_state* m, mrb_value a, mrb_value v) { (void)m; struct RArray* r = RARRAY(a); if (r->len==r->capa) { r->capa*=2; r->ptr = realloc(r->ptr, r->capa*sizeof(mrb_value)); } r->ptr[r->len++] = v; }
+void mrb_ary_set(mrb_state* m, mrb_value a, mrb_int i, mrb_value v) { struct RArray* r = RARRAY(a); while (r->len <= i) mrb_ary_push(m, a, mrb_nil_value()); r->ptr[i] = v; }
+mrb_value mrb_assoc_new(mrb_state* m, mrb_value a, mrb_value b) { mrb_value v[2] = {a,b}; return mrb_ary_new_from_values(m,2,v); }
+
+static int veq(mrb_value a, mrb_value b) { if (a.tt != b.tt || a.nil != b.nil) return 0; if (a.tt==MRB_TT_STRING) return RSTRING_LEN(a)==RSTRING_LEN(b) && !memcmp(RSTRING_PTR(a),RSTRING_PTR(b),RSTRING_LEN(a)); return a.value.i == b.value.i; }
+mrb_bool mrb_obj_equal(mrb_state* m, mrb_value a, mrb_value b) { (void)m; return a.tt==b.tt && a.nil==b.nil && a.value.i==b.value.i; }
+mrb_value mrb_hash_new(mrb_state* m) { (void)m; struct RHash* h = newobj(MRB_TT_HASH, sizeof *h, NULL); return mrb_obj_value(h); }
+mrb_value mrb_hash_fetch(mrb_state* m, mrb_value h, mrb_value k, mrb_value d) { (void)m; struct RHash* r = h.value.p; for (int i=0;i<r->len;i++) if (veq(r->keys[i],k)) return r->vals[i]; return d; }
+mrb_value mrb_hash_get(mrb_state* m, mrb_value h, mrb_value k) { return mrb_hash_fetch(m,h,k,mrb_nil_value()); }
+mrb_bool mrb_hash_key_p(mrb_state* m, mrb_value h, mrb_value k) { (void)m; struct RHash* r = h.value.p; for (int i=0;i<r->len;i++) if (veq(r->keys[i],k)) return 1; return 0; }
+void mrb_hash_set(mrb_state* m, mrb_value h, mrb_value k, mrb_value v) { (void)m; struct RHash* r = h.value.p; for (int i=0;i<r->len;i++) if (veq(r->keys[i],k)) { r->vals[i]=v; return; }
+  if (r->len==r->capa) { r->capa = r->capa?r->capa*2:4; r->keys = realloc(r->keys, r->capa*sizeof(mrb_value)); r->vals = realloc(r->vals, r->capa*sizeof(mrb_value)); } r->keys[r->len]=k; r->vals[r->len++]=v; }
+
+static iv_tbl* ivt(mrb_value o) { if (mrb_immediate_p(o)) abort(); return &((struct RBasic*)o.value.p)->iv; }
+mrb_value mrb_iv_get(mrb_state* m, mrb_value o, mrb_sym s) { (void)m; iv_tbl* t = ivt(o); for (int i=0;i<t->len;i++) if (t->keys[i]==s) return t->vals[i]; return mrb_nil_value(); }
+mrb_bool mrb_iv_defined(mrb_state* m, mrb_value o, mrb_sym s) { (void)m; iv_tbl* t = ivt(o); for (int i=0;i<t->len;i++) if (t->keys[i]==s) return 1; return 0; }
+void mrb_iv_set(mrb_state* m, mrb_value o, mrb_sym s, mrb_value v) { (void)m; iv_tbl* t = ivt(o); for (int i=0;i<t->len;i++) if (t->keys[i]==s) { t->vals[i]=v; return; }
+  if (t->len==t->capa) { t->capa = t->capa?t->capa*2:8; t->keys = realloc(t->keys,t->capa*sizeof(mrb_sym)); t->vals = realloc(t->vals,t->capa*sizeof(mrb_value)); } t->keys[t->len]=s; t->vals[t->len++]=v; }
+
+struct RData* mrb_data_object_alloc(mrb_state* m, struct RClass* c, void* p, const mrb_data_type* t) { (void)m; struct RData* d = newobj(MRB_TT_DATA, sizeof *d, c); d->data = p; d->type = t; return d; }
+void* mrb_data_check_get_ptr(mrb_state* m, mrb_value v, const mrb_data_type* t) { (void)m; if (v.tt != MRB_TT_DATA || DATA_TYPE(v) != t) return NULL; return DATA_PTR(v); }
+void* mrb_data_get_ptr(mrb_state* m, mrb_value v, const mrb_data_type* t) { if (v.tt != MRB_TT_DATA || DATA_TYPE(v) != t) mrb_raise(m, E_TYPE_ERROR, "wrong argument type (data)"); return DATA_PTR(v); }
+
+static struct RClass* newclass(mrb_state* m, const char* name, struct RClass* outer, enum mrb_vtype tt) {
+  for (int i=0;i<m->nclasses;i++) if (!strcmp(m->classes[i]->name,name) && m->classes[i]->outer==outer) return m->classes[i];
+  struct RClass* c = newobj(tt, sizeof *c, NULL); c->name = strdup(name); c->outer = outer; c->itt = MRB_TT_OBJECT;
+  m->classes = realloc(m->classes, (m->nclasses+1)*sizeof(*m->classes)); m->classes[m->nclasses++] = c; return c; }
+struct RClass* mrb_define_module(mrb_state* m, const char* n) { return newclass(m, n, NULL, MRB_TT_MODULE); }
+struct RClass* mrb_module_get(mrb_state* m, const char* n) { return newclass(m, n, NULL, MRB_TT_MODULE); }
+struct RClass* mrb_define_module_under(mrb_state* m, struct RClass* o, const char* n) { return newclass(m, n, o, MRB_TT_MODULE); }
+struct RClass* mrb_define_class_under(mrb_state* m, struct RClass* o, const char* n, struct RClass* s) { struct RClass* c = newclass(m, n, o, MRB_TT_CLASS); c->super = s; return c; }
+struct RClass* mrb_class_get_under(mrb_state* m, struct RClass* o, const char* n) { return newclass(m, n, o, MRB_TT_CLASS); }
+void mrb_define_method(mrb_state* m, struct RClass* c, const char* n, mrb_func_t f, mrb_aspec a) { (void)a; mrb_sym s = mrb_intern_cstr(m, n);
+  for (int i=0;i<c->mlen;i++) if (c->methods[i].name==s) { c->methods[i].fn=f; return; }
+  c->methods = realloc(c->methods, (c->mlen+1)*sizeof(*c->methods)); c->methods[c->mlen].name = s; c->methods[c->mlen++].fn = f; }
+void mrb_define_class_method(mrb_state* m, struct RClass* c, const char* n, mrb_func_t f, mrb_aspec a) { char buf[128]; snprintf(buf, sizeof buf, "self.%s", n); mrb_define_method(m, c, buf, f, a); }
+void mrb_define_const(mrb_state* m, struct RClass* c, const char* n, mrb_value v) { char buf[128]; snprintf(buf, sizeof buf, "::%s", n); mrb_iv_set(m, mrb_obj_value(c), mrb_intern_cstr(m, buf), v); }
+struct RClass* mrb_obj_class(mrb_state* m, mrb_value v) { (void)m; return ((struct RBasic*)v.value.p)->c; }
+
+mrb_value stub_call(mrb_state* m, mrb_value self, const char* name, int argc, mrb_value* argv);
+mrb_value mrb_obj_new(mrb_state* m, struct RClass* c, mrb_int argc, const mrb_value* argv) {
+  mrb_value o;
+  if (c->itt == MRB_TT_DATA) { o = mrb_obj_value(mrb_data_object_alloc(m, c, NULL, NULL)); }
+  else { struct RObject* r = newobj(MRB_TT_OBJECT, sizeof *r, c); o = mrb_obj_value(r); }
+  for (int i=0;i<c->mlen;i++) if (!strcmp(mrb_sym_name(m, c->methods[i].name), "initialize")) { stub_call(m, o, "initialize", argc, (mrb_value*)argv); break; }
+  return o;
+}
+mrb_value mrb_funcall(mrb_state* m, mrb_value self, const char* name, mrb_int argc, ...) {
+  mrb_value argv[16]; va_list ap; va_start(ap, argc); for (int i=0;i<argc;i++) argv[i] = va_arg(ap, mrb_value); va_end(ap);
+  return stub_call(m, self, name, argc, argv); }
+
+mrb_value stub_call(mrb_state* m, mrb_value self, const char* name, int argc, mrb_value* argv) {
+  struct RClass* c = mrb_immediate_p(self) ? NULL : ((struct RBasic*)self.value.p)->c;
+  if (self.tt == MRB_TT_CLASS) { char buf[128]; snprintf(buf, sizeof buf, "self.%s", name); c = self.value.p; name = strdup(buf); }
+  mrb_sym s = mrb_intern_cstr(m, name);
+  for (; c; c = c->super) for (int i=0;i<c->mlen;i++) if (c->methods[i].name==s) {
+    int oc = m->argc; mrb_value* ov = m->argv; m->argc = argc; m->argv = argv;
+    mrb_value r = c->methods[i].fn(m, self); m->argc = oc; m->argv = ov; return r; }
+  fprintf(stderr, "no method %s\n", name); abort();
+}
+
+mrb_int mrb_as_int(mrb_state* m, mrb_value v) { if (v.tt==MRB_TT_INTEGER) return v.value.i; if (v.tt==MRB_TT_FLOAT) return (mrb_int)v.value.f; mrb_raise(m, E_TYPE_ERROR, "can't convert to Integer"); }
+mrb_value mrb_to_int(mrb_state* m, mrb_value v) { return mrb_fixnum_value(mrb_as_int(m, v)); }
+mrb_float mrb_as_float(mrb_state* m, mrb_value v) { if (v.tt==MRB_TT_INTEGER) return (mrb_float)v.value.i; if (v.tt==MRB_TT_FLOAT) return v.value.f; mrb_raise(m, E_TYPE_ERROR, "can't convert to Float"); }
+int mrb_gc_arena_save(mrb_state* m) { (void)m; return 0; }
+void mrb_gc_arena_restore(mrb_state* m, int i) { (void)m; (void)i; }
+void mrb_gc_register(mrb_state* m, mrb_value v) { (void)m; (void)v; }
+void mrb_gc_unregister(mrb_state* m, mrb_value v) { (void)m; (void)v; }
+void mrb_check_frozen(mrb_state* m, void* p) { if (((struct RBasic*)p)->frozen) mrb_raise(m, E_FROZEN_ERROR, "can't modify frozen object"); }
+mrb_int mrb_get_argc(mrb_state* m) { return m->argc; }
+
+mrb_int mrb_get_args(mrb_state* m, const char* fmt, ...) {
+  va_list ap; va_start(ap, fmt); int ai = 0; int opt = 0; const char* f = fmt;
+  while (*f) {
+    char c = *f++;
+    if (c == '|') { opt = 1; continue; }
+    if (c == '?') { mrb_bool* b = va_arg(ap, mrb_bool*); *b = ai <= m->argc; continue; }
+    int bang = (*f == '!'); if (bang) f++;
+    if (c == '*') { mrb_value** pv = va_arg(ap, mrb_value**); mrb_int* pn = va_arg(ap, mrb_int*); *pv = m->argv + ai; *pn = m->argc - ai; ai = m->argc; continue; }
+    if (c == '&') { mrb_value* pv = va_arg(ap, mrb_value*); *pv = mrb_nil_value(); continue; }
+    if (ai >= m->argc) {
+      if (!opt) mrb_raise(m, E_ARGUMENT_ERROR, "wrong number of arguments");
+      switch (c) { case 'i': case 'b': case 'S': case 'A': case 'H': case 'o': case 'f': case 'n': case 'z': case 'C': (void)va_arg(ap, void*); break;
+        case 's': (void)va_arg(ap, void*); (void)va_arg(ap, void*); break; case 'd': (void)va_arg(ap, void*); (void)va_arg(ap, void*); break; }
+      continue;
+    }
+    mrb_value v = m->argv[ai++];
+    switch (c) {
+      case 'i': *va_arg(ap, mrb_int*) = mrb_as_int(m, v); break;
+      case 'f': *va_arg(ap, mrb_float*) = mrb_as_float(m, v); break;
+      case 'b': *va_arg(ap, mrb_bool*) = mrb_test(v); break;
+      case 'o': *va_arg(ap, mrb_value*) = v; break;
+      case 'C': *va_arg(ap, mrb_value*) = v; break;
+      case 'n': if (v.tt != MRB_TT_SYMBOL) mrb_raise(m, E_TYPE_ERROR, "not a symbol"); *va_arg(ap, mrb_sym*) = v.value.sym; break;
+      case 'S': if (bang && mrb_nil_p(v)) { *va_arg(ap, mrb_value*) = v; break; } if (v.tt != MRB_TT_STRING) mrb_raise(m, E_TYPE_ERROR, "expected String"); *va_arg(ap, mrb_value*) = v; break;
+      case 'A': if (bang && mrb_nil_p(v)) { *va_arg(ap, mrb_value*) = v; break; } if (v.tt != MRB_TT_ARRAY) mrb_raise(m, E_TYPE_ERROR, "expected Array"); *va_arg(ap, mrb_value*) = v; break;
+      case 'H': if (bang && mrb_nil_p(v)) { *va_arg(ap, mrb_value*) = v; break; } if (v.tt != MRB_TT_HASH) mrb_raise(m, E_TYPE_ERROR, "expected Hash"); *va_arg(ap, mrb_value*) = v; break;
+      case 's': { if (v.tt != MRB_TT_STRING) mrb_raise(m, E_TYPE_ERROR, "expected String"); *va_arg(ap, const char**) = RSTRING_PTR(v); *va_arg(ap, mrb_int*) = RSTRING_LEN(v); break; }
+      case 'z': if (v.tt != MRB_TT_STRING) mrb_raise(m, E_TYPE_ERROR, "expected String"); *va_arg(ap, const char**) = RSTRING_PTR(v); break;
+      case 'd': { void** pp = va_arg(ap, void**); const mrb_data_type* t = va_arg(ap, const mrb_data_type*); *pp = mrb_data_get_ptr(m, v, t); break; }
+      default: fprintf(stderr, "bad fmt %c\n", c); abort();
+    }
+  }
+  va_end(ap);
+  if (ai < m->argc) mrb_raise(m, E_ARGUMENT_ERROR, "wrong number of arguments (too many)");
+  return ai;
+}
+mrb_value mrb_hash_keys(mrb_state* m, mrb_value h) { struct RHash* r = h.value.p; mrb_value a = mrb_ary_new(m); for (int i=0;i<r->len;i++) mrb_ary_push(m,a,r->keys[i]); return a; }
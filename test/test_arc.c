@@ -0,0 +1,100 @@
+//
+// _arc, _pie and _rounded_rectangle, against _ellipse and _rectangle:
+//
+//   - A full 360 degree arc or pie is the ellipse.
+//   - Four pies (or arcs) splitting the sweep make up the ellipse.
+//   - A pie covers the pixels whose angle from the center is in its sweep,
+//     away from the edges, and both stay inside the filled ellipse.
+//   - A rounded square with radius half its side is a circle, and with
+//     radius 0 it is a rectangle.
+//
+#include "harness.h"
+#include <math.h>
+
+int main(void) {
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+
+  for (int trial = 0; trial < 3000; trial++) {
+    seed(trial);
+    int cols = rnd(8, 120), rows = rnd(8, 70), o = trial % 8;
+    int xc = rnd(-20, 130), yc = rnd(-20, 90), a = rnd(0, 60), b = rnd(0, 60), filled = coin();
+    char what[96];
+    snprintf(what, sizeof what, "trial %d o=%d center %d,%d axes %d,%d", trial, o, xc, yc, a, b);
+    #define NEW new_canvas(GEM, cols, rows, 1, o)
+
+    canvas ellipse = NEW, arc = NEW, pie = NEW;
+    double start = rnd(-720, 720);
+    call(GEM, ellipse.obj, "_ellipse", 6, I(xc), I(yc), I(a), I(b), mrb_bool_value(filled), I(1));
+    call(GEM, arc.obj, "_arc", 8, I(xc), I(yc), I(a), I(b), F(GEM, start), F(GEM, start + 360), mrb_bool_value(filled), I(1));
+    call(GEM, pie.obj, "_pie", 8, I(xc), I(yc), I(a), I(b), F(GEM, start), F(GEM, start + 360), mrb_bool_value(filled), I(1));
+    CHECK(same_pixels(&ellipse, &arc), "%s: full arc differs from ellipse", what);
+    CHECK(same_pixels(&ellipse, &pie), "%s: full pie differs from ellipse", what);
+
+    canvas pies = NEW, arcs = NEW, filled_ellipse = NEW, outline = NEW;
+    double cuts[5] = {start};
+    for (int i = 1; i < 4; i++) cuts[i] = cuts[i - 1] + rnd(1, 100);
+    cuts[4] = start + 360;
+    if (cuts[3] >= cuts[4]) cuts[3] = cuts[4] - 1;
+    for (int i = 0; i < 4; i++) {
+      call(GEM, pies.obj, "_pie", 8, I(xc), I(yc), I(a), I(b), F(GEM, cuts[i]), F(GEM, cuts[i + 1]), mrb_true_value(), I(1));
+      call(GEM, arcs.obj, "_arc", 8, I(xc), I(yc), I(a), I(b), F(GEM, cuts[i]), F(GEM, cuts[i + 1]), mrb_false_value(), I(1));
+    }
+    call(GEM, filled_ellipse.obj, "_ellipse", 6, I(xc), I(yc), I(a), I(b), mrb_true_value(), I(1));
+    call(GEM, outline.obj, "_ellipse", 6, I(xc), I(yc), I(a), I(b), mrb_false_value(), I(1));
+    CHECK(same_pixels(&filled_ellipse, &pies), "%s: 4 pies differ from filled ellipse", what);
+    CHECK(same_pixels(&outline, &arcs), "%s: 4 arcs differ from ellipse outline", what);
+
+    // Filled pie and filled arc (closed by its chord) of a random sweep.
+    double from = rnd(-400, 399), sweep = rnd(1, 359);
+    canvas pie_fill = NEW, segment = NEW;
+    call(GEM, pie_fill.obj, "_pie", 8, I(xc), I(yc), I(a), I(b), F(GEM, from), F(GEM, from + sweep), mrb_true_value(), I(1));
+    call(GEM, segment.obj, "_arc", 8, I(xc), I(yc), I(a), I(b), F(GEM, from), F(GEM, from + sweep), mrb_true_value(), I(1));
+    CHECK(covered_by(&pie_fill, &filled_ellipse), "%s: pie outside ellipse", what);
+    CHECK(covered_by(&segment, &filled_ellipse), "%s: segment outside ellipse", what);
+    if (sweep <= 180) CHECK(covered_by(&segment, &pie_fill), "%s: segment outside pie (sweep %g)", what, sweep);
+    if (sweep > 180) CHECK(covered_by(&pie_fill, &segment), "%s: pie outside segment (sweep %g)", what, sweep);
+
+    int wrong_side = 0;
+    for (int y = 0; y <= pie_fill.y_max; y++) for (int x = 0; x <= pie_fill.x_max; x++) {
+      double dist = hypot(x - xc, y - yc);
+      if (dist <= 3 || !color_at(&filled_ellipse, x, y)) continue;
+      double angle = atan2(-(y - yc), x - xc) * 180 / M_PI;
+      double d = fmod(angle - from + 720 * 3, 360), margin = 90 / dist;
+      int clear = (d > margin && d < sweep - margin) || (d > sweep + margin && d < 360 - margin);
+      if (clear && (d <= sweep) != color_at(&pie_fill, x, y)) wrong_side++;
+    }
+    CHECK(!wrong_side, "%s: %d pie pixels on the wrong side of the sweep %g..%g", what, wrong_side, from, from + sweep);
+
+    int r = rnd(0, 30), x1 = rnd(-20, 100), y1 = rnd(-20, 60), x2 = rnd(-20, 130), y2 = rnd(-20, 90);
+    canvas rounded = NEW, circle = NEW, square = NEW, rect = NEW;
+    call(GEM, rounded.obj, "_rounded_rectangle", 7, I(x1), I(y1), I(x1 + 2 * r), I(y1 + 2 * r), I(r), mrb_bool_value(filled), I(1));
+    call(GEM, circle.obj, "_ellipse", 6, I(x1 + r), I(y1 + r), I(r), I(r), mrb_bool_value(filled), I(1));
+    CHECK(same_pixels(&rounded, &circle), "%s: rounded square radius %d differs from circle", what, r);
+    call(GEM, square.obj, "_rounded_rectangle", 7, I(x1), I(y1), I(x2), I(y2), I(0), mrb_bool_value(filled), I(1));
+    call(GEM, rect.obj, "_rectangle", 6, I(x1), I(y1), I(x2), I(y2), mrb_bool_value(filled), I(1));
+    CHECK(same_pixels(&square, &rect), "%s: radius 0 differs from rectangle", what);
+    #undef NEW
+  }
+
+  // Radii near the Int16 limit, which overflowed 32-bit error terms. Centered so one edge crosses
+  // the canvas, the curve must pass through the pixel the radius puts it on, and no further.
+  for (int r = 800; r <= 32767; r = r < 32767 && r * 2 > 32767 ? 32767 : r * 2) {
+    for (int filled = 0; filled < 2; filled++) {
+      canvas c = new_canvas(GEM, 128, 64, 1, 0);
+      call(GEM, c.obj, "_ellipse", 6, I(64), I(r + 10), I(r), I(r), mrb_bool_value(filled), I(1));
+      CHECK(color_at(&c, 64, 10) && !color_at(&c, 64, 9), "radius %d filled %d: top of the circle should be row 10", r, filled);
+      CHECK(filled == color_at(&c, 64, 40), "radius %d filled %d: inside should be %s", r, filled, filled ? "set" : "clear");
+      call(GEM, c.obj, "clear", 0);
+      call(GEM, c.obj, "_pie", 8, I(64), I(r + 10), I(r), I(r), F(GEM, 0), F(GEM, 180), mrb_bool_value(filled), I(1));
+      CHECK(color_at(&c, 64, 10) && !color_at(&c, 64, 9), "radius %d filled %d: top of the pie should be row 10", r, filled);
+      call(GEM, c.obj, "clear", 0);
+      call(GEM, c.obj, "_rounded_rectangle", 7, I(-r), I(10), I(r + 127), I(2 * r + 10), I(r), mrb_bool_value(filled), I(1));
+      CHECK(color_at(&c, 64, 10) && !color_at(&c, 64, 9), "radius %d filled %d: top of the rounded rectangle should be row 10", r, filled);
+    }
+  }
+  canvas c = new_canvas(GEM, 8, 8, 1, 0);
+  mrb_value big[4] = {I(0), I(0), I(32768), I(5)};
+  const char* raised = call_raises(GEM, c.obj, "_ellipse", 4, big);
+  CHECK(raised && !strcmp(raised, "RangeError"), "radius past Int16 should raise RangeError");
+  return report("test_arc");
+}
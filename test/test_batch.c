@@ -0,0 +1,167 @@
+//
+// draw_batch, _bitmap, fill_rect and clear_rect, against the calls they stand
+// for: a batch must draw what the same baseline calls draw one by one, a
+// bitmap what the baseline draws pixel by pixel, and the rect helpers what a
+// filled _rectangle draws. Image sizes too big to count in bytes must raise.
+//
+#include "harness.h"
+
+static void put8(char** p, int v) { *(*p)++ = (char)v; }
+static void put16(char** p, int v) { put8(p, v & 0xFF); put8(p, (v >> 8) & 0xFF); }
+static void put32(char** p, int v) { put16(p, v & 0xFFFF); put16(p, (v >> 16) & 0xFFFF); }
+
+static void check_batch(void) {
+  static char buf[20000];
+  for (int trial = 0; trial < 1000; trial++) {
+    seed(trial);
+    int cols = rnd(1, 130), rows = rnd(1, 64), colors = rnd(1, 3), o = trial % 8, fw = rnd(4, 8);
+    canvas a = new_font_canvas(REF, cols, rows, colors, o, fw, 8, 1);
+    canvas b = new_font_canvas(GEM, cols, rows, colors, o, fw, 8, 1);
+    char* p = buf;
+    for (int k = 0; k < 30; k++) {
+      // Color -1 stands for "no color given", which the batch encodes the same way.
+      int op = rnd(1, 7), color = rnd(-1, colors), filled = coin(), v[4];
+      int argc = color < 0 ? -1 : 0;
+      mrb_value args[6];
+      for (int q = 0; q < 4; q++) v[q] = rnd(-30, 150);
+      put8(&p, op);
+      switch (op) {
+      case 1:
+        put16(&p, v[0]); put16(&p, v[1]); put32(&p, color);
+        args[0] = I(v[0]); args[1] = I(v[1]); args[2] = I(color);
+        stub_call(REF, a.obj, "_set_pixel", 3 + argc, args);
+        break;
+      case 2:
+        for (int q = 0; q < 4; q++) { put16(&p, v[q]); args[q] = I(v[q]); }
+        put32(&p, color);
+        args[4] = I(color);
+        stub_call(REF, a.obj, "_line", 5 + argc, args);
+        break;
+      case 3:
+      case 4:
+        if (op == 4) { v[2] = rnd(0, 50); v[3] = rnd(0, 50); }
+        for (int q = 0; q < 4; q++) { put16(&p, v[q]); args[q] = I(v[q]); }
+        put8(&p, filled); put32(&p, color);
+        args[4] = mrb_bool_value(filled); args[5] = I(color);
+        stub_call(REF, a.obj, op == 3 ? "_rectangle" : "_ellipse", 6 + argc, args);
+        break;
+      case 5:
+      case 6: {
+        // Outlines only: filled polygons no longer match the baseline's scanline fill.
+        int n = rnd(0, 8), xs[8], ys[8];
+        put16(&p, n);
+        if (op == 6) put8(&p, 0);
+        put32(&p, color);
+        for (int q = 0; q < n; q++) { xs[q] = rnd(-30, 150); ys[q] = rnd(-30, 150); put16(&p, xs[q]); put16(&p, ys[q]); }
+        args[0] = points(REF, xs, ys, n);
+        if (op == 5) { args[1] = I(color); stub_call(REF, a.obj, "_path", 2 + argc, args); }
+        else { args[1] = mrb_false_value(); args[2] = I(color); stub_call(REF, a.obj, "_polygon", 3 + argc, args); }
+        break;
+      }
+      case 7: {
+        int n = rnd(0, 20), scale = rnd(1, 3);
+        put16(&p, v[0]); put16(&p, v[1]); put8(&p, fw); put8(&p, scale); put32(&p, color); put16(&p, n);
+        mrb_value glyph = mrb_ary_new(REF);
+        for (int q = 0; q < n; q++) { int byte = rnd(0, 255); put8(&p, byte); mrb_ary_push(REF, glyph, I(byte)); }
+        mrb_value char_args[6] = {glyph, I(v[0]), I(v[1]), I(fw), I(scale), I(color)};
+        stub_call(REF, a.obj, "_char", 6 + argc, char_args);
+        break;
+      }
+      }
+    }
+    call(GEM, b.obj, "draw_batch", 1, mrb_str_new(GEM, buf, p - buf));
+    CHECK(same_pixels(&a, &b), "trial %d o=%d: batch differs from baseline calls", trial, o);
+  }
+
+  canvas c = new_canvas(GEM, 16, 16, 1, 0);
+  // A line cut off after its first coordinates, and an unknown opcode.
+  const char truncated[] = {2, 1, 0, 1, 0, 5, 0};
+  const char unknown[] = {9};
+  mrb_value arg = mrb_str_new(GEM, truncated, sizeof truncated);
+  const char* raised = call_raises(GEM, c.obj, "draw_batch", 1, &arg);
+  CHECK(raised && !strcmp(raised, "ArgumentError"), "truncated batch should raise ArgumentError, got %s", raised ? raised : "nothing");
+  arg = mrb_str_new(GEM, unknown, sizeof unknown);
+  raised = call_raises(GEM, c.obj, "draw_batch", 1, &arg);
+  CHECK(raised && !strcmp(raised, "ArgumentError"), "unknown opcode should raise ArgumentError, got %s", raised ? raised : "nothing");
+  CHECK(!strcmp(GEM->errmsg, "unknown draw_batch opcode 9"), "unknown opcode message: %s", GEM->errmsg);
+}
+
+static void check_bitmap(void) {
+  static const char* modes[] = {"transparent", "opaque", "xor"};
+  static unsigned char data[40 * 150];
+  for (int trial = 0; trial < 1500; trial++) {
+    seed(trial + 100000);
+    int cols = rnd(1, 100), rows = rnd(1, 90), colors = rnd(1, 3), o = trial % 8;
+    canvas a = new_canvas(REF, cols, rows, colors, o);
+    canvas b = new_canvas(GEM, cols, rows, colors, o);
+    for (int k = 0; k < 30; k++) {
+      mrb_value args[5] = {I(rnd(-5, 100)), I(rnd(-5, 100)), I(rnd(-5, 100)), I(rnd(-5, 100)), I(rnd(0, colors))};
+      stub_call(REF, a.obj, "_line", 5, args);
+      stub_call(GEM, b.obj, "_line", 5, args);
+    }
+
+    int w = rnd(0, 40), h = rnd(0, 150), x = rnd(-30, 90), y = rnd(-30, 90), mode = rnd(0, 2), row_order = coin(), color = rnd(0, colors);
+    int len = row_order ? ((w + 7) / 8) * h : w * ((h + 7) / 8);
+    for (int i = 0; i < len; i++) data[i] = rnd(0, 255);
+    for (int r = 0; r < h; r++) for (int col = 0; col < w; col++) {
+      int on = row_order ? (data[r * ((w + 7) / 8) + col / 8] >> (7 - col % 8)) & 1 : (data[(r / 8) * w + col] >> (r % 8)) & 1;
+      int lx = x + col, ly = y + r, next = -1;
+      if (mode == 0 && on) next = color;
+      if (mode == 1) next = on ? color : 0;
+      if (mode == 2 && on && color > 0 && lx >= 0 && lx <= a.x_max && ly >= 0 && ly <= a.y_max) next = color_at(&a, lx, ly) == color ? 0 : color;
+      if (next >= 0) call(REF, a.obj, "_set_pixel", 3, I(lx), I(ly), I(next));
+    }
+
+    mrb_value kw = kwargs(GEM, "color", I(color), "mode", sym(GEM, modes[mode]));
+    mrb_hash_set(GEM, kw, sym(GEM, "order"), sym(GEM, row_order ? "row" : "page"));
+    call(GEM, b.obj, "_bitmap", 6, I(x), I(y), I(w), I(h), mrb_str_new(GEM, (char*)data, len), kw);
+    CHECK(same_pixels(&a, &b), "trial %d o=%d %s %s order, %dx%d at %d,%d: bitmap differs from baseline pixels",
+          trial, o, modes[mode], row_order ? "row" : "page", w, h, x, y);
+  }
+}
+
+// Sizes whose byte count overflows mrb_int must raise, not wrap around and pass the length check.
+static void check_huge_images(void) {
+  canvas c = new_canvas(GEM, 8, 8, 1, 0);
+  mrb_value args[5] = {I(0), I(0), I((mrb_int)1 << 32), I((mrb_int)1 << 32), str(GEM, "abcd")};
+  const char* raised = call_raises(GEM, c.obj, "_dither_image", 5, args);
+  CHECK(raised && !strcmp(raised, "ArgumentError"), "_dither_image with an overflowing size should raise ArgumentError");
+  for (int row = 0; row < 2; row++) {
+    mrb_value bargs[6] = {I(0), I(0), I((mrb_int)1 << 40), I((mrb_int)1 << 40), str(GEM, "abcd"),
+                          kwargs(GEM, "order", sym(GEM, row ? "row" : "page"), NULL, I(0))};
+    raised = call_raises(GEM, c.obj, "_bitmap", 6, bargs);
+    CHECK(raised && !strcmp(raised, "ArgumentError"), "_bitmap with an overflowing size should raise ArgumentError");
+  }
+}
+
+static void check_rects(void) {
+  for (int trial = 0; trial < 3000; trial++) {
+    seed(trial + 200000);
+    int cols = rnd(1, 100), rows = rnd(1, 50), colors = rnd(1, 3), o = trial % 8;
+    canvas a = new_canvas(GEM, cols, rows, colors, o), b = new_canvas(GEM, cols, rows, colors, o);
+    for (int k = 0; k < 5; k++) {
+      int x1 = rnd(-20, 120), y1 = rnd(-20, 120), x2 = rnd(-20, 120), y2 = rnd(-20, 120), color = rnd(-1, colors);
+      if (coin()) {
+        call(GEM, a.obj, "clear_rect", 4, I(x1), I(y1), I(x2), I(y2));
+        call(GEM, b.obj, "_rectangle", 6, I(x1), I(y1), I(x2), I(y2), mrb_true_value(), I(0));
+      } else if (color < 0) {
+        call(GEM, a.obj, "fill_rect", 4, I(x1), I(y1), I(x2), I(y2));
+        call(GEM, b.obj, "_rectangle", 5, I(x1), I(y1), I(x2), I(y2), mrb_true_value());
+      } else {
+        call(GEM, a.obj, "fill_rect", 5, I(x1), I(y1), I(x2), I(y2), I(color));
+        call(GEM, b.obj, "_rectangle", 6, I(x1), I(y1), I(x2), I(y2), mrb_true_value(), I(color));
+      }
+    }
+    CHECK(same_pixels(&a, &b), "trial %d o=%d: fill_rect/clear_rect differ from filled _rectangle", trial, o);
+  }
+}
+
+int main(void) {
+  ref_gem_init(REF);
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+  check_batch();
+  check_bitmap();
+  check_rects();
+  check_huge_images();
+  return report("test_batch");
+}
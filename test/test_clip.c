@@ -0,0 +1,95 @@
+//
+// clip, against the baseline gem: a clipped draw must match the unclipped
+// baseline drawing inside the clip rectangle, and leave everything outside it
+// alone.
+//
+#include "harness.h"
+
+enum { OP_LINE, OP_RECTANGLE, OP_ELLIPSE, OP_SET_PIXEL, OP_POLYGON, OP_PATH, OP_TEXT, OP_TEXT_ALIGNED, OP_BITMAP, OP_COUNT };
+
+int main(void) {
+  ref_gem_init(REF);
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+
+  for (int trial = 0; trial < 4000; trial++) {
+    seed(trial);
+    int cols = rnd(1, 100), rows = rnd(1, 70), colors = rnd(1, 3), o = trial % 8, scale = rnd(1, 3);
+    canvas a = new_font_canvas(REF, cols, rows, colors, o, 6, 8, scale);
+    canvas b = new_font_canvas(GEM, cols, rows, colors, o, 6, 8, scale);
+    int op = rnd(0, OP_COUNT - 1), color = rnd(1, colors);
+
+    int cx1 = rnd(-10, 80), cy1 = rnd(-10, 80), cx2 = rnd(-10, 80), cy2 = rnd(-10, 80);
+    call(GEM, b.obj, "clip", 4, I(cx1), I(cy1), I(cx2), I(cy2));
+    if (cx2 < cx1) { int t = cx1; cx1 = cx2; cx2 = t; }
+    if (cy2 < cy1) { int t = cy1; cy1 = cy2; cy2 = t; }
+
+    mrb_value args[8];
+    switch (op) {
+    case OP_LINE:
+      for (int i = 0; i < 4; i++) args[i] = I(rnd(-50, 150));
+      args[4] = I(color);
+      stub_call(REF, a.obj, "_line", 5, args);
+      stub_call(GEM, b.obj, "_line", 5, args);
+      break;
+    case OP_RECTANGLE:
+    case OP_ELLIPSE:
+      if (op == OP_RECTANGLE) for (int i = 0; i < 4; i++) args[i] = I(rnd(-50, 150));
+      else { args[0] = I(rnd(-20, 120)); args[1] = I(rnd(-20, 120)); args[2] = I(rnd(0, 60)); args[3] = I(rnd(0, 60)); }
+      args[4] = mrb_bool_value(coin());
+      args[5] = I(color);
+      stub_call(REF, a.obj, op == OP_RECTANGLE ? "_rectangle" : "_ellipse", 6, args);
+      stub_call(GEM, b.obj, op == OP_RECTANGLE ? "_rectangle" : "_ellipse", 6, args);
+      break;
+    case OP_SET_PIXEL:
+      args[0] = I(rnd(-5, 100)); args[1] = I(rnd(-5, 100)); args[2] = I(color);
+      stub_call(REF, a.obj, "_set_pixel", 3, args);
+      stub_call(GEM, b.obj, "_set_pixel", 3, args);
+      break;
+    case OP_POLYGON:
+    case OP_PATH: {
+      int n = rnd(1, 7), xs[7], ys[7];
+      for (int i = 0; i < n; i++) { xs[i] = rnd(-30, 130); ys[i] = rnd(-30, 130); }
+      if (op == OP_PATH) {
+        call(REF, a.obj, "_path", 2, points(REF, xs, ys, n), I(color));
+        call(GEM, b.obj, "_path", 2, points(GEM, xs, ys, n), I(color));
+      } else {
+        call(REF, a.obj, "_polygon", 3, points(REF, xs, ys, n), mrb_false_value(), I(color));
+        call(GEM, b.obj, "_polygon", 3, points(GEM, xs, ys, n), mrb_false_value(), I(color));
+      }
+      break;
+    }
+    case OP_TEXT:
+    case OP_TEXT_ALIGNED: {
+      int tx = rnd(-20, 80), ty = op == OP_TEXT_ALIGNED ? rnd(1, 8) * 8 - 1 : rnd(-10, 80);
+      canvas* cs[2] = {&a, &b};
+      for (int q = 0; q < 2; q++) {
+        mrb_value cursor = iv(cs[q]->mrb, cs[q]->obj, "@text_cursor");
+        mrb_ary_set(cs[q]->mrb, cursor, 0, I(tx));
+        mrb_ary_set(cs[q]->mrb, cursor, 1, I(ty));
+        call(cs[q]->mrb, cs[q]->obj, "text", 1, str(cs[q]->mrb, "Hello!#"));
+      }
+      break;
+    }
+    case OP_BITMAP: {
+      // The baseline has no _bitmap, so draw the same image pixel by pixel there.
+      int w = rnd(1, 40), h = rnd(1, 40), len = w * ((h + 7) / 8), x = rnd(-20, 80), y = rnd(-20, 80);
+      char data[200];
+      for (int i = 0; i < len; i++) data[i] = rnd(0, 255);
+      call(GEM, b.obj, "_bitmap", 6, I(x), I(y), I(w), I(h), mrb_str_new(GEM, data, len), kwargs(GEM, "color", I(color), "mode", sym(GEM, "opaque")));
+      for (int r = 0; r < h; r++) for (int c = 0; c < w; c++) {
+        int on = (data[(r / 8) * w + c] >> (r % 8)) & 1;
+        call(REF, a.obj, "_set_pixel", 3, I(x + c), I(y + r), I(on ? color : 0));
+      }
+      break;
+    }
+    }
+
+    int bad = 0;
+    for (int y = 0; y <= b.y_max && !bad; y++) for (int x = 0; x <= b.x_max; x++) {
+      int inside = x >= cx1 && x <= cx2 && y >= cy1 && y <= cy2;
+      if (color_at(&b, x, y) != (inside ? color_at(&a, x, y) : 0)) { bad = 1; break; }
+    }
+    CHECK(!bad, "trial %d op %d o=%d clip %d,%d..%d,%d: differs from baseline", trial, op, o, cx1, cy1, cx2, cy2);
+  }
+  return report("test_clip");
+}
@@ -0,0 +1,106 @@
+//
+// composite, against a pixel by pixel model of each op, with and without a
+// mask, clipping, layers hanging off any edge, and all 8 orientations. Then
+// by color, on 2 color canvases drawn the usual way.
+//
+#include "harness.h"
+
+static const char* ops[] = {"copy", "or", "and", "xor"};
+static int expected[3][160][80];
+
+// Random page-format canvas of the given size, same orientation as the target.
+static canvas layer(int cols, int rows, int colors, int o) {
+  canvas c = new_canvas(GEM, cols, rows, colors, o);
+  fill_random(&c);
+  return c;
+}
+
+int main(void) {
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+
+  for (int trial = 0; trial < 3000; trial++) {
+    seed(trial);
+    int o = trial % 8, colors = rnd(1, 3), op = rnd(0, 3), use_mask = coin();
+    canvas c = layer(rnd(1, 150), rnd(1, 70), colors, o);
+    canvas src = layer(rnd(1, 60), rnd(1, 40), colors, o);
+    canvas mask = layer(src.cols, src.rows, rnd(1, 3), o);
+    int x = rnd(-50, 150), y = rnd(-50, 100);
+
+    int cx1 = 0, cy1 = 0, cx2 = c.x_max, cy2 = c.y_max;
+    if (coin()) {
+      int x1 = rnd(-10, 160), y1 = rnd(-10, 160), x2 = rnd(-10, 160), y2 = rnd(-10, 160);
+      call(GEM, c.obj, "clip", 4, I(x1), I(y1), I(x2), I(y2));
+      if ((x1 < x2 ? x1 : x2) > cx1) cx1 = x1 < x2 ? x1 : x2;
+      if ((x1 < x2 ? x2 : x1) < cx2) cx2 = x1 < x2 ? x2 : x1;
+      if ((y1 < y2 ? y1 : y2) > cy1) cy1 = y1 < y2 ? y1 : y2;
+      if ((y1 < y2 ? y2 : y1) < cy2) cy2 = y1 < y2 ? y2 : y1;
+    }
+
+    for (int p = 0; p < colors; p++) for (int px = 0; px < c.cols; px++) for (int py = 0; py < c.rows; py++) expected[p][px][py] = bit(&c, p, px, py);
+    for (int lx = 0; lx <= src.x_max; lx++) for (int ly = 0; ly <= src.y_max; ly++) {
+      int X = x + lx, Y = y + ly;
+      if (X < cx1 || X > cx2 || Y < cy1 || Y > cy2) continue;
+      int spx, spy, px, py;
+      physical(&src, lx, ly, &spx, &spy);
+      physical(&c, X, Y, &px, &py);
+      if (use_mask) {
+        int any = 0;
+        for (int p = 0; p < plane_count(&mask); p++) any |= bit(&mask, p, spx, spy);
+        if (!any) continue;
+      }
+      // With more than one color, :or and :xor only touch pixels where the layer has a color.
+      int colored = 0;
+      for (int p = 0; p < colors; p++) colored |= bit(&src, p, spx, spy);
+      int by_color = colors > 1 && (op == 1 || op == 3);
+      if (by_color && !colored) continue;
+      for (int p = 0; p < colors; p++) {
+        int d = expected[p][px][py], s = bit(&src, p, spx, spy);
+        if (by_color) expected[p][px][py] = op == 1 ? s : (s & !d);
+        else expected[p][px][py] = op == 0 ? s : op == 1 ? (d | s) : op == 2 ? (d & s) : (d ^ s);
+      }
+    }
+
+    mrb_value kw = kwargs(GEM, "op", sym(GEM, ops[op]), use_mask ? "mask" : NULL, mask.obj);
+    call(GEM, c.obj, "composite", 4, src.obj, I(x), I(y), kw);
+
+    int bad = 0;
+    for (int p = 0; p < colors && !bad; p++) for (int px = 0; px < c.cols && !bad; px++) for (int py = 0; py < c.rows; py++) {
+      if (bit(&c, p, px, py) != expected[p][px][py]) { bad = 1; break; }
+    }
+    CHECK(!bad, "trial %d op %s mask %d o=%d colors=%d at %d,%d: differs from model", trial, ops[op], use_mask, o, colors, x, y);
+  }
+
+  // Two colors drawn normally, one plane per pixel: every op keeps it that way, by color.
+  for (int trial = 0; trial < 500; trial++) {
+    seed(trial + 100000);
+    int o = trial % 8, op = rnd(0, 3);
+    canvas c = new_canvas(GEM, rnd(1, 40), rnd(1, 30), 2, o), src = new_canvas(GEM, rnd(1, 30), rnd(1, 20), 2, o);
+    canvas* cs[2] = {&c, &src};
+    for (int q = 0; q < 2; q++) for (int k = 0; k < 300; k++) call(GEM, cs[q]->obj, "_set_pixel", 3, I(rnd(0, 40)), I(rnd(0, 40)), I(rnd(0, 2)));
+    int x = rnd(-20, 40), y = rnd(-20, 40);
+    static int before[40][40];
+    for (int lx = 0; lx <= c.x_max; lx++) for (int ly = 0; ly <= c.y_max; ly++) before[lx][ly] = color_at(&c, lx, ly);
+
+    call(GEM, c.obj, "composite", 4, src.obj, I(x), I(y), kwargs(GEM, "op", sym(GEM, ops[op]), NULL, I(0)));
+    int bad = 0, doubled = 0;
+    for (int lx = 0; lx <= c.x_max; lx++) for (int ly = 0; ly <= c.y_max; ly++) {
+      int px, py;
+      physical(&c, lx, ly, &px, &py);
+      doubled += bit(&c, 0, px, py) && bit(&c, 1, px, py);
+      int d = before[lx][ly], want = d;
+      if (lx - x >= 0 && lx - x <= src.x_max && ly - y >= 0 && ly - y <= src.y_max) {
+        int s = color_at(&src, lx - x, ly - y);
+        want = op == 0 ? s : op == 1 ? (s ? s : d) : op == 2 ? (d == s ? d : 0) : (s ? (d == s ? 0 : s) : d);
+      }
+      bad += color_at(&c, lx, ly) != want;
+    }
+    CHECK(!doubled, "trial %d 2 colors op %s: %d pixels set in both planes", trial, ops[op], doubled);
+    CHECK(!bad, "trial %d 2 colors op %s: %d pixels with the wrong color", trial, ops[op], bad);
+  }
+
+  canvas c = new_canvas(GEM, 10, 10, 1, 0), rotated = new_canvas(GEM, 5, 5, 1, 1);
+  mrb_value args[3] = {rotated.obj, I(0), I(0)};
+  const char* raised = call_raises(GEM, c.obj, "composite", 3, args);
+  CHECK(raised && !strcmp(raised, "ArgumentError"), "layer with another orientation should raise ArgumentError");
+  return report("test_composite");
+}
@@ -0,0 +1,86 @@
+//
+// _flood_fill, against a plain 4-connected breadth-first fill, on random
+// scenes in several pixel formats, orientations and clip rectangles. Unrotated
+// :page scans the framebuffer bytes directly, and everything else goes
+// through the orientation's reader.
+//
+#include "harness.h"
+
+static const char* formats[] = {"page", "row", "gray4", "page_interleaved"};
+static int before[150][70], expected[150][70];
+static int queue_x[150 * 70], queue_y[150 * 70];
+
+static int pixel(canvas* c, int px, int py) { return mrb_fixnum(call(GEM, c->obj, "_get_pixel", 2, I(px), I(py))); }
+
+int main(void) {
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+  int filled = 0;
+
+  for (int trial = 0; trial < 3000; trial++) {
+    seed(trial);
+    int f = trial % 4, colors = rnd(1, 3), o = (trial / 4) % 8;
+    canvas c = new_canvas(GEM, rnd(1, 150), rnd(1, 70), colors, o);
+    if (f) set_pixel_format(&c, formats[f], colors);
+    int max_color = f == 2 ? 15 : colors;
+    // Random :page bytes leave some pixels set in more than one plane. They read as the first.
+    if (f == 0 && rnd(0, 3) == 0) fill_random(&c);
+
+    int shapes = rnd(0, 25);
+    for (int k = 0; k < shapes; k++) {
+      int color = rnd(0, max_color);
+      switch (rnd(0, 3)) {
+      case 0: call(GEM, c.obj, "_line", 5, I(rnd(-20, 170)), I(rnd(-20, 170)), I(rnd(-20, 170)), I(rnd(-20, 170)), I(color)); break;
+      case 1: call(GEM, c.obj, "_rectangle", 6, I(rnd(-20, 170)), I(rnd(-20, 170)), I(rnd(-20, 170)), I(rnd(-20, 170)), mrb_bool_value(rnd(0, 3) == 0), I(color)); break;
+      case 2: call(GEM, c.obj, "_ellipse", 6, I(rnd(-20, 170)), I(rnd(-20, 170)), I(rnd(0, 60)), I(rnd(0, 60)), mrb_bool_value(rnd(0, 3) == 0), I(color)); break;
+      case 3: for (int q = 0; q < 30; q++) call(GEM, c.obj, "_set_pixel", 3, I(rnd(0, 150)), I(rnd(0, 150)), I(color)); break;
+      }
+    }
+
+    int cx1 = 0, cy1 = 0, cx2 = c.x_max, cy2 = c.y_max;
+    if (coin()) {
+      int x1 = rnd(-10, 160), y1 = rnd(-10, 160), x2 = rnd(-10, 160), y2 = rnd(-10, 160);
+      call(GEM, c.obj, "clip", 4, I(x1), I(y1), I(x2), I(y2));
+      if ((x1 < x2 ? x1 : x2) > cx1) cx1 = x1 < x2 ? x1 : x2;
+      if ((x1 < x2 ? x2 : x1) < cx2) cx2 = x1 < x2 ? x2 : x1;
+      if ((y1 < y2 ? y1 : y2) > cy1) cy1 = y1 < y2 ? y1 : y2;
+      if ((y1 < y2 ? y2 : y1) < cy2) cy2 = y1 < y2 ? y2 : y1;
+    }
+    for (int px = 0; px < c.cols; px++) for (int py = 0; py < c.rows; py++) before[px][py] = expected[px][py] = pixel(&c, px, py);
+
+    int sx = rnd(-5, 155), sy = rnd(-5, 155), color = rnd(0, max_color);
+    if (sx >= cx1 && sx <= cx2 && sy >= cy1 && sy <= cy2) {
+      int px, py;
+      physical(&c, sx, sy, &px, &py);
+      int old = before[px][py];
+      if (old != color) {
+        int head = 0, tail = 0;
+        queue_x[tail] = sx; queue_y[tail++] = sy;
+        expected[px][py] = color;
+        while (head < tail) {
+          int x = queue_x[head], y = queue_y[head++];
+          static const int dx[4] = {1, -1, 0, 0}, dy[4] = {0, 0, 1, -1};
+          for (int d = 0; d < 4; d++) {
+            int nx = x + dx[d], ny = y + dy[d];
+            if (nx < cx1 || nx > cx2 || ny < cy1 || ny > cy2) continue;
+            physical(&c, nx, ny, &px, &py);
+            if (expected[px][py] != old) continue;
+            expected[px][py] = color;
+            queue_x[tail] = nx; queue_y[tail++] = ny;
+          }
+        }
+      }
+    }
+
+    mrb_value complete = call(GEM, c.obj, "_flood_fill", 3, I(sx), I(sy), I(color));
+    CHECK(mrb_test(complete), "trial %d: fill did not complete", trial);
+    int bad = 0;
+    for (int px = 0; px < c.cols && !bad; px++) for (int py = 0; py < c.rows; py++) {
+      int v = pixel(&c, px, py);
+      if (v != expected[px][py]) { bad = 1; break; }
+      filled += v != before[px][py];
+    }
+    CHECK(!bad, "trial %d %s o=%d seed %d,%d color %d: differs from breadth-first fill", trial, formats[f], o, sx, sy, color);
+  }
+  CHECK(filled > 100000, "only %d pixels changed across all fills", filled);
+  return report("test_flood_fill");
+}
@@ -0,0 +1,237 @@
+//
+// Pixel formats and change tracking.
+//
+// The same random drawing in :row, :gray4, :rgb565 and :page_interleaved must
+// read back the same as in :page, pixel for pixel, in every orientation.
+// diff_and_commit must report exactly the columns that changed on each page,
+// widened only to the format's byte boundaries. Both, for each framebuffer
+// set, must describe that set alone across swap_buffers.
+//
+#include "harness.h"
+
+static const char* formats[] = {"row", "gray4", "rgb565", "page_interleaved"};
+static const char* modes[] = {"transparent", "opaque", "xor"};
+
+static int pixel(canvas* c, int px, int py) { return mrb_fixnum(call(GEM, c->obj, "_get_pixel", 2, I(px), I(py))); }
+
+// One random drawing call, the same on every canvas given (callers reseed between them).
+// #fill sets every plane, which only reads back as color 1 in the planar formats.
+static void draw(canvas* c, int op, int color, int planar) {
+  switch (op) {
+  case 0: call(GEM, c->obj, "_set_pixel", 3, I(rnd(-10, 110)), I(rnd(-10, 110)), I(color)); break;
+  case 1: call(GEM, c->obj, "_line", 5, I(rnd(-30, 130)), I(rnd(-30, 130)), I(rnd(-30, 130)), I(rnd(-30, 130)), I(color)); break;
+  case 2: call(GEM, c->obj, "_rectangle", 6, I(rnd(-30, 130)), I(rnd(-30, 130)), I(rnd(-30, 130)), I(rnd(-30, 130)), mrb_bool_value(coin()), I(color)); break;
+  case 3: {
+    int n = rnd(1, 8), xs[8], ys[8];
+    for (int i = 0; i < n; i++) { xs[i] = rnd(-30, 130); ys[i] = rnd(-30, 130); }
+    call(GEM, c->obj, "_polygon", 3, points(GEM, xs, ys, n), mrb_bool_value(coin()), I(color));
+    break;
+  }
+  case 4: call(GEM, c->obj, "_ellipse", 6, I(rnd(-20, 120)), I(rnd(-20, 120)), I(rnd(0, 50)), I(rnd(0, 50)), mrb_bool_value(coin()), I(color)); break;
+  case 5: {
+    mrb_value cursor = iv(GEM, c->obj, "@text_cursor");
+    mrb_ary_set(GEM, cursor, 0, I(rnd(-10, 90)));
+    mrb_ary_set(GEM, cursor, 1, I(coin() ? rnd(0, 8) * 8 + 7 : rnd(-10, 70)));
+    call(GEM, c->obj, "text", 2, str(GEM, "Hi #@!"), kwargs(GEM, "color", I(color), NULL, I(0)));
+    break;
+  }
+  case 6: {
+    int w = rnd(1, 30), h = rnd(1, 30), len = w * ((h + 7) / 8);
+    char data[150];
+    for (int i = 0; i < len; i++) data[i] = rnd(0, 255);
+    int x = rnd(-10, 90), y = rnd(-10, 70);
+    call(GEM, c->obj, "_bitmap", 6, I(x), I(y), I(w), I(h), mrb_str_new(GEM, data, len), kwargs(GEM, "color", I(color), "mode", sym(GEM, modes[rnd(0, 2)])));
+    break;
+  }
+  case 7: call(GEM, c->obj, (coin() && planar) ? "fill" : "clear", 0); break;
+  case 8: call(GEM, c->obj, "_pie", 8, I(rnd(-20, 120)), I(rnd(-20, 120)), I(rnd(0, 50)), I(rnd(0, 50)), F(GEM, rnd(0, 360)), F(GEM, rnd(0, 720)), mrb_bool_value(coin()), I(color)); break;
+  case 9: call(GEM, c->obj, "_rounded_rectangle", 7, I(rnd(-30, 130)), I(rnd(-30, 130)), I(rnd(-30, 130)), I(rnd(-30, 130)), I(rnd(0, 20)), mrb_bool_value(coin()), I(color)); break;
+  default: {
+    mrb_value glyph = mrb_ary_ref(GEM, iv(GEM, c->obj, "@font_characters"), rnd(0, 94));
+    int x = rnd(-10, 90), y = coin() ? rnd(0, 7) * 8 : rnd(-10, 70), scale = coin() ? 1 : rnd(1, 10);
+    call(GEM, c->obj, "_char", 6, glyph, I(x), I(y), I(6), I(scale), I(color));
+    break;
+  }
+  }
+}
+
+static void check_formats(void) {
+  for (int trial = 0; trial < 2000; trial++) {
+    seed(trial);
+    int cols = rnd(1, 100), rows = rnd(1, 60), colors = rnd(1, 3), o = trial % 8, scale = rnd(1, 3);
+    const char* format = formats[(trial / 8) % 4];
+    canvas page = new_font_canvas(GEM, cols, rows, colors, o, 6, 8, scale);
+    canvas other = new_font_canvas(GEM, cols, rows, colors, o, 6, 8, scale);
+    set_pixel_format(&other, format, colors);
+    canvas* cs[2] = {&page, &other};
+
+    int steps = rnd(1, 30);
+    for (int k = 0; k < steps; k++) {
+      int op = rnd(0, 11), color = rnd(0, colors);
+      unsigned long s = rnd(0, 1 << 30);
+      if (rnd(0, 3) == 0) {
+        int x1 = rnd(-10, 80), y1 = rnd(-10, 80), x2 = rnd(-10, 80), y2 = rnd(-10, 80), unclip = rnd(0, 2) == 0;
+        for (int q = 0; q < 2; q++) {
+          if (unclip) call(GEM, cs[q]->obj, "unclip", 0);
+          else call(GEM, cs[q]->obj, "clip", 4, I(x1), I(y1), I(x2), I(y2));
+        }
+      }
+      int planar = !strcmp(format, "row") || !strcmp(format, "page_interleaved");
+      for (int q = 0; q < 2; q++) { seed(s); draw(cs[q], op, color, planar); }
+    }
+
+    int bad = 0;
+    for (int py = 0; py < rows && !bad; py++) for (int px = 0; px < cols; px++) {
+      if (pixel(&page, px, py) != pixel(&other, px, py)) { bad = 1; break; }
+    }
+    CHECK(!bad, "trial %d %s o=%d: pixels differ from :page", trial, format, o);
+    mrb_value dp = call(GEM, page.obj, "dirty_regions", 0), dq = call(GEM, other.obj, "dirty_regions", 0);
+    CHECK(RARRAY_LEN(dp) == RARRAY_LEN(dq), "trial %d %s: dirty pages differ from :page", trial, format);
+
+    if (!strcmp(format, "page_interleaved")) {
+      for (int p = 1; p <= colors; p++) {
+        mrb_value got = call(GEM, other.obj, "framebuffer_plane", 1, I(p)), want = plane(&page, p - 1);
+        CHECK(RSTRING_LEN(got) == RSTRING_LEN(want) && !memcmp(RSTRING_PTR(got), RSTRING_PTR(want), RSTRING_LEN(want)),
+              "trial %d: framebuffer_plane(%d) differs from :page plane", trial, p);
+        mrb_value into = str(GEM, "x"), reused = call(GEM, other.obj, "framebuffer_plane", 2, I(p), into);
+        CHECK(mrb_obj_equal(GEM, reused, into) && RSTRING_LEN(into) == RSTRING_LEN(want) && !memcmp(RSTRING_PTR(into), RSTRING_PTR(want), RSTRING_LEN(want)),
+              "trial %d: framebuffer_plane(%d, into) should fill the String given", trial, p);
+      }
+    } else if (!strcmp(format, "row")) {
+      for (int p = 1; p <= colors; p++) {
+        CHECK(mrb_obj_equal(GEM, call(GEM, other.obj, "framebuffer_plane", 1, I(p)), mrb_ary_ref(GEM, iv(GEM, other.obj, "@framebuffers"), p - 1)),
+              "trial %d: :row framebuffer_plane(%d) should be the framebuffer, not a copy", trial, p);
+      }
+    }
+  }
+}
+
+static void check_diff_and_commit(void) {
+  static const char* all_formats[] = {"page", "row", "gray4", "rgb565", "page_interleaved"};
+  static int before[150][70];
+  for (int trial = 0; trial < 1000; trial++) {
+    seed(trial + 500000);
+    int cols = rnd(1, 150), rows = rnd(1, 70), colors = rnd(1, 3), f = trial % 5;
+    canvas c = new_canvas(GEM, cols, rows, colors, 0);
+    if (f) set_pixel_format(&c, all_formats[f], colors);
+    int max_color = f == 2 ? 15 : f == 3 ? 0xFFFF : colors;
+    // Columns per byte: :row packs 8 pixels, :gray4 two.
+    int granularity = f == 1 ? 8 : f == 2 ? 2 : 1;
+
+    mrb_value regions = call(GEM, c.obj, "diff_and_commit", 0);
+    CHECK(RARRAY_LEN(regions) == (rows + 7) / 8, "trial %d %s: first diff should cover every page", trial, all_formats[f]);
+
+    for (int round = 0; round < 6; round++) {
+      for (int x = 0; x < cols; x++) for (int y = 0; y < rows; y++) before[x][y] = pixel(&c, x, y);
+      int steps = rnd(0, 3);
+      for (int k = 0; k < steps; k++) {
+        int color = rnd(0, max_color), op = rnd(0, 9);
+        if (op < 5) call(GEM, c.obj, "_set_pixel", 3, I(rnd(-5, cols + 5)), I(rnd(-5, rows + 5)), I(color));
+        else if (op < 7) call(GEM, c.obj, "_line", 5, I(rnd(-20, 170)), I(rnd(-20, 90)), I(rnd(-20, 170)), I(rnd(-20, 90)), I(color));
+        else if (op < 9) call(GEM, c.obj, "_rectangle", 6, I(rnd(-20, 170)), I(rnd(-20, 90)), I(rnd(-20, 170)), I(rnd(-20, 90)), mrb_bool_value(coin()), I(color));
+        // Not #fill: it also sets the padding past the last row or column, which changes bytes
+        // without changing any pixel read back.
+        else call(GEM, c.obj, "clear", 0);
+      }
+
+      int lo[9], hi[9], got_lo[9], got_hi[9];
+      for (int p = 0; p < 9; p++) { lo[p] = got_lo[p] = cols; hi[p] = got_hi[p] = -1; }
+      for (int x = 0; x < cols; x++) for (int y = 0; y < rows; y++) {
+        if (pixel(&c, x, y) == before[x][y]) continue;
+        if (x < lo[y / 8]) lo[y / 8] = x;
+        if (x > hi[y / 8]) hi[y / 8] = x;
+      }
+      regions = call(GEM, c.obj, "diff_and_commit", 0);
+      for (int i = 0; i < RARRAY_LEN(regions); i++) {
+        mrb_value r = mrb_ary_ref(GEM, regions, i);
+        int p = mrb_fixnum(mrb_ary_ref(GEM, r, 0));
+        got_lo[p] = mrb_fixnum(mrb_ary_ref(GEM, r, 1));
+        got_hi[p] = mrb_fixnum(mrb_ary_ref(GEM, r, 2));
+      }
+      for (int p = 0; p < (rows + 7) / 8; p++) {
+        int ok = (lo[p] > hi[p]) ? (got_lo[p] > got_hi[p])
+               : (got_lo[p] <= lo[p] && got_hi[p] >= hi[p] && got_hi[p] < cols &&
+                  got_lo[p] / granularity == lo[p] / granularity && got_hi[p] / granularity == hi[p] / granularity);
+        CHECK(ok, "trial %d %s round %d page %d: expected %d..%d, got %d..%d", trial, all_formats[f], round, p, lo[p], hi[p], got_lo[p], got_hi[p]);
+      }
+      CHECK(RARRAY_LEN(call(GEM, c.obj, "diff_and_commit", 0)) == 0, "trial %d: diff right after a commit should be empty", trial);
+    }
+  }
+}
+
+// Regions as a "page:x_min-x_max ..." string, for comparing whole results at once.
+static const char* region_text(mrb_value regions) {
+  static char text[256];
+  int n = 0;
+  text[0] = 0;
+  for (int i = 0; i < RARRAY_LEN(regions) && n < 200; i++) {
+    mrb_value r = mrb_ary_ref(GEM, regions, i);
+    n += snprintf(text + n, sizeof(text) - n, "%s%d:%d-%d", i ? " " : "", (int)mrb_fixnum(mrb_ary_ref(GEM, r, 0)),
+                  (int)mrb_fixnum(mrb_ary_ref(GEM, r, 1)), (int)mrb_fixnum(mrb_ary_ref(GEM, r, 2)));
+  }
+  return text;
+}
+
+static void check_regions(canvas* c, const char* method, const char* expected, const char* when) {
+  const char* got = region_text(call(GEM, c->obj, method, 0));
+  CHECK(!strcmp(got, expected), "%s %s: expected \"%s\", got \"%s\"", method, when, expected, got);
+}
+
+// Dirty regions and the diff_and_commit copy belong to a framebuffer set, and swap with it.
+static void check_swap_buffers(void) {
+  canvas c = new_canvas(GEM, 40, 24, 1, 0);
+  call(GEM, c.obj, "diff_and_commit", 0);
+  call(GEM, c.obj, "clear_dirty", 0);
+  call(GEM, c.obj, "_set_pixel", 3, I(5), I(3), I(1));
+
+  // The second set is new, so all of it is dirty and differs from the display.
+  call(GEM, c.obj, "swap_buffers", 0);
+  check_regions(&c, "dirty_regions", "0:0-39 1:0-39 2:0-39", "on a new set");
+  check_regions(&c, "diff_and_commit", "0:0-39 1:0-39 2:0-39", "on a new set");
+  call(GEM, c.obj, "clear_dirty", 0);
+  call(GEM, c.obj, "_set_pixel", 3, I(30), I(20), I(1));
+  check_regions(&c, "dirty_regions", "2:30-30", "after drawing in the second set");
+
+  // Back to the first set: only the pixel drawn in it before the swap.
+  call(GEM, c.obj, "swap_buffers", 0);
+  check_regions(&c, "dirty_regions", "0:5-5", "back in the first set");
+  check_regions(&c, "diff_and_commit", "0:5-5", "back in the first set");
+  check_regions(&c, "diff_and_commit", "", "right after a commit");
+
+  call(GEM, c.obj, "swap_buffers", 0);
+  check_regions(&c, "dirty_regions", "2:30-30", "back in the second set");
+  check_regions(&c, "diff_and_commit", "2:30-30", "back in the second set");
+}
+
+// A bad @pixel_format or framebuffer must raise on every call until it's fixed, and never be half loaded.
+static void check_bad_state(void) {
+  canvas c = new_canvas(GEM, 16, 16, 2, 0);
+  mrb_value args[3] = {I(3), I(4), I(2)};
+  call(GEM, c.obj, "_set_pixel", 3, I(1), I(1), I(1));
+
+  iv_set(GEM, c.obj, "@pixel_format", sym(GEM, "bogus"));
+  for (int k = 0; k < 2; k++) {
+    const char* raised = call_raises(GEM, c.obj, "_set_pixel", 3, args);
+    CHECK(raised && !strcmp(raised, "ArgumentError"), "call %d with @pixel_format :bogus should raise ArgumentError", k + 1);
+  }
+
+  // :rgb565 with the :page framebuffers, which are too small for it.
+  iv_set(GEM, c.obj, "@pixel_format", sym(GEM, "rgb565"));
+  for (int k = 0; k < 2; k++) {
+    const char* raised = call_raises(GEM, c.obj, "_set_pixel", 3, args);
+    CHECK(raised && !strcmp(raised, "ArgumentError"), "call %d with framebuffers too small should raise ArgumentError", k + 1);
+  }
+
+  iv_set(GEM, c.obj, "@pixel_format", mrb_nil_value());
+  call(GEM, c.obj, "_set_pixel", 3, I(3), I(4), I(2));
+  CHECK(color_at(&c, 1, 1) == 1 && color_at(&c, 3, 4) == 2, "canvas should draw as :page again once @pixel_format is fixed");
+}
+
+int main(void) {
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+  check_bad_state();
+  check_formats();
+  check_diff_and_commit();
+  check_swap_buffers();
+  return report("test_formats");
+}
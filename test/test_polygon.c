@@ -0,0 +1,139 @@
+//
+// Polygon fill, against a direct winding-number test of each pixel center.
+//
+// A filled polygon is its outline (same as the baseline's unfilled polygon)
+// plus every pixel whose center is inside by the fill rule, sampled on the
+// row the way the scanline fill does. Packed Int16 strings, PointBuffers and
+// draw_batch polygons must draw exactly what the same Array of points does.
+//
+#include "harness.h"
+
+enum { RULE_TRUE, RULE_EVEN_ODD, RULE_NONZERO };
+
+static int inside(const int* xs, const int* ys, int n, int x, int y, int rule) {
+  long winding = 0;
+  for (int i = 0; i < n; i++) {
+    int j = (i + 1) % n;
+    long dx = xs[j] - xs[i], dy = ys[j] - ys[i];
+    if (!dy) continue;
+    long top = dy < 0 ? ys[j] : ys[i], bottom = dy < 0 ? ys[i] : ys[j];
+    if (y < top || y >= bottom) continue;
+    long dir = dy > 0 ? 1 : -1;
+    if ((long)(y - ys[i]) * dx * dir < (long)(x - xs[i]) * (dy * dir)) winding += dir;
+  }
+  return rule == RULE_NONZERO ? winding != 0 : (winding & 1);
+}
+
+static mrb_value rule_value(mrb_state* mrb, int rule) {
+  return rule == RULE_TRUE ? mrb_true_value() : sym(mrb, rule == RULE_EVEN_ODD ? "even_odd" : "nonzero");
+}
+
+static void check_fill_rules(void) {
+  for (int trial = 0; trial < 3000; trial++) {
+    seed(trial);
+    int cols = rnd(1, 120), rows = rnd(1, 70), o = trial % 8, rule = rnd(0, 2), n = rnd(1, 12);
+    int lo = trial % 3 ? -20 : -200, hi = trial % 3 ? 130 : 300;
+    int xs[12], ys[12];
+    for (int i = 0; i < n; i++) { xs[i] = rnd(lo, hi); ys[i] = rnd(lo, hi); }
+
+    canvas outline = new_canvas(REF, cols, rows, 1, o);
+    canvas filled = new_canvas(GEM, cols, rows, 1, o);
+    call(REF, outline.obj, "_polygon", 3, points(REF, xs, ys, n), mrb_false_value(), I(1));
+    call(GEM, filled.obj, "_polygon", 3, points(GEM, xs, ys, n), rule_value(GEM, rule), I(1));
+
+    int bad = 0;
+    for (int y = 0; y <= filled.y_max && !bad; y++) for (int x = 0; x <= filled.x_max; x++) {
+      int expected = color_at(&outline, x, y) || inside(xs, ys, n, x, y, rule);
+      if (color_at(&filled, x, y) != expected) { bad = 1; break; }
+    }
+    CHECK(!bad, "trial %d rule %d o=%d n=%d: fill differs from winding test", trial, rule, o, n);
+  }
+}
+
+static void check_point_sources(void) {
+  struct RClass* klass = mrb_class_get_under(GEM, mrb_class_get_under(GEM, mrb_class_get_under(GEM, mrb_module_get(GEM, "Denko"), "Display"), "Canvas"), "PointBuffer");
+  mrb_value buffer = mrb_obj_new(GEM, klass, 0, NULL);
+
+  for (int trial = 0; trial < 2000; trial++) {
+    seed(trial + 100000);
+    int cols = rnd(1, 100), rows = rnd(1, 50), o = trial % 8, n = rnd(0, 12);
+    canvas from_array = new_canvas(GEM, cols, rows, 2, o);
+    canvas from_string = new_canvas(GEM, cols, rows, 2, o);
+    canvas from_buffer = new_canvas(GEM, cols, rows, 2, o);
+
+    int xs[12], ys[12];
+    char packed[48];
+    call(GEM, buffer, "clear", 0);
+    for (int i = 0; i < n; i++) {
+      xs[i] = rnd(-3000, 3000) / rnd(1, 20);
+      ys[i] = rnd(-3000, 3000) / rnd(1, 20);
+      int16_t x = xs[i], y = ys[i];
+      memcpy(packed + 4 * i, &x, 2);
+      memcpy(packed + 4 * i + 2, &y, 2);
+      call(GEM, buffer, "push", 2, I(xs[i]), I(ys[i]));
+    }
+    CHECK(mrb_fixnum(call(GEM, buffer, "size", 0)) == n, "trial %d: PointBuffer#size", trial);
+
+    mrb_value sources[3] = {points(GEM, xs, ys, n), mrb_str_new(GEM, packed, 4 * n), buffer};
+    canvas* targets[3] = {&from_array, &from_string, &from_buffer};
+    for (int s = 0; s < 3; s++) {
+      if (trial % 3 == 0) call(GEM, targets[s]->obj, "_path", 2, sources[s], I(1));
+      else call(GEM, targets[s]->obj, "_polygon", 3, sources[s], rule_value(GEM, trial % 3 == 1 ? RULE_TRUE : RULE_NONZERO), I(2));
+    }
+    CHECK(same_pixels(&from_array, &from_string), "trial %d: packed Int16 points differ from Array", trial);
+    CHECK(same_pixels(&from_array, &from_buffer), "trial %d: PointBuffer differs from Array", trial);
+  }
+
+  canvas c = new_canvas(GEM, 10, 10, 1, 0);
+  mrb_value odd[1] = {str(GEM, "abc")};
+  const char* raised = call_raises(GEM, c.obj, "_path", 1, odd);
+  CHECK(raised && !strcmp(raised, "ArgumentError"), "packed points with a partial pair should raise ArgumentError");
+
+  // Past Int16, Arrays and #push raise rather than wrap around.
+  int xs[2] = {0, 32767}, ys[2] = {-32768, 40000};
+  mrb_value far[1] = {points(GEM, xs, ys, 2)};
+  raised = call_raises(GEM, c.obj, "_path", 1, far);
+  CHECK(raised && !strcmp(raised, "RangeError"), "Array point past Int16 should raise RangeError");
+  far[0] = points(GEM, xs, ys, 1);
+  CHECK(!call_raises(GEM, c.obj, "_path", 1, far), "Array points at the Int16 limits should draw");
+  mrb_value pushes[3][2] = {{I(32767), I(-32768)}, {I(-32769), I(0)}, {I(0), I(32768)}};
+  call(GEM, buffer, "clear", 0);
+  for (int k = 0; k < 3; k++) {
+    raised = call_raises(GEM, buffer, "push", 2, pushes[k]);
+    CHECK(k ? raised && !strcmp(raised, "RangeError") : !raised, "PointBuffer#push %d should %s", k, k ? "raise RangeError" : "accept the Int16 limits");
+  }
+  CHECK(mrb_fixnum(call(GEM, buffer, "size", 0)) == 1, "rejected pushes should not grow the buffer");
+}
+
+static void put8(char** p, int v) { *(*p)++ = (char)v; }
+static void put16(char** p, int v) { put8(p, v & 0xFF); put8(p, (v >> 8) & 0xFF); }
+static void put32(char** p, int v) { put16(p, v & 0xFFFF); put16(p, (v >> 16) & 0xFFFF); }
+
+// draw_batch op 6 is a polygon: count, fill rule byte, color, then Int16 pairs.
+static void check_batch_polygons(void) {
+  for (int trial = 0; trial < 2000; trial++) {
+    seed(trial + 200000);
+    int o = trial % 8, rule = rnd(0, 3), n = rnd(1, 10);
+    canvas batched = new_canvas(GEM, 100, 64, 2, o), direct = new_canvas(GEM, 100, 64, 2, o);
+    int xs[10], ys[10];
+    for (int i = 0; i < n; i++) { xs[i] = rnd(-20, 120); ys[i] = rnd(-20, 120); }
+
+    char buf[64], *p = buf;
+    put8(&p, 6); put16(&p, n); put8(&p, rule); put32(&p, 2);
+    for (int i = 0; i < n; i++) { put16(&p, xs[i]); put16(&p, ys[i]); }
+    call(GEM, batched.obj, "draw_batch", 1, mrb_str_new(GEM, buf, p - buf));
+
+    mrb_value fill = rule == 0 ? mrb_false_value() : rule == 2 ? sym(GEM, "nonzero") : sym(GEM, "even_odd");
+    call(GEM, direct.obj, "_polygon", 3, points(GEM, xs, ys, n), fill, I(2));
+    CHECK(same_pixels(&batched, &direct), "trial %d rule %d: draw_batch polygon differs from _polygon", trial, rule);
+  }
+}
+
+int main(void) {
+  ref_gem_init(REF);
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+  check_fill_rules();
+  check_point_sources();
+  check_batch_polygons();
+  return report("test_polygon");
+}
@@ -0,0 +1,175 @@
+//
+// Differential test: every method the baseline gem also implements is called
+// with the same arguments on both, across canvas sizes, color counts and all 8
+// orientations, and the framebuffers must match byte for byte.
+//
+// Polygons are only compared as outlines. Filled polygons intentionally differ
+// from the baseline's fill (see test_polygon.c).
+//
+#include "harness.h"
+
+enum { OP_SET_PIXEL, OP_LINE, OP_RECTANGLE, OP_PATH, OP_POLYGON, OP_ELLIPSE, OP_CHAR, OP_TEXT, OP_CLEAR, OP_FILL, OP_GET_PIXEL, OP_MUTATE, OP_COUNT };
+static const char* op_names[] = {"_set_pixel", "_line", "_rectangle", "_path", "_polygon", "_ellipse", "_char", "text", "clear", "fill", "_get_pixel", "mutate"};
+
+static mrb_value ref_points, gem_points;
+
+static void random_points(int n, int lo, int hi) {
+  int xs[16], ys[16];
+  for (int i = 0; i < n; i++) { xs[i] = rnd(lo, hi); ys[i] = rnd(lo, hi); }
+  ref_points = points(REF, xs, ys, n);
+  gem_points = points(GEM, xs, ys, n);
+}
+
+// Call on both, with a trailing color argument unless color < 0.
+static void both(canvas* a, canvas* b, const char* name, int argc, mrb_value* argv, int color, const char* what) {
+  if (color >= 0) argv[argc++] = I(color);
+  mrb_value ra = stub_call(REF, a->obj, name, argc, argv);
+  mrb_value rb = stub_call(GEM, b->obj, name, argc, argv);
+  CHECK(ra.tt == rb.tt && ra.value.i == rb.value.i, "%s: %s returned a different value", what, name);
+}
+
+// Change orientation, current color, font, or replace a framebuffer String,
+// the way Ruby code would between calls, on both canvases.
+static void mutate(canvas* a, canvas* b, int fw, int fh, int colors) {
+  int o = rnd(0, 7), color = rnd(0, colors), new_font = coin(), replace = rnd(0, 2) == 0;
+  unsigned long font_seed = rnd(0, 1 << 20);
+  canvas* cs[2] = {a, b};
+  for (int q = 0; q < 2; q++) {
+    canvas* c = cs[q];
+    set_orientation(c, o);
+    iv_set(c->mrb, c->obj, "@current_color", I(color));
+    if (new_font) iv_set(c->mrb, c->obj, "@font_characters", font_characters(c->mrb, fw, fh, font_seed));
+    if (replace) {
+      mrb_value old = plane(c, 0);
+      mrb_ary_set(c->mrb, iv(c->mrb, c->obj, "@framebuffers"), 0, mrb_str_new(c->mrb, RSTRING_PTR(old), RSTRING_LEN(old)));
+    }
+  }
+}
+
+// #rotate and #reflect assign @swap_xy, @invert_x and @invert_y directly, and
+// #calculate_bounds then @x_max and @y_max. The next draw must use them.
+static void check_direct_ivars(void) {
+  canvas a = new_canvas(REF, 40, 24, 1, 0), b = new_canvas(GEM, 40, 24, 1, 0);
+  canvas* cs[2] = {&a, &b};
+  mrb_value args[5] = {I(2), I(3), I(30), I(9), I(1)};
+  for (int step = 0; step < 4; step++) {
+    for (int q = 0; q < 2; q++) {
+      canvas* c = cs[q];
+      stub_call(c->mrb, c->obj, "_line", 5, args);
+      mrb_bool swap = !mrb_test(iv(c->mrb, c->obj, "@swap_xy"));
+      iv_set(c->mrb, c->obj, "@swap_xy", mrb_bool_value(swap));
+      if (step == 2) iv_set(c->mrb, c->obj, "@invert_x", mrb_true_value());
+      iv_set(c->mrb, c->obj, "@x_max", I(swap ? c->rows - 1 : c->cols - 1));
+      iv_set(c->mrb, c->obj, "@y_max", I(swap ? c->cols - 1 : c->rows - 1));
+      stub_call(c->mrb, c->obj, "_rectangle", 5, (mrb_value[5]){I(-3), I(20), I(50), I(22), mrb_true_value()});
+    }
+    CHECK(same_pixels(&a, &b), "step %d: draw after assigning @swap_xy directly differs from baseline", step);
+  }
+}
+
+int main(int argc, char** argv) {
+  int trials = argc > 1 ? atoi(argv[1]) : 4000;
+  ref_gem_init(REF);
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+
+  for (int trial = 0; trial < trials; trial++) {
+    seed(trial);
+    int cols = rnd(1, 140), rows = rnd(1, 70), colors = rnd(1, 3), o = trial % 8;
+    int fw = rnd(4, 8), fh = coin() ? 8 : rnd(9, 16), fs = rnd(1, 3);
+    canvas a = new_font_canvas(REF, cols, rows, colors, o, fw, fh, fs);
+    canvas b = new_font_canvas(GEM, cols, rows, colors, o, fw, fh, fs);
+    int sequence = (trial / 8) % OP_COUNT;
+    int steps = sequence == OP_MUTATE ? 40 : 1;
+    char what[160];
+
+    for (int step = 0; step < steps; step++) {
+      int op = sequence == OP_MUTATE ? rnd(0, OP_MUTATE) : sequence;
+      int lo = -40, hi = 180, color = rnd(-1, colors + 1);
+      mrb_value args[8];
+      snprintf(what, sizeof what, "trial %d step %d %s (%dx%d colors=%d o=%d font=%dx%d*%d)", trial, step, op_names[op], cols, rows, colors, a.o, fw, fh, fs);
+
+      switch (op) {
+      case OP_SET_PIXEL:
+        args[0] = I(rnd(lo, hi)); args[1] = I(rnd(lo, hi));
+        both(&a, &b, "_set_pixel", 2, args, color, what);
+        break;
+      case OP_LINE:
+        for (int i = 0; i < 4; i++) args[i] = I(rnd(lo, hi));
+        if (coin()) args[2] = args[0]; else if (coin()) args[3] = args[1];
+        both(&a, &b, "_line", 4, args, color, what);
+        break;
+      case OP_RECTANGLE:
+        for (int i = 0; i < 4; i++) args[i] = I(rnd(lo, hi));
+        args[4] = mrb_bool_value(coin());
+        both(&a, &b, "_rectangle", 5, args, color, what);
+        break;
+      case OP_PATH:
+      case OP_POLYGON: {
+        random_points(rnd(0, 9), lo, hi);
+        mrb_value ra[3] = {ref_points, mrb_false_value(), I(color)}, rb[3] = {gem_points, mrb_false_value(), I(color)};
+        if (op == OP_PATH) {
+          ra[1] = rb[1] = I(color);
+          stub_call(REF, a.obj, "_path", color < 0 ? 1 : 2, ra);
+          stub_call(GEM, b.obj, "_path", color < 0 ? 1 : 2, rb);
+        } else {
+          stub_call(REF, a.obj, "_polygon", color < 0 ? 2 : 3, ra);
+          stub_call(GEM, b.obj, "_polygon", color < 0 ? 2 : 3, rb);
+        }
+        break;
+      }
+      case OP_ELLIPSE:
+        args[0] = I(rnd(lo, hi)); args[1] = I(rnd(lo, hi)); args[2] = I(rnd(0, 60)); args[3] = I(rnd(0, 60));
+        args[4] = mrb_bool_value(coin());
+        both(&a, &b, "_ellipse", 5, args, color, what);
+        break;
+      case OP_CHAR: {
+        int index = rnd(0, 94), scale = fs, y = rnd(lo, hi);
+        // Also hit the byte-aligned fast path.
+        if (coin()) { y = rnd(0, 8) * 8; scale = 1; }
+        mrb_value ra[6] = {mrb_ary_ref(REF, iv(REF, a.obj, "@font_characters"), index), I(rnd(lo, hi)), I(y), I(fw), I(scale), I(color)};
+        mrb_value rb[6];
+        memcpy(rb, ra, sizeof ra);
+        rb[0] = mrb_ary_ref(GEM, iv(GEM, b.obj, "@font_characters"), index);
+        stub_call(REF, a.obj, "_char", color < 0 ? 5 : 6, ra);
+        stub_call(GEM, b.obj, "_char", color < 0 ? 5 : 6, rb);
+        break;
+      }
+      case OP_TEXT: {
+        char s[24];
+        int len = rnd(0, 20);
+        for (int i = 0; i < len; i++) s[i] = rnd(0, 255) ? rnd(20, 140) : 0;
+        int tx = rnd(lo, hi), ty = coin() ? rnd(1, 8) * 8 - 1 : rnd(lo, hi);
+        canvas* cs[2] = {&a, &b};
+        for (int q = 0; q < 2; q++) {
+          mrb_state* m = cs[q]->mrb;
+          mrb_value cursor = iv(m, cs[q]->obj, "@text_cursor");
+          mrb_ary_set(m, cursor, 0, I(tx));
+          mrb_ary_set(m, cursor, 1, I(ty));
+          mrb_value targs[2] = {mrb_str_new(m, s, len), kwargs(m, "color", I(color), NULL, I(0))};
+          stub_call(m, cs[q]->obj, "text", color < 0 ? 1 : 2, targs);
+        }
+        mrb_value ca = iv(REF, a.obj, "@text_cursor"), cb = iv(GEM, b.obj, "@text_cursor");
+        CHECK(mrb_fixnum(mrb_ary_ref(REF, ca, 0)) == mrb_fixnum(mrb_ary_ref(GEM, cb, 0)), "%s: text cursor differs", what);
+        break;
+      }
+      case OP_CLEAR:
+        both(&a, &b, "clear", 0, args, -1, what);
+        break;
+      case OP_FILL:
+        both(&a, &b, "fill", 0, args, -1, what);
+        break;
+      case OP_GET_PIXEL:
+        // _get_pixel takes physical coordinates.
+        args[0] = I(rnd(0, cols - 1)); args[1] = I(rnd(0, rows - 1));
+        both(&a, &b, "_get_pixel", 2, args, -1, what);
+        break;
+      case OP_MUTATE:
+        mutate(&a, &b, fw, fh, colors);
+        break;
+      }
+      CHECK(same_pixels(&a, &b), "%s: framebuffers differ", what);
+    }
+  }
+  check_direct_ivars();
+  return report("test_reference");
+}
@@ -0,0 +1,150 @@
+//
+// stroke_width, checked against shapes the gem already draws correctly at 1px:
+//
+//   - A thick outline always covers the 1px outline of the same shape.
+//   - Rectangle, ellipse and rounded rectangle rings equal a filled outer
+//     shape with a filled inner shape cleared out of it.
+//   - A clockwise 4 point polygon on a rectangle (4 mitered joins) equals the
+//     rectangle ring.
+//   - Thick strokes write each pixel once: the pixel counter in
+//     fastcanvas_stats matches the bits set on a cleared canvas.
+//
+#include "harness.h"
+
+static long pixels_written(canvas* c, const char* method) {
+  mrb_value stats = call(GEM, c->obj, "fastcanvas_stats", 0);
+  mrb_value entry = mrb_hash_get(GEM, stats, sym(GEM, method));
+  if (mrb_nil_p(entry)) return 0;
+  return mrb_fixnum(mrb_hash_get(GEM, entry, sym(GEM, "pixels")));
+}
+
+static void stroke_width(canvas* c, int w) { call(GEM, c->obj, "stroke_width=", 1, I(w)); }
+
+// Outer and inner offsets of a ring around a 1px outline: extra width is split
+// around it, with the odd pixel inside.
+static void ring(canvas* c, int x1, int y1, int x2, int y2, int out, int in) {
+  call(GEM, c->obj, "fill_rect", 5, I(x1 - out), I(y1 - out), I(x2 + out), I(y2 + out), I(1));
+  if (x1 + in <= x2 - in && y1 + in <= y2 - in) call(GEM, c->obj, "clear_rect", 4, I(x1 + in), I(y1 + in), I(x2 - in), I(y2 - in));
+}
+
+enum { LINE, PATH, POLYGON, RECTANGLE, ELLIPSE, ROUNDED, SHAPES };
+static const char* methods[] = {"_line", "_path", "_polygon", "_rectangle", "_ellipse", "_rounded_rectangle"};
+
+int main(void) {
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+
+  for (int trial = 0; trial < 6000; trial++) {
+    seed(trial);
+    int o = rnd(0, 7), shape = trial % SHAPES, w = rnd(1, 9);
+    int out = (w - 1) / 2, in = w / 2 + 1;
+    canvas thick = new_canvas(GEM, 96, 64, 1, o), expected = new_canvas(GEM, 96, 64, 1, o);
+    if (rnd(0, 3) == 0) {
+      int cx = rnd(0, 60), cy = rnd(0, 60), cx2 = cx + rnd(0, 40), cy2 = cy + rnd(0, 40);
+      call(GEM, thick.obj, "clip", 4, I(cx), I(cy), I(cx2), I(cy2));
+      call(GEM, expected.obj, "clip", 4, I(cx), I(cy), I(cx2), I(cy2));
+    }
+    stroke_width(&thick, w);
+    call(GEM, thick.obj, "reset_fastcanvas_stats", 0);
+
+    int x1 = rnd(-20, 110), y1 = rnd(-20, 80), x2 = rnd(-20, 110), y2 = rnd(-20, 80);
+    int lx = x1 < x2 ? x1 : x2, hx = x1 < x2 ? x2 : x1, ly = y1 < y2 ? y1 : y2, hy = y1 < y2 ? y2 : y1;
+    int covers = 0;
+    char what[96];
+    snprintf(what, sizeof what, "trial %d %s w=%d o=%d", trial, methods[shape], w, o);
+
+    switch (shape) {
+    case LINE:
+      if (rnd(0, 2) == 0) y2 = y1;
+      call(GEM, thick.obj, "_line", 5, I(x1), I(y1), I(x2), I(y2), I(1));
+      if (y1 == y2 && x1 < x2) {
+        call(GEM, expected.obj, "fill_rect", 5, I(x1), I(y1 - out), I(x2), I(y1 + w / 2), I(1));
+      } else {
+        call(GEM, expected.obj, "_line", 5, I(x1), I(y1), I(x2), I(y2), I(1));
+        covers = 1;
+      }
+      break;
+    case PATH:
+    case POLYGON: {
+      int n = rnd(1, 7), xs[7], ys[7];
+      for (int i = 0; i < n; i++) { xs[i] = rnd(-20, 110); ys[i] = rnd(-20, 110); }
+      canvas* cs[2] = {&thick, &expected};
+      for (int q = 0; q < 2; q++) {
+        if (shape == PATH) call(GEM, cs[q]->obj, "_path", 2, points(GEM, xs, ys, n), I(1));
+        else call(GEM, cs[q]->obj, "_polygon", 3, points(GEM, xs, ys, n), mrb_false_value(), I(1));
+      }
+      covers = 1;
+      break;
+    }
+    case RECTANGLE:
+      call(GEM, thick.obj, "_rectangle", 6, I(x1), I(y1), I(x2), I(y2), mrb_false_value(), I(1));
+      if (w == 1) call(GEM, expected.obj, "_rectangle", 6, I(x1), I(y1), I(x2), I(y2), mrb_false_value(), I(1));
+      else ring(&expected, lx, ly, hx, hy, out, in);
+      break;
+    case ELLIPSE: {
+      int a = rnd(0, 30), b = rnd(0, 30);
+      call(GEM, thick.obj, "_ellipse", 6, I(x1), I(y1), I(a), I(b), mrb_false_value(), I(1));
+      if (w == 1) {
+        call(GEM, expected.obj, "_ellipse", 6, I(x1), I(y1), I(a), I(b), mrb_false_value(), I(1));
+      } else {
+        call(GEM, expected.obj, "_ellipse", 6, I(x1), I(y1), I(a + out), I(b + out), mrb_true_value(), I(1));
+        if (a - in >= 0 && b - in >= 0) call(GEM, expected.obj, "_ellipse", 6, I(x1), I(y1), I(a - in), I(b - in), mrb_true_value(), I(0));
+      }
+      break;
+    }
+    case ROUNDED: {
+      int r = rnd(0, 20);
+      call(GEM, thick.obj, "_rounded_rectangle", 7, I(x1), I(y1), I(x2), I(y2), I(r), mrb_false_value(), I(1));
+      if (r > (hx - lx) / 2) r = (hx - lx) / 2;
+      if (r > (hy - ly) / 2) r = (hy - ly) / 2;
+      if (w == 1) {
+        call(GEM, expected.obj, "_rounded_rectangle", 7, I(x1), I(y1), I(x2), I(y2), I(r), mrb_false_value(), I(1));
+      } else if (r <= 0) {
+        ring(&expected, lx, ly, hx, hy, out, in);
+      } else {
+        call(GEM, expected.obj, "_rounded_rectangle", 7, I(lx - out), I(ly - out), I(hx + out), I(hy + out), I(r + out), mrb_true_value(), I(1));
+        if (lx + in <= hx - in && ly + in <= hy - in)
+          call(GEM, expected.obj, "_rounded_rectangle", 7, I(lx + in), I(ly + in), I(hx - in), I(hy - in), I(r > in ? r - in : 0), mrb_true_value(), I(0));
+      }
+      break;
+    }
+    }
+
+    if (covers) CHECK(covered_by(&expected, &thick), "%s: 1px outline not covered", what);
+    else CHECK(same_pixels(&thick, &expected), "%s: differs from expected shape", what);
+    if (w > 1) CHECK(pixels_written(&thick, methods[shape]) == set_bits(&thick), "%s: pixels written more than once", what);
+
+    // Mitered corners: a clockwise rectangle polygon is the rectangle ring.
+    if (shape == POLYGON && lx < hx && ly < hy) {
+      canvas poly = new_canvas(GEM, 96, 64, 1, o), rect = new_canvas(GEM, 96, 64, 1, o);
+      stroke_width(&poly, w);
+      stroke_width(&rect, w);
+      int xs[4] = {lx, hx, hx, lx}, ys[4] = {ly, ly, hy, hy};
+      call(GEM, poly.obj, "reset_fastcanvas_stats", 0);
+      call(GEM, poly.obj, "_polygon", 3, points(GEM, xs, ys, 4), mrb_false_value(), I(1));
+      call(GEM, rect.obj, "_rectangle", 6, I(lx), I(ly), I(hx), I(hy), mrb_false_value(), I(1));
+      CHECK(same_pixels(&poly, &rect), "%s: rectangle polygon differs from rectangle", what);
+      if (w > 1) CHECK(pixels_written(&poly, "_polygon") == set_bits(&poly), "%s: rectangle polygon overdraws", what);
+    }
+  }
+
+  // Widths up to the limit on a radius 1000 curve, whose 1px outline crosses row 32. The ring covers the canvas.
+  for (int w = 1001; w <= 32767; w = w < 32767 && w * 4 > 32767 ? 32767 : w * 4) {
+    canvas ring = new_canvas(GEM, 128, 64, 1, 0), corner = new_canvas(GEM, 128, 64, 1, 0);
+    stroke_width(&ring, w);
+    stroke_width(&corner, w);
+    call(GEM, ring.obj, "_ellipse", 6, I(64), I(1032), I(1000), I(1000), mrb_false_value(), I(1));
+    call(GEM, corner.obj, "_rounded_rectangle", 7, I(64), I(32), I(3064), I(2032), I(1000), mrb_false_value(), I(1));
+    CHECK(set_bits(&ring) == 128 * 64, "stroke_width %d: ellipse ring should cover the canvas", w);
+    CHECK(set_bits(&corner) == 128 * 64, "stroke_width %d: rounded corner ring should cover the canvas", w);
+  }
+
+  canvas c = new_canvas(GEM, 8, 8, 1, 0);
+  CHECK(mrb_fixnum(call(GEM, c.obj, "stroke_width", 0)) == 1, "default stroke_width is 1");
+  mrb_value zero[1] = {I(0)};
+  const char* raised = call_raises(GEM, c.obj, "stroke_width=", 1, zero);
+  CHECK(raised && !strcmp(raised, "ArgumentError"), "stroke_width=(0) should raise ArgumentError");
+  mrb_value huge[1] = {I(32768)};
+  raised = call_raises(GEM, c.obj, "stroke_width=", 1, huge);
+  CHECK(raised && !strcmp(raised, "ArgumentError"), "stroke_width=(32768) should raise ArgumentError");
+  return report("test_stroke");
+}
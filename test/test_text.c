@@ -0,0 +1,155 @@
+//
+// text, text_width and text_box, in every orientation at scales 1 and 2.
+// Each case is checked against plain #text calls at the positions the lines
+// should land on: wrapping, alignment, clipping to the box, newlines, UTF-8
+// with @font_map, and proportional fonts via @font_widths.
+//
+#include "harness.h"
+
+static void cursor(canvas* c, int x, int y) {
+  mrb_value tc = iv(c->mrb, c->obj, "@text_cursor");
+  mrb_ary_set(c->mrb, tc, 0, I(x));
+  mrb_ary_set(c->mrb, tc, 1, I(y));
+}
+
+static void text(canvas* c, int x, int y, const char* s) {
+  cursor(c, x, y);
+  call(c->mrb, c->obj, "text", 1, str(c->mrb, s));
+}
+
+static int width(canvas* c, const char* s) { return mrb_fixnum(call(c->mrb, c->obj, "text_width", 1, str(c->mrb, s))); }
+
+static void clear(canvas* a, canvas* b) {
+  call(a->mrb, a->obj, "clear", 0);
+  call(b->mrb, b->obj, "clear", 0);
+}
+
+int main(void) {
+  mrb_mruby_denko_fastcanvas_gem_init(GEM);
+
+  for (int o = 0; o < 8; o++) for (int scale = 1; scale <= 2; scale++) {
+    canvas a = new_font_canvas(GEM, 128, 64, 1, o, 6, 8, scale), b = new_font_canvas(GEM, 128, 64, 1, o, 6, 8, scale);
+    int w = 6 * scale, h = 8 * scale;
+    #define CASE(cond, what) CHECK(cond, "o=%d scale %d: %s", o, scale, what)
+
+    CASE(width(&a, "hello") == 5 * w, "text_width");
+    CASE(width(&a, "ab\nhello\nx") == 5 * w, "text_width of the widest line");
+    CASE(width(&a, "") == 0, "text_width of an empty string");
+    CASE(width(&a, "\xc3\xa9\xe2\x82\xac") == 2 * w, "text_width counts UTF-8 characters");
+
+    // Wraps at the last space that fits a 5 character box.
+    clear(&a, &b);
+    mrb_value lines = call(GEM, a.obj, "text_box", 5, I(3), I(2), I(3 + 5 * w - 1), I(60), str(GEM, "aa bb cc"));
+    CASE(mrb_fixnum(lines) == 2, "wrapped line count");
+    text(&b, 3, 2 + h - 1, "aa bb");
+    text(&b, 3, 2 + 2 * h - 1, "cc");
+    CASE(same_pixels(&a, &b), "wrap at spaces");
+
+    // Right aligned, a word longer than the box split, and a hard newline.
+    clear(&a, &b);
+    lines = call(GEM, a.obj, "text_box", 6, I(0), I(0), I(4 * w - 1), I(63), str(GEM, "abcdef\nx  y"), kwargs(GEM, "align", sym(GEM, "right"), NULL, I(0)));
+    CASE(mrb_fixnum(lines) == 3, "right aligned line count");
+    text(&b, 0, h - 1, "abcd");
+    text(&b, 2 * w, 2 * h - 1, "ef");
+    text(&b, 0, 3 * h - 1, "x  y");
+    CASE(same_pixels(&a, &b), "right align");
+
+    // Spaces at a wrap don't count toward the line's width, so aligned lines end flush.
+    for (int center = 0; center < 2; center++) {
+      clear(&a, &b);
+      lines = call(GEM, a.obj, "text_box", 6, I(0), I(0), I(5 * w - 1), I(63), str(GEM, "ab  cd efgh"), kwargs(GEM, "align", sym(GEM, center ? "center" : "right"), NULL, I(0)));
+      CASE(mrb_fixnum(lines) == 3, "aligned line count with spaces at the wraps");
+      text(&b, (center ? 3 * w / 2 : 3 * w), h - 1, "ab");
+      text(&b, (center ? 3 * w / 2 : 3 * w), 2 * h - 1, "cd");
+      text(&b, (center ? w / 2 : w), 3 * h - 1, "efgh");
+      CASE(same_pixels(&a, &b), center ? "center ignores spaces at a wrap" : "right ignores spaces at a wrap");
+    }
+
+    // Centered without wrapping, wider than the box, so clipped to it.
+    clear(&a, &b);
+    lines = call(GEM, a.obj, "text_box", 6, I(10), I(5), I(10 + 3 * w), I(5 + h / 2), str(GEM, "wide text here"),
+                 kwargs(GEM, "wrap", mrb_false_value(), "align", sym(GEM, "center")));
+    CASE(mrb_fixnum(lines) == 1, "unwrapped line count");
+    call(GEM, b.obj, "clip", 4, I(10), I(5), I(10 + 3 * w), I(5 + h / 2));
+    text(&b, 10 + (3 * w + 1 - 14 * w) / 2, 5 + h - 1, "wide text here");
+    call(GEM, b.obj, "unclip", 0);
+    CASE(same_pixels(&a, &b), "center and clip to the box");
+
+    // Stays inside a clip that was already set, and puts it back afterwards.
+    clear(&a, &b);
+    call(GEM, a.obj, "clip", 4, I(0), I(0), I(20), I(20));
+    call(GEM, a.obj, "text_box", 5, I(0), I(0), I(100), I(60), str(GEM, "zzzz"));
+    call(GEM, a.obj, "_rectangle", 6, I(0), I(0), I(60), I(60), mrb_true_value(), I(1));
+    call(GEM, a.obj, "unclip", 0);
+    call(GEM, b.obj, "_rectangle", 6, I(0), I(0), I(20), I(20), mrb_true_value(), I(1));
+    CASE(same_pixels(&a, &b), "clip restored after text_box");
+
+    // UTF-8, with @font_map for two characters and "?" for the rest,
+    // including a truncated sequence at the end.
+    mrb_value map = mrb_hash_new(GEM);
+    mrb_hash_set(GEM, map, I(0xE9), I(5));
+    mrb_hash_set(GEM, map, str(GEM, "\xe2\x82\xac"), I(10));
+    iv_set(GEM, a.obj, "@font_map", map);
+    clear(&a, &b);
+    text(&a, 0, h - 1, "\xc3\xa9\xe2\x82\xac\xff!\xe2\x82");
+    text(&b, 0, h - 1, "%*?!??");
+    CASE(same_pixels(&a, &b), "UTF-8 and @font_map");
+
+    clear(&a, &b);
+    text(&a, 4, h - 1, "ab\ncd");
+    mrb_value tc = iv(GEM, a.obj, "@text_cursor");
+    CASE(mrb_fixnum(mrb_ary_ref(GEM, tc, 0)) == 4 + 2 * w && mrb_fixnum(mrb_ary_ref(GEM, tc, 1)) == 2 * h - 1, "cursor after a newline");
+    text(&b, 4, h - 1, "ab");
+    text(&b, 4, 2 * h - 1, "cd");
+    CASE(same_pixels(&a, &b), "newline");
+
+    // Proportional font where every glyph is 3 columns, against a fixed 3 column font.
+    mrb_value chars = iv(GEM, b.obj, "@font_characters"), narrow_a = mrb_ary_new(GEM), narrow_b = mrb_ary_new(GEM), widths = mrb_ary_new(GEM);
+    for (int i = 0; i < RARRAY_LEN(chars); i++) {
+      mrb_value glyph = mrb_ary_ref(GEM, chars, i), narrow = mrb_ary_new(GEM);
+      for (int k = 0; k < 3; k++) mrb_ary_push(GEM, narrow, mrb_ary_ref(GEM, glyph, k));
+      mrb_ary_push(GEM, narrow_a, narrow);
+      mrb_ary_push(GEM, narrow_b, narrow);
+      mrb_ary_push(GEM, widths, I(3));
+    }
+    iv_set(GEM, a.obj, "@font_characters", narrow_a);
+    iv_set(GEM, a.obj, "@font_widths", widths);
+    iv_set(GEM, a.obj, "@font_map", mrb_nil_value());
+    CASE(width(&a, "hello") == 5 * 3 * scale, "proportional text_width");
+    iv_set(GEM, b.obj, "@font_characters", narrow_b);
+    iv_set(GEM, b.obj, "@font_width", I(3));
+    clear(&a, &b);
+    text(&a, 1, h - 1, "Hi there");
+    text(&b, 1, h - 1, "Hi there");
+    CASE(same_pixels(&a, &b), "proportional text");
+    iv_set(GEM, a.obj, "@font_widths", mrb_nil_value());
+    CASE(width(&a, "hello") == 5 * w, "text_width after @font_widths is removed");
+
+    // Scales below 1 draw nothing, from _char or from @font_scale.
+    clear(&a, &b);
+    mrb_value glyph = mrb_ary_ref(GEM, chars, 33);
+    for (int bad_scale = -2; bad_scale <= 0; bad_scale++) {
+      call(GEM, a.obj, "_char", 6, glyph, I(5), I(5), I(6), I(bad_scale), I(1));
+      iv_set(GEM, a.obj, "@font_scale", I(bad_scale));
+      text(&a, 5, 20, "Hi");
+    }
+    CASE(set_bits(&a) == 0, "scale below 1 draws nothing");
+
+    // Metrics and glyphs changed without replacing @font_characters.
+    canvas c = new_font_canvas(GEM, 128, 64, 1, o, 6, 8, scale), d = new_font_canvas(GEM, 128, 64, 1, o, 6, 8, scale);
+    CASE(width(&c, "hello") == 5 * w, "text_width before changing @font_width");
+    iv_set(GEM, c.obj, "@font_width", I(4));
+    CASE(width(&c, "hello") == 5 * 4 * scale, "text_width after changing @font_width");
+    iv_set(GEM, c.obj, "@font_width", I(6));
+    text(&c, 0, h - 1, "\x7f");
+    mrb_value font = iv(GEM, c.obj, "@font_characters");
+    mrb_ary_push(GEM, font, mrb_ary_ref(GEM, font, 33));
+    iv_set(GEM, c.obj, "@font_last_character", I(95));
+    text(&c, 0, h - 1, "\x7f");
+    text(&d, 0, h - 1, "?");
+    text(&d, 0, h - 1, "A");
+    CASE(same_pixels(&c, &d), "glyph appended to @font_characters");
+    #undef CASE
+  }
+  return report("test_text");
+}